@@ -0,0 +1,109 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "file.h"
+#include "stats.h"
+
+// Numbers temporary entries, levels shared between mods may be stored by several threads at once
+static atomic_uint next_temp = 0;
+
+uint64_t cache_key(const struct WolfMap* wolfmap, const struct Config* config) {
+    // Anything else that changes the output either changes the config or comes with a new version
+    uint64_t key = hash_bytes(wolfmap->hash, &config->hash, sizeof(config->hash));
+    key = hash_bytes(key, &config->format, sizeof(config->format));
+    return hash_bytes(key, WOLF2WAD_VERSION, strlen(WOLF2WAD_VERSION));
+}
+
+bool cache_load(const char* cache_dir, struct MapLumps* lumps) {
+    stats_begin(PHASE_CACHE);
+    char* path = cache_path(cache_dir, lumps->key, "lmp");
+    size_t size = 0;
+    uint8_t* data = path == NULL ? NULL : (uint8_t*)read_file(path, &size);
+    free(path);
+    if (data == NULL) {
+        stats_end();
+        return false;
+    }
+
+    // Entries that don't match are just converted again and overwritten
+    const struct CacheHeader* header = (const struct CacheHeader*)data;
+    size_t total = sizeof(struct CacheHeader);
+    if (size >= sizeof(struct CacheHeader))
+        for (int i = 0; i < MAP_LUMPS; i++)
+            total += header->sizes[i];
+    if (size < sizeof(struct CacheHeader) || strncmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != CACHE_VERSION || header->key != lumps->key || total != size) {
+        printf("! cache_load: Ignoring invalid entry %016llx\n", (unsigned long long)lumps->key);
+        stats_free(data);
+        stats_end();
+        return false;
+    }
+
+    memcpy(lumps->name, header->name, LUMP_NAME_MAX);
+    size_t offset = sizeof(struct CacheHeader);
+    for (int i = 0; i < MAP_LUMPS; i++) {
+        lumps->sizes[i] = header->sizes[i];
+        lumps->data[i] = header->sizes[i] > 0 ? data + offset : NULL;
+        offset += header->sizes[i];
+    }
+    lumps->buffer = data;
+    lumps->cached = true;
+    stats_end();
+    return true;
+}
+
+void cache_store(const char* cache_dir, const struct MapLumps* lumps) {
+    // Written under a temporary name first, so that a concurrent run never reads half an entry
+    stats_begin(PHASE_CACHE);
+    char ext[16];
+    snprintf(ext, sizeof(ext), "%u.tmp", atomic_fetch_add(&next_temp, 1));
+    char* path = cache_path(cache_dir, lumps->key, "lmp");
+    char* temp = cache_path(cache_dir, lumps->key, ext);
+    FILE* output = temp == NULL ? NULL : fopen(temp, "wb");
+    if (output == NULL) {
+        printf("! cache_store: Failed to store \"%.8s\" (%s)\n", lumps->name, strerror(errno));
+        free(path);
+        free(temp);
+        stats_end();
+        return;
+    }
+
+    struct CacheHeader header = {0};
+    strncpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    memcpy(header.sizes, lumps->sizes, sizeof(header.sizes));
+    header.key = lumps->key;
+    memcpy(header.name, lumps->name, LUMP_NAME_MAX);
+    fwrite(&header, sizeof(header), 1, output);
+    for (int i = 0; i < MAP_LUMPS; i++)
+        if (lumps->sizes[i] > 0)
+            fwrite(lumps->data[i], lumps->sizes[i], 1, output);
+
+    bool success = !ferror(output);
+    success = fclose(output) == 0 && success;
+    if (success) {
+        // Windows won't rename over an existing file
+        remove(path);
+        success = rename(temp, path) == 0;
+    }
+    if (!success) {
+        printf("! cache_store: Failed to store \"%.8s\"\n", lumps->name);
+        remove(temp);
+    }
+
+    free(path);
+    free(temp);
+    stats_end();
+}
+
+char* cache_path(const char* cache_dir, uint64_t key, const char* ext) {
+    size_t size = strlen(cache_dir) + 32;
+    char* path = malloc(size);
+    if (path != NULL)
+        snprintf(path, size, "%s/%016llx.%s", cache_dir, (unsigned long long)key, ext);
+    return path;
+}
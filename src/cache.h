@@ -0,0 +1,25 @@
+#pragma once
+
+#include "config.h"
+#include "map.h"
+
+#define CACHE_MAGIC "W2WLUMP"
+#define CACHE_VERSION 1
+
+#ifndef WOLF2WAD_VERSION
+#define WOLF2WAD_VERSION "unknown"
+#endif
+
+// Start of a cached level, followed by its lumps in WAD order
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sizes[MAP_LUMPS];
+    uint64_t key;
+    char name[LUMP_NAME_MAX];
+};
+
+uint64_t cache_key(const struct WolfMap*, const struct Config*);
+bool cache_load(const char*, struct MapLumps*);
+void cache_store(const char*, const struct MapLumps*);
+char* cache_path(const char*, uint64_t, const char*);
@@ -1,63 +1,442 @@
+#include <errno.h>
 #include <stdlib.h>
 
 #include "config.h"
+#include "error.h"
+#include "file.h"
+#include "map.h"
+#include "stats.h"
+
+// Door linedefs per axis: entrances, track sides, door faces and jambs
+const struct DoorLine door_lines[2][DOOR_LINES] = {
+    [DAX_X] =
+        {
+            {64, 0, 0, 0, {0}, DSEC_BEFORE, DSEC_LTRACK, LF_TWO_SIDED, false, 0},
+            {0, -64, 64, -64, {0}, DSEC_AFTER, DSEC_RTRACK, LF_TWO_SIDED, false, 0},
+            {0, -64, 0, -35, {0, DTEX_TRACK}, DSEC_RTRACK, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 0},
+            {0, -29, 0, 0, {0, DTEX_TRACK}, DSEC_LTRACK, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 35},
+            {64, -35, 64, -64, {0, DTEX_TRACK}, DSEC_RTRACK, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 35},
+            {64, 0, 64, -29, {0, DTEX_TRACK}, DSEC_LTRACK, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 0},
+            {64, -29, 0, -29, {DTEX_RIGHT}, DSEC_LTRACK, DSEC_DOOR, LF_TWO_SIDED, true, 0},
+            {0, -35, 64, -35, {DTEX_LEFT}, DSEC_RTRACK, DSEC_DOOR, LF_TWO_SIDED, true, 0},
+            {0, -35, 0, -29, {0, DTEX_TRACK}, DSEC_DOOR, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 29},
+            {64, -29, 64, -35, {0, DTEX_TRACK}, DSEC_DOOR, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 29},
+        },
+    [DAX_Y] =
+        {
+            {0, 0, 0, -64, {0}, DSEC_BEFORE, DSEC_LTRACK, LF_TWO_SIDED, false, 0},
+            {64, -64, 64, 0, {0}, DSEC_AFTER, DSEC_RTRACK, LF_TWO_SIDED, false, 0},
+            {0, 0, 29, 0, {0, DTEX_TRACK}, DSEC_LTRACK, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 0},
+            {35, 0, 64, 0, {0, DTEX_TRACK}, DSEC_RTRACK, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 35},
+            {64, -64, 35, -64, {0, DTEX_TRACK}, DSEC_RTRACK, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 0},
+            {29, -64, 0, -64, {0, DTEX_TRACK}, DSEC_LTRACK, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 35},
+            {29, 0, 29, -64, {DTEX_LEFT}, DSEC_LTRACK, DSEC_DOOR, LF_TWO_SIDED, true, 0},
+            {35, -64, 35, 0, {DTEX_RIGHT}, DSEC_RTRACK, DSEC_DOOR, LF_TWO_SIDED, true, 0},
+            {29, 0, 35, 0, {0, DTEX_TRACK}, DSEC_DOOR, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 29},
+            {35, -64, 29, -64, {0, DTEX_TRACK}, DSEC_DOOR, DSEC_NONE, LF_BLOCKING | LF_UNPEG_LOW, false, 29},
+        },
+};
+
+bool config_init(struct Config* config, const char* config_name, const char* image_name) {
+    memset(config, 0, sizeof(struct Config));
 
-static struct Config config = {0};
-
-void config_init(const char* config_name) {
     // Open file
-    yyjson_read_err error;
-    yyjson_doc* json = yyjson_read_file(config_name, JSON_FLAGS, NULL, &error);
-    if (json == NULL) {
-        printf("!!! config_init: Failed to read \"%s\" (%s)\n", config_name, error.msg);
-        exit(EXIT_FAILURE);
+    stats_begin(PHASE_CONFIG);
+    size_t size;
+    char* source = read_file(config_name, &size);
+    if (source == NULL)
+        return fail("config_init: Failed to open \"%s\" (%s)", config_name, strerror(errno));
+
+    // Skip parsing if the compiled image is still up to date
+    config->hash = hash_bytes(HASH_INIT, source, size);
+    if (image_name != NULL && config_load_image(config, image_name, config->hash)) {
+        stats_free(source);
+        printf("config_init: Using config \"%s\" (format: %u, compiled)\n", config->name, config->format);
+        stats_end();
+        return true;
     }
 
+    bool success = config_parse(config, config_name, source, size);
+    stats_free(source);
+    if (!success)
+        return false;
+
+    if (image_name != NULL)
+        config_save_image(config, image_name);
+    stats_end();
+    return true;
+}
+
+bool config_parse(struct Config* config, const char* config_name, const char* source, size_t size) {
+    memset(config, 0, sizeof(struct Config));
+    config->hash = hash_bytes(HASH_INIT, source, size);
+
+    stats_begin(PHASE_CONFIG);
+    yyjson_read_err error;
+    yyjson_doc* json = yyjson_read_opts((char*)source, size, JSON_FLAGS, stats_allocator(), &error);
+    if (json == NULL)
+        return fail("config_parse: Failed to read \"%s\" (%s)", config_name, error.msg);
+
     yyjson_val* root = yyjson_doc_get_root(json);
     if (!yyjson_is_obj(root)) {
-        printf("!!! config_init: Expected root object in \"%s\", got %s\n", config_name, yyjson_get_type_desc(root));
-        exit(EXIT_FAILURE);
+        fail("config_parse: Expected root object in \"%s\", got %s", config_name, yyjson_get_type_desc(root));
+        yyjson_doc_free(json);
+        return false;
     }
 
     // Information
-    parse_name(config.name, NAME_MAX, yyjson_obj_get(root, "name"), "Untitled");
-    parse_map_format(&config.format, yyjson_obj_get(root, "format"));
-    printf("config_init: Using config \"%s\" (format: %u)\n", config.name, config.format);
+    parse_name(config->name, INFO_NAME_MAX, yyjson_obj_get(root, "name"), "Untitled");
+    parse_map_format(&config->format, yyjson_obj_get(root, "format"));
+    printf("config_parse: Using config \"%s\" (format: %u)\n", config->name, config->format);
 
     // Defaults
-    parse_name(config.flats[FLAT_FLOOR], LUMP_NAME_MAX, yyjson_obj_get(root, "floor"), "-");
-    parse_name(config.flats[FLAT_CEILING], LUMP_NAME_MAX, yyjson_obj_get(root, "ceiling"), "-");
-    parse_uint8(&config.brightness, yyjson_obj_get(root, "brightness"), 160);
+    uint16_t none;
+    bool success = intern_lump(config, &none, "-") &&
+                   parse_lump(config, &config->flats[FLAT_FLOOR], yyjson_obj_get(root, "floor"), LUMP_NONE) &&
+                   parse_lump(config, &config->flats[FLAT_CEILING], yyjson_obj_get(root, "ceiling"), LUMP_NONE);
+    parse_uint8(&config->brightness, yyjson_obj_get(root, "brightness"), 160);
+    parse_track_mode(&config->track_mode, yyjson_obj_get(root, "tracks"));
+    parse_order(&config->order, yyjson_obj_get(root, "order"));
+    config->banded = yyjson_get_bool(yyjson_obj_get(root, "banded"));
     /*printf(
-        "config_init: Set defaults (tex: %s/%s, light: %u)\n", config.flats[FLAT_FLOOR], config.flats[FLAT_CEILING],
-        config.brightness
+        "config_init: Set defaults (tex: %.8s/%.8s, light: %u)\n", config->lumps[config->flats[FLAT_FLOOR]],
+        config->lumps[config->flats[FLAT_CEILING]], config->brightness
     );*/
 
-    // Definitions
-    parse_walls(&config.walls, &config.num_walls, yyjson_obj_get(root, "walls"));
-    parse_doors(&config.doors, &config.num_doors, yyjson_obj_get(root, "doors"));
-    parse_objects(&config.objects, &config.num_objects, yyjson_obj_get(root, "objects"));
-    parse_areas(&config.areas, &config.num_areas, yyjson_obj_get(root, "areas"));
+    // Definitions, expanded from ranges and templates so that lookups never see either
+    yyjson_val* templates = yyjson_obj_get(root, "templates");
+    success = success &&
+              parse_walls(config, &config->walls, &config->num_walls, yyjson_obj_get(root, "walls"), templates) &&
+              parse_doors(config, &config->doors, &config->num_doors, yyjson_obj_get(root, "doors"), templates) &&
+              parse_objects(
+                  config, &config->objects, &config->num_objects, yyjson_obj_get(root, "objects"), templates
+              ) &&
+              parse_areas(config, &config->areas, &config->num_areas, yyjson_obj_get(root, "areas"), templates);
+
+    // Lookups index straight into the definitions instead of scanning them
+    success = success &&
+              index_ids(
+                  &config->wall_index, &config->num_wall_ids, config->walls, config->num_walls, sizeof(struct WallInfo)
+              ) &&
+              index_ids(
+                  &config->door_index, &config->num_door_ids, config->doors, config->num_doors, sizeof(struct DoorInfo)
+              ) &&
+              index_ids(
+                  &config->object_index, &config->num_object_ids, config->objects, config->num_objects,
+                  sizeof(struct ObjectInfo)
+              ) &&
+              index_ids(
+                  &config->area_index, &config->num_area_ids, config->areas, config->num_areas, sizeof(struct AreaInfo)
+              );
 
-    // Close file
     yyjson_doc_free(json);
+    if (!success) {
+        config_teardown(config);
+        return false;
+    }
+
+    stats_end();
+    return true;
 }
 
-void config_teardown() {
-    if (config.walls != NULL)
-        free(config.walls);
-    if (config.doors != NULL)
-        free(config.doors);
-    if (config.objects != NULL)
-        free(config.objects);
-    if (config.areas != NULL)
-        free(config.areas);
+void config_teardown(struct Config* config) {
+    if (config->view.data != NULL) {
+        file_unmap(&config->view);
+        memset(config, 0, sizeof(struct Config));
+        return;
+    }
+
+    if (config->walls != NULL)
+        stats_free(config->walls);
+    if (config->doors != NULL)
+        stats_free(config->doors);
+    if (config->objects != NULL)
+        stats_free(config->objects);
+    if (config->areas != NULL)
+        stats_free(config->areas);
+    if (config->lumps != NULL)
+        stats_free(config->lumps);
+    if (config->names != NULL)
+        stats_free(config->names);
+    if (config->wall_index != NULL)
+        stats_free(config->wall_index);
+    if (config->door_index != NULL)
+        stats_free(config->door_index);
+    if (config->object_index != NULL)
+        stats_free(config->object_index);
+    if (config->area_index != NULL)
+        stats_free(config->area_index);
+    memset(config, 0, sizeof(struct Config));
+}
+
+bool config_load_image(struct Config* config, const char* image_name, uint64_t hash) {
+    struct FileView view;
+    if (!file_map(&view, image_name))
+        return false;
+
+    const struct ConfigImage* image = (const struct ConfigImage*)view.data;
+    if (view.size < sizeof(struct ConfigImage) ||
+        strncmp(image->magic, CONFIG_IMAGE_MAGIC, sizeof(image->magic)) != 0 ||
+        image->version != CONFIG_IMAGE_VERSION || image->sizes[0] != sizeof(struct Config) ||
+        image->sizes[1] != sizeof(struct WallInfo) || image->sizes[2] != sizeof(struct DoorInfo) ||
+        image->sizes[3] != sizeof(struct ObjectInfo) || image->sizes[4] != sizeof(struct AreaInfo) ||
+        image->hash != hash) {
+        printf("! config_load_image: \"%s\" is out of date, recompiling\n", image_name);
+        file_unmap(&view);
+        return false;
+    }
+    if (!config_check_image(image, view.size)) {
+        printf("! config_load_image: \"%s\" is damaged, recompiling\n", image_name);
+        file_unmap(&view);
+        return false;
+    }
+
+    *config = image->config;
+    config->view = view;
+    config->walls = (struct WallInfo*)(view.data + image->walls);
+    config->doors = (struct DoorInfo*)(view.data + image->doors);
+    config->objects = (struct ObjectInfo*)(view.data + image->objects);
+    config->areas = (struct AreaInfo*)(view.data + image->areas);
+    config->lumps = (char(*)[LUMP_NAME_MAX])(view.data + image->lumps);
+    config->max_lumps = config->num_lumps;
+    config->names = (char(*)[INFO_NAME_MAX])(view.data + image->names);
+    config->max_names = config->num_names;
+    config->wall_index = (uint16_t*)(view.data + image->wall_index);
+    config->door_index = (uint16_t*)(view.data + image->door_index);
+    config->object_index = (uint16_t*)(view.data + image->object_index);
+    config->area_index = (uint16_t*)(view.data + image->area_index);
+
+    // Every index is used as is later on, so one that is out of range would read past the image
+    if (!config_check_ids(config)) {
+        printf("! config_load_image: \"%s\" refers to missing names or definitions, recompiling\n", image_name);
+        memset(config, 0, sizeof(struct Config));
+        file_unmap(&view);
+        return false;
+    }
+    return true;
+}
+
+bool config_check_image(const struct ConfigImage* image, size_t size) {
+    const uint8_t* data = (const uint8_t*)image;
+    size_t start = offsetof(struct ConfigImage, config);
+    if (hash_bytes(HASH_INIT, data + start, size - start) != image->checksum)
+        return false;
+
+    const struct Config* compiled = &image->config;
+    return image_fits(size, image->walls, compiled->num_walls, sizeof(struct WallInfo), _Alignof(struct WallInfo)) &&
+           image_fits(size, image->doors, compiled->num_doors, sizeof(struct DoorInfo), _Alignof(struct DoorInfo)) &&
+           image_fits(
+               size, image->objects, compiled->num_objects, sizeof(struct ObjectInfo), _Alignof(struct ObjectInfo)
+           ) &&
+           image_fits(size, image->areas, compiled->num_areas, sizeof(struct AreaInfo), _Alignof(struct AreaInfo)) &&
+           image_fits(size, image->lumps, compiled->num_lumps, LUMP_NAME_MAX, 1) &&
+           image_fits(size, image->names, compiled->num_names, INFO_NAME_MAX, 1) &&
+           image_fits(size, image->wall_index, compiled->num_wall_ids, sizeof(uint16_t), _Alignof(uint16_t)) &&
+           image_fits(size, image->door_index, compiled->num_door_ids, sizeof(uint16_t), _Alignof(uint16_t)) &&
+           image_fits(size, image->object_index, compiled->num_object_ids, sizeof(uint16_t), _Alignof(uint16_t)) &&
+           image_fits(size, image->area_index, compiled->num_area_ids, sizeof(uint16_t), _Alignof(uint16_t));
+}
+
+bool image_fits(size_t size, uint64_t offset, size_t count, size_t record, size_t align) {
+    // Divides rather than multiplies, so that no count can wrap around
+    return offset <= size && offset % align == 0 && count <= (size - offset) / record;
+}
+
+bool config_check_ids(const struct Config* config) {
+    size_t lumps = config->num_lumps, names = config->num_names;
+    if (lumps == 0 || lumps > UINT16_MAX + 1 || names > UINT16_MAX + 1 ||
+        memchr(config->name, '\0', INFO_NAME_MAX) == NULL || config->flats[FLAT_FLOOR] >= lumps ||
+        config->flats[FLAT_CEILING] >= lumps || (unsigned)config->format > MAPF_MBF21 ||
+        (unsigned)config->track_mode > TRACKS_AREA || (unsigned)config->order > ORDER_MORTON)
+        return false;
+    for (size_t i = 0; i < names; i++)
+        if (memchr(config->names[i], '\0', INFO_NAME_MAX) == NULL)
+            return false;
+
+    for (size_t i = 0; i < config->num_walls; i++) {
+        const struct WallInfo* wall = &config->walls[i];
+        if (wall->name >= names || (unsigned)wall->type > WALL_MIDTEX || (unsigned)wall->actions[0] > WACT_EXIT ||
+            (unsigned)wall->actions[1] > WACT_EXIT)
+            return false;
+        for (int j = 0; j < 4; j++)
+            if (wall->textures[j] >= lumps)
+                return false;
+    }
+    for (size_t i = 0; i < config->num_doors; i++) {
+        const struct DoorInfo* door = &config->doors[i];
+        if (door->name >= names || (unsigned)door->type > DOOR_BLUE_SKULL || (unsigned)door->axis > DAX_Y ||
+            door->flats[FLAT_FLOOR] >= lumps || door->flats[FLAT_CEILING] >= lumps ||
+            door->sides[SIDE_LEFT] >= lumps || door->sides[SIDE_RIGHT] >= lumps || door->track >= lumps)
+            return false;
+    }
+    for (size_t i = 0; i < config->num_objects; i++) {
+        const struct ObjectInfo* object = &config->objects[i];
+        if (object->name >= names || (unsigned)object->type > OBJ_PUSHWALL)
+            return false;
+    }
+    for (size_t i = 0; i < config->num_areas; i++) {
+        const struct AreaInfo* area = &config->areas[i];
+        if (area->name >= names || (unsigned)area->type > AREA_SECRET_EXIT || area->flats[FLAT_FLOOR] >= lumps ||
+            area->flats[FLAT_CEILING] >= lumps)
+            return false;
+    }
+
+    return index_fits(
+               config->wall_index, config->num_wall_ids, config->walls, config->num_walls, sizeof(struct WallInfo)
+           ) &&
+           index_fits(
+               config->door_index, config->num_door_ids, config->doors, config->num_doors, sizeof(struct DoorInfo)
+           ) &&
+           index_fits(
+               config->object_index, config->num_object_ids, config->objects, config->num_objects,
+               sizeof(struct ObjectInfo)
+           ) &&
+           index_fits(
+               config->area_index, config->num_area_ids, config->areas, config->num_areas, sizeof(struct AreaInfo)
+           );
+}
+
+bool index_fits(const uint16_t* index, size_t num_ids, const void* infos, size_t count, size_t size) {
+    // Lookups trust that every entry points at a definition with that very ID, see index_ids
+    if (num_ids > UINT16_MAX + 1)
+        return false;
+    for (size_t id = 0; id < num_ids; id++)
+        if (index[id] > 0 &&
+            (index[id] > count || *(const int*)((const uint8_t*)infos + (index[id] - 1) * size) != (int)id))
+            return false;
+    return true;
+}
+
+void config_save_image(const struct Config* config, const char* image_name) {
+    FILE* output = fopen(image_name, "wb");
+    if (output == NULL) {
+        printf("! config_save_image: Failed to open \"%s\"\n", image_name);
+        return;
+    }
+
+    struct ConfigImage image = {0};
+    strncpy(image.magic, CONFIG_IMAGE_MAGIC, sizeof(image.magic));
+    image.version = CONFIG_IMAGE_VERSION;
+    image.sizes[0] = sizeof(struct Config);
+    image.sizes[1] = sizeof(struct WallInfo);
+    image.sizes[2] = sizeof(struct DoorInfo);
+    image.sizes[3] = sizeof(struct ObjectInfo);
+    image.sizes[4] = sizeof(struct AreaInfo);
+    image.hash = config->hash;
+
+    image.config = *config;
+    image.config.walls = NULL;
+    image.config.doors = NULL;
+    image.config.objects = NULL;
+    image.config.areas = NULL;
+    image.config.lumps = NULL;
+    image.config.names = NULL;
+    image.config.wall_index = NULL;
+    image.config.door_index = NULL;
+    image.config.object_index = NULL;
+    image.config.area_index = NULL;
+    memset(&image.config.view, 0, sizeof(struct FileView));
+
+    image.walls = sizeof(struct ConfigImage);
+    image.doors = image.walls + config->num_walls * sizeof(struct WallInfo);
+    image.objects = image.doors + config->num_doors * sizeof(struct DoorInfo);
+    image.areas = image.objects + config->num_objects * sizeof(struct ObjectInfo);
+    image.lumps = image.areas + config->num_areas * sizeof(struct AreaInfo);
+    image.names = image.lumps + config->num_lumps * LUMP_NAME_MAX;
+    image.wall_index = image.names + config->num_names * INFO_NAME_MAX;
+    image.door_index = image.wall_index + config->num_wall_ids * sizeof(uint16_t);
+    image.object_index = image.door_index + config->num_door_ids * sizeof(uint16_t);
+    image.area_index = image.object_index + config->num_object_ids * sizeof(uint16_t);
+
+    // The checksum is worked out over the same bytes that are written below
+    size_t start = offsetof(struct ConfigImage, config);
+    uint64_t checksum = hash_bytes(HASH_INIT, (const uint8_t*)&image + start, sizeof(struct ConfigImage) - start);
+    checksum = hash_bytes(checksum, config->walls, config->num_walls * sizeof(struct WallInfo));
+    checksum = hash_bytes(checksum, config->doors, config->num_doors * sizeof(struct DoorInfo));
+    checksum = hash_bytes(checksum, config->objects, config->num_objects * sizeof(struct ObjectInfo));
+    checksum = hash_bytes(checksum, config->areas, config->num_areas * sizeof(struct AreaInfo));
+    checksum = hash_bytes(checksum, config->lumps, config->num_lumps * LUMP_NAME_MAX);
+    checksum = hash_bytes(checksum, config->names, config->num_names * INFO_NAME_MAX);
+    checksum = hash_bytes(checksum, config->wall_index, config->num_wall_ids * sizeof(uint16_t));
+    checksum = hash_bytes(checksum, config->door_index, config->num_door_ids * sizeof(uint16_t));
+    checksum = hash_bytes(checksum, config->object_index, config->num_object_ids * sizeof(uint16_t));
+    checksum = hash_bytes(checksum, config->area_index, config->num_area_ids * sizeof(uint16_t));
+    image.checksum = checksum;
+
+    fwrite(&image, sizeof(struct ConfigImage), 1, output);
+    fwrite(config->walls, sizeof(struct WallInfo), config->num_walls, output);
+    fwrite(config->doors, sizeof(struct DoorInfo), config->num_doors, output);
+    fwrite(config->objects, sizeof(struct ObjectInfo), config->num_objects, output);
+    fwrite(config->areas, sizeof(struct AreaInfo), config->num_areas, output);
+    fwrite(config->lumps, LUMP_NAME_MAX, config->num_lumps, output);
+    fwrite(config->names, INFO_NAME_MAX, config->num_names, output);
+    fwrite(config->wall_index, sizeof(uint16_t), config->num_wall_ids, output);
+    fwrite(config->door_index, sizeof(uint16_t), config->num_door_ids, output);
+    fwrite(config->object_index, sizeof(uint16_t), config->num_object_ids, output);
+    fwrite(config->area_index, sizeof(uint16_t), config->num_area_ids, output);
+    fclose(output);
+
+    printf("config_save_image: Compiled config into \"%s\"\n", image_name);
+}
+
+bool intern_lump(struct Config* config, uint16_t* ptr, const char* name) {
+    for (size_t i = 0; i < config->num_lumps; i++)
+        if (strncmp(config->lumps[i], name, LUMP_NAME_MAX) == 0) {
+            *ptr = i;
+            return true;
+        }
+
+    if (config->num_lumps > UINT16_MAX)
+        return fail("intern_lump: Too many texture and flat names");
+    if (config->num_lumps >= config->max_lumps) {
+        size_t max_lumps = config->max_lumps ? config->max_lumps * 2 : 64;
+        char(*lumps)[LUMP_NAME_MAX] = stats_realloc(config->lumps, max_lumps * LUMP_NAME_MAX);
+        if (lumps == NULL)
+            return fail("intern_lump: Out of memory");
+
+        config->lumps = lumps;
+        config->max_lumps = max_lumps;
+    }
+
+    // Padded with zeroes, so wad_add_map can copy it as is
+    memset(config->lumps[config->num_lumps], 0, LUMP_NAME_MAX);
+    strncpy(config->lumps[config->num_lumps], name, LUMP_NAME_MAX);
+    *ptr = config->num_lumps++;
+    return true;
 }
 
 void parse_name(char* string, size_t size, yyjson_val* value, const char* default_value) {
     strncpy(string, yyjson_is_str(value) ? yyjson_get_str(value) : default_value, size);
 }
 
+bool parse_lump(struct Config* config, uint16_t* ptr, yyjson_val* value, uint16_t default_value) {
+    if (!yyjson_is_str(value)) {
+        *ptr = default_value;
+        return true;
+    }
+
+    return intern_lump(config, ptr, yyjson_get_str(value));
+}
+
+bool parse_info_name(struct Config* config, uint16_t* ptr, yyjson_val* value) {
+    if (config->num_names > UINT16_MAX)
+        return fail("parse_info_name: Too many definitions");
+    if (config->num_names >= config->max_names) {
+        size_t max_names = config->max_names ? config->max_names * 2 : 64;
+        char(*names)[INFO_NAME_MAX] = stats_realloc(config->names, max_names * INFO_NAME_MAX);
+        if (names == NULL)
+            return fail("parse_info_name: Out of memory");
+
+        config->names = names;
+        config->max_names = max_names;
+    }
+
+    memset(config->names[config->num_names], 0, INFO_NAME_MAX);
+    parse_name(config->names[config->num_names], INFO_NAME_MAX - 1, value, "Untitled");
+    *ptr = config->num_names++;
+    return true;
+}
+
 void parse_uint8(uint8_t* ptr, yyjson_val* value, uint8_t default_value) {
     *ptr = (value == NULL || !yyjson_is_num(value)) ? default_value : (uint8_t)yyjson_get_uint(value);
 }
@@ -66,6 +445,105 @@ void parse_uint16(uint16_t* ptr, yyjson_val* value, uint16_t default_value) {
     *ptr = (value == NULL || !yyjson_is_num(value)) ? default_value : (uint16_t)yyjson_get_uint(value);
 }
 
+bool parse_id_range(const char* key, int* first, int* last) {
+    char* end;
+    unsigned long from = strtoul(key, &end, 0), to = from;
+    if (*end == '-')
+        to = strtoul(end + 1, &end, 0);
+    if (*end != '\0' || from == 0 || to < from || to > UINT16_MAX)
+        return false;
+
+    *first = (int)from;
+    *last = (int)to;
+    return true;
+}
+
+size_t count_ids(yyjson_val* value) {
+    // Invalid definitions count once, the parse_* functions reject them later
+    size_t count = 0, i, n;
+    yyjson_val *key, *val;
+    yyjson_obj_foreach(value, i, n, key, val) {
+        int first, last;
+        bool valid = yyjson_is_obj(val) && parse_id_range(yyjson_get_str(key), &first, &last);
+        count += valid ? (size_t)(last - first + 1) : 1;
+    }
+    return count;
+}
+
+bool index_ids(uint16_t** index, size_t* num_ids, const void* infos, size_t count, size_t size) {
+    // Every kind of definition starts with its ID
+    *index = NULL;
+    *num_ids = 0;
+    if (count >= UINT16_MAX)
+        return fail("index_ids: Too many definitions (max %d)", UINT16_MAX - 1);
+    for (size_t i = 0; i < count; i++) {
+        int id = *(const int*)((const uint8_t*)infos + i * size);
+        if ((size_t)id >= *num_ids)
+            *num_ids = id + 1;
+    }
+    if (*num_ids == 0)
+        return true;
+
+    *index = stats_calloc(*num_ids, sizeof(uint16_t));
+    if (*index == NULL)
+        return fail("index_ids: Out of memory");
+
+    // Later definitions of the same ID never won a lookup, so they don't here either
+    for (size_t i = 0; i < count; i++) {
+        int id = *(const int*)((const uint8_t*)infos + i * size);
+        if ((*index)[id] == 0)
+            (*index)[id] = i + 1;
+    }
+    return true;
+}
+
+bool check_templates(yyjson_val* templates, yyjson_val* info, int depth) {
+    yyjson_val* names = yyjson_obj_get(info, "template");
+    if (names == NULL)
+        return true;
+    if (depth >= MAX_TEMPLATE_DEPTH)
+        return false;
+    if (yyjson_is_str(names)) {
+        yyjson_val* base = yyjson_obj_get(templates, yyjson_get_str(names));
+        return yyjson_is_obj(base) && check_templates(templates, base, depth + 1);
+    }
+
+    size_t i, n;
+    yyjson_val* name;
+    yyjson_arr_foreach(names, i, n, name) {
+        yyjson_val* base = yyjson_obj_get(templates, yyjson_get_str(name));
+        if (!yyjson_is_obj(base) || !check_templates(templates, base, depth + 1))
+            return false;
+    }
+    return yyjson_is_arr(names);
+}
+
+yyjson_val* get_field(const struct InfoFields* fields, const char* key) {
+    // Arrays give every ID of a range its own value, e.g. the angles of four guards facing each way
+    yyjson_val* value = find_field(fields->templates, fields->info, key);
+    size_t size = yyjson_arr_size(value);
+    return size > 0 ? yyjson_arr_get(value, fields->index % size) : value;
+}
+
+yyjson_val* find_field(yyjson_val* templates, yyjson_val* info, const char* key) {
+    yyjson_val* value = yyjson_obj_get(info, key);
+    if (value != NULL)
+        return value;
+
+    // Templates are searched in the order they're listed, each one along with its own templates
+    yyjson_val* names = yyjson_obj_get(info, "template");
+    if (yyjson_is_str(names))
+        return find_field(templates, yyjson_obj_get(templates, yyjson_get_str(names)), key);
+
+    size_t i, n;
+    yyjson_val* name;
+    yyjson_arr_foreach(names, i, n, name) {
+        if ((value = find_field(templates, yyjson_obj_get(templates, yyjson_get_str(name)), key)) != NULL)
+            return value;
+    }
+    return NULL;
+}
+
 void parse_map_format(enum MapFormats* ptr, yyjson_val* value) {
     if (value == NULL || !yyjson_is_str(value)) {
         *ptr = MAPF_MBF21;
@@ -83,51 +561,78 @@ void parse_map_format(enum MapFormats* ptr, yyjson_val* value) {
         *ptr = MAPF_MBF21;
 }
 
-void parse_walls(struct WallInfo** walls, size_t* num_walls, yyjson_val* value) {
+void parse_track_mode(enum TrackModes* ptr, yyjson_val* value) {
+    if (value == NULL || !yyjson_is_str(value)) {
+        *ptr = TRACKS_DOOR;
+        return;
+    }
+
+    const char* mode = yyjson_get_str(value);
+    *ptr = strcmp(mode, "area") == 0 ? TRACKS_AREA : TRACKS_DOOR;
+}
+
+void parse_order(enum ArrayOrders* ptr, yyjson_val* value) {
+    const char* order = yyjson_get_str(value);
+    *ptr = order != NULL && strcmp(order, "morton") == 0 ? ORDER_MORTON : ORDER_SCAN;
+}
+
+bool parse_walls(
+    struct Config* config, struct WallInfo** walls, size_t* num_walls, yyjson_val* value, yyjson_val* templates
+) {
     if (value == NULL || !yyjson_is_obj(value)) {
         *walls = NULL;
         *num_walls = 0;
-        return;
+        return true;
     }
 
-    *num_walls = yyjson_obj_size(value);
-    *walls = calloc(*num_walls, sizeof(struct WallInfo));
-    if (*walls == NULL) {
-        printf("!!! parse_walls: Out of memory for wall map\n");
-        exit(EXIT_FAILURE);
-    }
+    *num_walls = count_ids(value);
+    *walls = stats_calloc(*num_walls, sizeof(struct WallInfo));
+    if (*walls == NULL)
+        return fail("parse_walls: Out of memory for wall map");
 
-    size_t i, n;
+    size_t i, n, count = 0;
     yyjson_val *key, *val;
     yyjson_obj_foreach(value, i, n, key, val) {
-        struct WallInfo* wall = &(*walls)[i];
-        if ((wall->id = strtoul(yyjson_get_str(key), NULL, 0)) == 0) {
-            printf("!!! parse_walls: Expected wall ID as non-zero integer\n");
-            exit(EXIT_FAILURE);
-        }
-
-        if (!yyjson_is_obj(val)) {
-            printf("!!! parse_walls: Expected wall %d info as object, got %s\n", wall->id, yyjson_get_type_desc(val));
-            exit(EXIT_FAILURE);
+        int first, last;
+        if (!parse_id_range(yyjson_get_str(key), &first, &last))
+            return fail("parse_walls: Expected wall ID as non-zero integer or range");
+
+        if (!yyjson_is_obj(val))
+            return fail("parse_walls: Expected wall %d info as object, got %s", first, yyjson_get_type_desc(val));
+        if (!check_templates(templates, val, 0))
+            return fail("parse_walls: Wall %d uses an unknown or circular template", first);
+
+        for (int id = first; id <= last; id++) {
+            struct InfoFields fields = {val, templates, id - first};
+            if (!parse_wall(config, &(*walls)[count++], id, &fields))
+                return false;
         }
-
-        parse_name(wall->name, NAME_MAX, yyjson_obj_get(val, "name"), "Untitled");
-        parse_wall_type(&wall->type, yyjson_obj_get(val, "type"));
-        parse_name(wall->textures[SIDE_X], LUMP_NAME_MAX, yyjson_obj_get(val, "xtex"), "-");
-        parse_name(wall->textures[SIDE_Y], LUMP_NAME_MAX, yyjson_obj_get(val, "ytex"), wall->textures[SIDE_X]);
-        parse_name(wall->textures[SIDE_BACK_X], LUMP_NAME_MAX, yyjson_obj_get(val, "xback"), wall->textures[SIDE_X]);
-        parse_name(wall->textures[SIDE_BACK_Y], LUMP_NAME_MAX, yyjson_obj_get(val, "yback"), wall->textures[SIDE_Y]);
-        parse_wall_action(&wall->actions[SIDE_X], yyjson_obj_get(val, "xact"));
-        parse_wall_action(&wall->actions[SIDE_Y], yyjson_obj_get(val, "yact"));
-        parse_uint16(&wall->tag, yyjson_obj_get(val, "tag"), 0);
-
-        /*printf(
-            "parse_walls: Wall %d is \"%s\" (tex: %s/%s, act: %u/%u, tag: %u)\n", wall->id, wall->name,
-            wall->textures[SIDE_X], wall->textures[SIDE_Y], wall->actions[SIDE_X], wall->actions[SIDE_Y], wall->tag
-        );*/
     }
 
     // printf("parse_walls: Found %zu wall(s)\n", *num_walls);
+    return true;
+}
+
+bool parse_wall(struct Config* config, struct WallInfo* wall, int id, const struct InfoFields* fields) {
+    wall->id = id;
+    if (!parse_info_name(config, &wall->name, get_field(fields, "name")))
+        return false;
+    parse_wall_type(&wall->type, get_field(fields, "type"));
+    if (!parse_lump(config, &wall->textures[SIDE_X], get_field(fields, "xtex"), LUMP_NONE) ||
+        !parse_lump(config, &wall->textures[SIDE_Y], get_field(fields, "ytex"), wall->textures[SIDE_X]) ||
+        !parse_lump(config, &wall->textures[SIDE_BACK_X], get_field(fields, "xback"), wall->textures[SIDE_X]) ||
+        !parse_lump(config, &wall->textures[SIDE_BACK_Y], get_field(fields, "yback"), wall->textures[SIDE_Y]))
+        return false;
+    parse_wall_action(&wall->actions[SIDE_X], get_field(fields, "xact"));
+    parse_wall_action(&wall->actions[SIDE_Y], get_field(fields, "yact"));
+    parse_uint16(&wall->tag, get_field(fields, "tag"), 0);
+
+    /*printf(
+        "parse_wall: Wall %d is \"%s\" (tex: %.8s/%.8s, act: %u/%u, tag: %u)\n", wall->id, config->names[wall->name],
+        config->lumps[wall->textures[SIDE_X]], config->lumps[wall->textures[SIDE_Y]], wall->actions[SIDE_X],
+        wall->actions[SIDE_Y], wall->tag
+    );*/
+    return true;
 }
 
 void parse_wall_type(enum WallTypes* ptr, yyjson_val* value) {
@@ -158,57 +663,69 @@ void parse_wall_action(enum WallActions* ptr, yyjson_val* value) {
         *ptr = WACT_NONE;
 }
 
-void parse_doors(struct DoorInfo** doors, size_t* num_doors, yyjson_val* value) {
+bool parse_doors(
+    struct Config* config, struct DoorInfo** doors, size_t* num_doors, yyjson_val* value, yyjson_val* templates
+) {
     if (value == NULL || !yyjson_is_obj(value)) {
         *doors = NULL;
         *num_doors = 0;
-        return;
+        return true;
     }
 
-    *num_doors = yyjson_obj_size(value);
-    *doors = calloc(*num_doors, sizeof(struct DoorInfo));
-    if (*doors == NULL) {
-        printf("!!! parse_doors: Out of memory for door map\n");
-        exit(EXIT_FAILURE);
-    }
+    *num_doors = count_ids(value);
+    *doors = stats_calloc(*num_doors, sizeof(struct DoorInfo));
+    if (*doors == NULL)
+        return fail("parse_doors: Out of memory for door map");
 
-    size_t i, n;
+    size_t i, n, count = 0;
     yyjson_val *key, *val;
     yyjson_obj_foreach(value, i, n, key, val) {
-        struct DoorInfo* door = &(*doors)[i];
-        if ((door->id = strtoul(yyjson_get_str(key), NULL, 0)) == 0) {
-            printf("!!! parse_doors: Expected door ID as non-zero integer\n");
-            exit(EXIT_FAILURE);
-        }
-
-        if (!yyjson_is_obj(val)) {
-            printf("!!! parse_doors: Expected door %d info as object, got %s\n", door->id, yyjson_get_type_desc(val));
-            exit(EXIT_FAILURE);
+        int first, last;
+        if (!parse_id_range(yyjson_get_str(key), &first, &last))
+            return fail("parse_doors: Expected door ID as non-zero integer or range");
+
+        if (!yyjson_is_obj(val))
+            return fail("parse_doors: Expected door %d info as object, got %s", first, yyjson_get_type_desc(val));
+        if (!check_templates(templates, val, 0))
+            return fail("parse_doors: Door %d uses an unknown or circular template", first);
+
+        for (int id = first; id <= last; id++) {
+            struct InfoFields fields = {val, templates, id - first};
+            if (!parse_door(config, &(*doors)[count++], id, &fields))
+                return false;
         }
-
-        parse_name(door->name, NAME_MAX, yyjson_obj_get(val, "name"), "Untitled");
-        parse_door_type(&door->type, yyjson_obj_get(val, "type"));
-        parse_door_axis(&door->axis, yyjson_obj_get(val, "axis"));
-        parse_name(door->flats[FLAT_FLOOR], LUMP_NAME_MAX, yyjson_obj_get(val, "floor"), config.flats[FLAT_FLOOR]);
-        parse_name(
-            door->flats[FLAT_CEILING], LUMP_NAME_MAX, yyjson_obj_get(val, "ceiling"), config.flats[FLAT_CEILING]
-        );
-        parse_name(door->sides[SIDE_LEFT], LUMP_NAME_MAX, yyjson_obj_get(val, "ltex"), "-");
-        parse_name(door->sides[SIDE_RIGHT], LUMP_NAME_MAX, yyjson_obj_get(val, "rtex"), door->sides[SIDE_LEFT]);
-        parse_name(door->track, LUMP_NAME_MAX, yyjson_obj_get(val, "track"), "-");
-        parse_uint16(&door->tag, yyjson_obj_get(val, "tag"), 0);
-
-        /*printf(
-            "parse_doors: Door %d is \"%s\" (type: %u, axis: %u, flat: %s/%s, side: %s/%s, track: %s, tag: %u)\n",
-            door->id, door->name, door->type, door->axis, door->flats[FLAT_FLOOR], door->flats[FLAT_CEILING],
-            door->sides[SIDE_LEFT], door->sides[SIDE_RIGHT], door->track, door->tag
-        );*/
     }
 
     // printf("parse_doors: Found %zu door(s)\n", *num_doors);
+    return true;
+}
+
+bool parse_door(struct Config* config, struct DoorInfo* door, int id, const struct InfoFields* fields) {
+    door->id = id;
+    if (!parse_info_name(config, &door->name, get_field(fields, "name")))
+        return false;
+    parse_door_type(config, &door->type, get_field(fields, "type"));
+    parse_door_axis(&door->axis, get_field(fields, "axis"));
+    if (!parse_lump(config, &door->flats[FLAT_FLOOR], get_field(fields, "floor"), config->flats[FLAT_FLOOR]) ||
+        !parse_lump(config, &door->flats[FLAT_CEILING], get_field(fields, "ceiling"), config->flats[FLAT_CEILING]) ||
+        !parse_lump(config, &door->sides[SIDE_LEFT], get_field(fields, "ltex"), LUMP_NONE) ||
+        !parse_lump(config, &door->sides[SIDE_RIGHT], get_field(fields, "rtex"), door->sides[SIDE_LEFT]) ||
+        !parse_lump(config, &door->track, get_field(fields, "track"), LUMP_NONE))
+        return false;
+    parse_uint16(&door->tag, get_field(fields, "tag"), 0);
+    compile_door(door);
+
+    /*printf(
+        "parse_door: Door %d is \"%s\" (type: %u, axis: %u, flat: %.8s/%.8s, side: %.8s/%.8s, track: %.8s, "
+        "tag: %u)\n",
+        door->id, config->names[door->name], door->type, door->axis, config->lumps[door->flats[FLAT_FLOOR]],
+        config->lumps[door->flats[FLAT_CEILING]], config->lumps[door->sides[SIDE_LEFT]],
+        config->lumps[door->sides[SIDE_RIGHT]], config->lumps[door->track], door->tag
+    );*/
+    return true;
 }
 
-void parse_door_type(enum DoorTypes* ptr, yyjson_val* value) {
+void parse_door_type(const struct Config* config, enum DoorTypes* ptr, yyjson_val* value) {
     if (value == NULL || !yyjson_is_str(value)) {
         *ptr = DOOR_NORMAL;
         return;
@@ -226,42 +743,42 @@ void parse_door_type(enum DoorTypes* ptr, yyjson_val* value) {
     else if (strcmp(type, "blue") == 0)
         *ptr = DOOR_BLUE;
     else if (strcmp(type, "red_card") == 0) {
-        if (config.format == MAPF_DOOM) {
+        if (config->format == MAPF_DOOM) {
             printf("! parse_door_type: Reverting \"red_card\" to \"red\" for vanilla format\n");
             *ptr = DOOR_RED;
         } else {
             *ptr = DOOR_RED_CARD;
         }
     } else if (strcmp(type, "yellow_card") == 0) {
-        if (config.format == MAPF_DOOM) {
+        if (config->format == MAPF_DOOM) {
             printf("! parse_door_type: Reverting \"yellow_card\" to \"yellow\" for vanilla format\n");
             *ptr = DOOR_YELLOW;
         } else {
             *ptr = DOOR_YELLOW_CARD;
         }
     } else if (strcmp(type, "blue_card") == 0) {
-        if (config.format == MAPF_DOOM) {
+        if (config->format == MAPF_DOOM) {
             printf("! parse_door_type: Reverting \"blue_card\" to \"blue\" for vanilla format\n");
             *ptr = DOOR_BLUE;
         } else {
             *ptr = DOOR_BLUE_CARD;
         }
     } else if (strcmp(type, "red_skull") == 0) {
-        if (config.format == MAPF_DOOM) {
+        if (config->format == MAPF_DOOM) {
             printf("! parse_door_type: Reverting \"red_skull\" to \"red\" for vanilla format\n");
             *ptr = DOOR_RED;
         } else {
             *ptr = DOOR_RED_SKULL;
         }
     } else if (strcmp(type, "yellow_skull") == 0) {
-        if (config.format == MAPF_DOOM) {
+        if (config->format == MAPF_DOOM) {
             printf("! parse_door_type: Reverting \"yellow_skull\" to \"yellow\" for vanilla format\n");
             *ptr = DOOR_YELLOW;
         } else {
             *ptr = DOOR_YELLOW_SKULL;
         }
     } else if (strcmp(type, "blue_skull") == 0) {
-        if (config.format == MAPF_DOOM) {
+        if (config->format == MAPF_DOOM) {
             printf("! parse_door_type: Reverting \"blue_skull\" to \"blue\" for vanilla format\n");
             *ptr = DOOR_BLUE;
         } else {
@@ -275,63 +792,106 @@ void parse_door_axis(enum DoorAxes* ptr, yyjson_val* value) {
     *ptr = (value == NULL || !yyjson_is_str(value) || strcmp(yyjson_get_str(value), "y") != 0) ? DAX_X : DAX_Y;
 }
 
-void parse_objects(struct ObjectInfo** objects, size_t* num_objects, yyjson_val* value) {
+void compile_door(struct DoorInfo* door) {
+    switch (door->type) {
+        default:
+        case DOOR_NORMAL:
+            door->special = LT_DOOR;
+            break;
+        case DOOR_FAST:
+            door->special = LT_DOOR_FAST;
+            break;
+        case DOOR_RED:
+            door->special = LT_DOOR_RED;
+            break;
+        case DOOR_YELLOW:
+            door->special = LT_DOOR_YELLOW;
+            break;
+        case DOOR_BLUE:
+            door->special = LT_DOOR_BLUE;
+            break;
+        case DOOR_RED_CARD:
+            door->special = LT_DOOR_RED_CARD;
+            break;
+        case DOOR_YELLOW_CARD:
+            door->special = LT_DOOR_YELLOW_CARD;
+            break;
+        case DOOR_BLUE_CARD:
+            door->special = LT_DOOR_BLUE_CARD;
+            break;
+        case DOOR_RED_SKULL:
+            door->special = LT_DOOR_RED_SKULL;
+            break;
+        case DOOR_YELLOW_SKULL:
+            door->special = LT_DOOR_YELLOW_SKULL;
+            break;
+        case DOOR_BLUE_SKULL:
+            door->special = LT_DOOR_BLUE_SKULL;
+            break;
+    }
+}
+
+bool parse_objects(
+    struct Config* config, struct ObjectInfo** objects, size_t* num_objects, yyjson_val* value, yyjson_val* templates
+) {
     if (value == NULL || !yyjson_is_obj(value)) {
         *objects = NULL;
         *num_objects = 0;
-        return;
+        return true;
     }
 
-    *num_objects = yyjson_obj_size(value);
-    *objects = calloc(*num_objects, sizeof(struct ObjectInfo));
-    if (*objects == NULL) {
-        printf("!!! parse_objects: Out of memory for object map\n");
-        exit(EXIT_FAILURE);
-    }
+    *num_objects = count_ids(value);
+    *objects = stats_calloc(*num_objects, sizeof(struct ObjectInfo));
+    if (*objects == NULL)
+        return fail("parse_objects: Out of memory for object map");
 
-    size_t i, n;
+    size_t i, n, count = 0;
     yyjson_val *key, *val;
     yyjson_obj_foreach(value, i, n, key, val) {
-        struct ObjectInfo* object = &(*objects)[i];
-        if ((object->id = strtoul(yyjson_get_str(key), NULL, 0)) == 0) {
-            printf("!!! parse_objects: Expected object ID as non-zero integer\n");
-            exit(EXIT_FAILURE);
-        }
-
-        if (!yyjson_is_obj(val)) {
-            printf(
-                "!!! parse_objects: Expected object %d info as object, got %s\n", object->id, yyjson_get_type_desc(val)
-            );
-            exit(EXIT_FAILURE);
+        int first, last;
+        if (!parse_id_range(yyjson_get_str(key), &first, &last))
+            return fail("parse_objects: Expected object ID as non-zero integer or range");
+
+        if (!yyjson_is_obj(val))
+            return fail("parse_objects: Expected object %d info as object, got %s", first, yyjson_get_type_desc(val));
+        if (!check_templates(templates, val, 0))
+            return fail("parse_objects: Object %d uses an unknown or circular template", first);
+
+        for (int id = first; id <= last; id++) {
+            struct InfoFields fields = {val, templates, id - first};
+            if (!parse_object(config, &(*objects)[count++], id, &fields))
+                return false;
         }
+    }
 
-        parse_name(object->name, NAME_MAX, yyjson_obj_get(val, "name"), "Untitled");
-        parse_object_type(&object->type, yyjson_obj_get(val, "type"));
-
-        if (object->type == OBJ_THING) {
-            parse_uint16(&object->ednum, yyjson_obj_get(val, "ednum"), 0);
-            if (object->ednum <= 0) {
-                printf(
-                    "!!! parse_objects: Expected object %d DoomEdNum as non-zero unsigned 16-bit integer\n", object->id
-                );
-                exit(EXIT_FAILURE);
-            }
-
-            parse_uint16(&object->angle, yyjson_obj_get(val, "angle"), 0);
-            parse_object_flags(&object->flags, val);
-        } else {
-            object->ednum = 0;
-            object->angle = 0;
-            object->flags = TF_NONE;
-        }
+    // printf("parse_objects: Found %zu object(s)\n", *num_objects);
+    return true;
+}
 
-        /*printf(
-            "parse_objects: Object %d is \"%s\" (type: %u, ednum: %u, angle: %u, flags: %u)\n", object->id,
-            object->name, object->type, object->ednum, object->angle, object->flags
-        );*/
+bool parse_object(struct Config* config, struct ObjectInfo* object, int id, const struct InfoFields* fields) {
+    object->id = id;
+    if (!parse_info_name(config, &object->name, get_field(fields, "name")))
+        return false;
+    parse_object_type(&object->type, get_field(fields, "type"));
+
+    if (object->type == OBJ_THING) {
+        parse_uint16(&object->ednum, get_field(fields, "ednum"), 0);
+        if (object->ednum <= 0)
+            return fail("parse_object: Expected object %d DoomEdNum as non-zero unsigned 16-bit integer", object->id);
+
+        parse_uint16(&object->angle, get_field(fields, "angle"), 0);
+        parse_object_flags(config, &object->flags, fields);
+    } else {
+        object->ednum = 0;
+        object->angle = 0;
+        object->flags = TF_NONE;
     }
 
-    // printf("parse_objects: Found %zu object(s)\n", *num_objects);
+    /*printf(
+        "parse_object: Object %d is \"%s\" (type: %u, ednum: %u, angle: %u, flags: %u)\n", object->id,
+        config->names[object->name], object->type, object->ednum, object->angle, object->flags
+    );*/
+    return true;
 }
 
 void parse_object_type(enum ObjectTypes* ptr, yyjson_val* value) {
@@ -349,76 +909,85 @@ void parse_object_type(enum ObjectTypes* ptr, yyjson_val* value) {
         *ptr = OBJ_MARKER;
 }
 
-void parse_object_flags(enum ThingFlags* ptr, yyjson_val* value) {
+void parse_object_flags(const struct Config* config, enum ThingFlags* ptr, const struct InfoFields* fields) {
     *ptr = TF_NONE;
 
     yyjson_val* flag;
-    if ((flag = yyjson_obj_get(value, "easy")) == NULL || !yyjson_is_bool(flag) || yyjson_get_bool(flag))
+    if ((flag = get_field(fields, "easy")) == NULL || !yyjson_is_bool(flag) || yyjson_get_bool(flag))
         *ptr |= TF_EASY;
-    if ((flag = yyjson_obj_get(value, "normal")) == NULL || !yyjson_is_bool(flag) || yyjson_get_bool(flag))
+    if ((flag = get_field(fields, "normal")) == NULL || !yyjson_is_bool(flag) || yyjson_get_bool(flag))
         *ptr |= TF_NORMAL;
-    if ((flag = yyjson_obj_get(value, "hard")) == NULL || !yyjson_is_bool(flag) || yyjson_get_bool(flag))
+    if ((flag = get_field(fields, "hard")) == NULL || !yyjson_is_bool(flag) || yyjson_get_bool(flag))
         *ptr |= TF_HARD;
-    if ((flag = yyjson_obj_get(value, "ambush")) != NULL && yyjson_is_bool(flag) && yyjson_get_bool(flag))
+    if ((flag = get_field(fields, "ambush")) != NULL && yyjson_is_bool(flag) && yyjson_get_bool(flag))
         *ptr |= TF_AMBUSH;
-    if ((flag = yyjson_obj_get(value, "multiplayer")) != NULL && yyjson_is_bool(flag) && yyjson_get_bool(flag))
+    if ((flag = get_field(fields, "multiplayer")) != NULL && yyjson_is_bool(flag) && yyjson_get_bool(flag))
         *ptr |= TF_MULTIPLAYER;
-    if ((flag = yyjson_obj_get(value, "no_deathmatch")) != NULL && yyjson_is_bool(flag) && yyjson_get_bool(flag))
+    if ((flag = get_field(fields, "no_deathmatch")) != NULL && yyjson_is_bool(flag) && yyjson_get_bool(flag))
         *ptr |= TF_NO_DEATHMATCH;
-    if ((flag = yyjson_obj_get(value, "no_coop")) != NULL && yyjson_is_bool(flag) && yyjson_get_bool(flag))
+    if ((flag = get_field(fields, "no_coop")) != NULL && yyjson_is_bool(flag) && yyjson_get_bool(flag))
         *ptr |= TF_NO_COOP;
-    if ((flag = yyjson_obj_get(value, "friendly")) != NULL && yyjson_is_bool(flag) && yyjson_get_bool(flag)) {
-        if (config.format < MAPF_MBF)
+    if ((flag = get_field(fields, "friendly")) != NULL && yyjson_is_bool(flag) && yyjson_get_bool(flag)) {
+        if (config->format < MAPF_MBF)
             printf("! parse_object_flags: \"friendly\" cannot be used in Boom and older\n");
         else
             *ptr |= TF_FRIENDLY;
     }
 }
 
-void parse_areas(struct AreaInfo** areas, size_t* num_areas, yyjson_val* value) {
+bool parse_areas(
+    struct Config* config, struct AreaInfo** areas, size_t* num_areas, yyjson_val* value, yyjson_val* templates
+) {
     if (value == NULL || !yyjson_is_obj(value)) {
         *areas = NULL;
         *num_areas = 0;
-        return;
+        return true;
     }
 
-    *num_areas = yyjson_obj_size(value);
-    *areas = calloc(*num_areas, sizeof(struct AreaInfo));
-    if (*areas == NULL) {
-        printf("!!! parse_areas: Out of memory for area map\n");
-        exit(EXIT_FAILURE);
-    }
+    *num_areas = count_ids(value);
+    *areas = stats_calloc(*num_areas, sizeof(struct AreaInfo));
+    if (*areas == NULL)
+        return fail("parse_areas: Out of memory for area map");
 
-    size_t i, n;
+    size_t i, n, count = 0;
     yyjson_val *key, *val;
     yyjson_obj_foreach(value, i, n, key, val) {
-        struct AreaInfo* area = &(*areas)[i];
-        if ((area->id = strtoul(yyjson_get_str(key), NULL, 0)) == 0) {
-            printf("!!! parse_areas: Expected area ID as non-zero integer\n");
-            exit(EXIT_FAILURE);
-        }
-
-        if (!yyjson_is_obj(val)) {
-            printf("!!! parse_areas: Expected area %d info as object, got %s\n", area->id, yyjson_get_type_desc(val));
-            exit(EXIT_FAILURE);
+        int first, last;
+        if (!parse_id_range(yyjson_get_str(key), &first, &last))
+            return fail("parse_areas: Expected area ID as non-zero integer or range");
+
+        if (!yyjson_is_obj(val))
+            return fail("parse_areas: Expected area %d info as object, got %s", first, yyjson_get_type_desc(val));
+        if (!check_templates(templates, val, 0))
+            return fail("parse_areas: Area %d uses an unknown or circular template", first);
+
+        for (int id = first; id <= last; id++) {
+            struct InfoFields fields = {val, templates, id - first};
+            if (!parse_area(config, &(*areas)[count++], id, &fields))
+                return false;
         }
-
-        parse_name(area->name, NAME_MAX, yyjson_obj_get(val, "name"), "Untitled");
-        parse_area_type(&area->type, yyjson_obj_get(val, "type"));
-        parse_name(area->flats[FLAT_FLOOR], LUMP_NAME_MAX, yyjson_obj_get(val, "floor"), config.flats[FLAT_FLOOR]);
-        parse_name(
-            area->flats[FLAT_CEILING], LUMP_NAME_MAX, yyjson_obj_get(val, "ceiling"), config.flats[FLAT_CEILING]
-        );
-        parse_uint8(&area->brightness, yyjson_obj_get(val, "brightness"), config.brightness);
-        parse_uint16(&area->tag, yyjson_obj_get(val, "tag"), 0);
-
-        /*printf(
-            "parse_areas: Area %d is \"%s\" (type: %u, flat: %s/%s, light: %u)\n", area->id, area->name, area->type,
-            area->flats[FLAT_FLOOR], area->flats[FLAT_CEILING], area->brightness
-        );*/
     }
 
     // printf("parse_areas: Found %zu area(s)\n", *num_areas);
+    return true;
+}
+
+bool parse_area(struct Config* config, struct AreaInfo* area, int id, const struct InfoFields* fields) {
+    area->id = id;
+    if (!parse_info_name(config, &area->name, get_field(fields, "name")))
+        return false;
+    parse_area_type(&area->type, get_field(fields, "type"));
+    if (!parse_lump(config, &area->flats[FLAT_FLOOR], get_field(fields, "floor"), config->flats[FLAT_FLOOR]) ||
+        !parse_lump(config, &area->flats[FLAT_CEILING], get_field(fields, "ceiling"), config->flats[FLAT_CEILING]))
+        return false;
+    parse_uint8(&area->brightness, get_field(fields, "brightness"), config->brightness);
+    parse_uint16(&area->tag, get_field(fields, "tag"), 0);
+
+    /*printf(
+        "parse_area: Area %d is \"%s\" (type: %u, flat: %.8s/%.8s, light: %u)\n", area->id, config->names[area->name],
+        area->type, config->lumps[area->flats[FLAT_FLOOR]], config->lumps[area->flats[FLAT_CEILING]], area->brightness
+    );*/
+    return true;
 }
 
 void parse_area_type(enum AreaTypes* ptr, yyjson_val* value) {
@@ -444,57 +1013,49 @@ void parse_area_type(enum AreaTypes* ptr, yyjson_val* value) {
         *ptr = AREA_NORMAL;
 }
 
-const struct Config* get_config() {
-    return &config;
-}
-
-const struct DoorInfo* get_door_info(int id) {
-    if (id <= 0)
+const struct DoorInfo* get_door_info(const struct Config* config, int id) {
+    if (id <= 0 || (size_t)id >= config->num_door_ids)
         return NULL;
-    for (size_t i = 0; i < config.num_doors; i++)
-        if (config.doors[i].id == id)
-            return &config.doors[i];
-    return NULL;
+    stats_lookup(LOOKUP_DOOR, 1);
+    uint16_t i = config->door_index[id];
+    return i > 0 ? &config->doors[i - 1] : NULL;
 }
 
-const struct WallInfo* get_wall_info(int id) {
-    if (id <= 0)
+const struct WallInfo* get_wall_info(const struct Config* config, int id) {
+    if (id <= 0 || (size_t)id >= config->num_wall_ids)
         return NULL;
-    for (size_t i = 0; i < config.num_walls; i++)
-        if (config.walls[i].id == id)
-            return &config.walls[i];
-    return NULL;
+    stats_lookup(LOOKUP_WALL, 1);
+    uint16_t i = config->wall_index[id];
+    return i > 0 ? &config->walls[i - 1] : NULL;
 }
 
-const struct ObjectInfo* get_object_info(int id) {
-    if (id <= 0)
+const struct ObjectInfo* get_object_info(const struct Config* config, int id) {
+    if (id <= 0 || (size_t)id >= config->num_object_ids)
         return NULL;
-    for (size_t i = 0; i < config.num_objects; i++)
-        if (config.objects[i].id == id)
-            return &config.objects[i];
-    return NULL;
+    stats_lookup(LOOKUP_OBJECT, 1);
+    uint16_t i = config->object_index[id];
+    return i > 0 ? &config->objects[i - 1] : NULL;
 }
 
-const struct AreaInfo* get_area_info(int id) {
-    if (id <= 0)
+const struct AreaInfo* get_area_info(const struct Config* config, int id) {
+    if (id <= 0 || (size_t)id >= config->num_area_ids)
         return NULL;
-    for (size_t i = 0; i < config.num_areas; i++)
-        if (config.areas[i].id == id)
-            return &config.areas[i];
-    return NULL;
+    stats_lookup(LOOKUP_AREA, 1);
+    uint16_t i = config->area_index[id];
+    return i > 0 ? &config->areas[i - 1] : NULL;
 }
 
-bool oid_is_pushwall(int id) {
-    const struct ObjectInfo* obj = get_object_info(id);
+bool oid_is_pushwall(const struct Config* config, int id) {
+    const struct ObjectInfo* obj = get_object_info(config, id);
     return obj != NULL && obj->type == OBJ_PUSHWALL;
 }
 
-bool aid_is_secret_exit(int id) {
-    const struct AreaInfo* area = get_area_info(id);
+bool aid_is_secret_exit(const struct Config* config, int id) {
+    const struct AreaInfo* area = get_area_info(config, id);
     return area != NULL && area->type == AREA_SECRET_EXIT;
 }
 
-bool aid_is_ambush(int id) {
-    const struct AreaInfo* area = get_area_info(id);
+bool aid_is_ambush(const struct Config* config, int id) {
+    const struct AreaInfo* area = get_area_info(config, id);
     return area != NULL && area->type == AREA_AMBUSH;
 }
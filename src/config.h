@@ -1,12 +1,19 @@
 #pragma once
 
+#include "file.h"
 #include "yyjson.h"
 
 #define JSON_FLAGS (YYJSON_READ_ALLOW_COMMENTS | YYJSON_READ_ALLOW_TRAILING_COMMAS)
 
-#define NAME_MAX 128
+#define CONFIG_IMAGE_MAGIC "W2WCONF"
+#define CONFIG_IMAGE_VERSION 11
+
+#define INFO_NAME_MAX 128
 #define LUMP_NAME_MAX 8
 
+// ID of "-", always the first lump name interned
+#define LUMP_NONE 0
+
 #define FLAT_FLOOR 0
 #define FLAT_CEILING 1
 
@@ -17,6 +24,9 @@
 #define SIDE_LEFT 0
 #define SIDE_RIGHT 1
 
+#define DOOR_LINES 10
+#define MAX_TEMPLATE_DEPTH 8
+
 enum MapFormats {
     MAPF_DOOM,
     MAPF_BOOM,
@@ -24,18 +34,50 @@ enum MapFormats {
     MAPF_MBF21,
 };
 
+// Which doors share their track sectors
+enum TrackModes {
+    TRACKS_DOOR, // Two for every door
+    TRACKS_AREA, // Between doors opening into the same sector
+};
+
+// Order of the vertex, line and side arrays that are written out
+enum ArrayOrders {
+    ORDER_SCAN,   // As the passes find them
+    ORDER_MORTON, // Along a Morton curve, sides grouped by sector
+};
+
 struct Config {
-    char name[NAME_MAX];
+    char name[INFO_NAME_MAX];
     enum MapFormats format;
 
-    char flats[2][LUMP_NAME_MAX];
+    uint16_t flats[2];
     uint8_t brightness;
+    enum TrackModes track_mode;
+    enum ArrayOrders order;
+
+    // Convert big maps a few columns at a time, see map_banded
+    bool banded;
+
+    // Texture and flat names, referred to everywhere else by their index
+    char (*lumps)[LUMP_NAME_MAX];
+    size_t num_lumps, max_lumps;
+
+    // Display names of the definitions, kept apart from what the passes read
+    char (*names)[INFO_NAME_MAX];
+    size_t num_names, max_names;
 
     struct WallInfo* walls;
     struct DoorInfo* doors;
     struct ObjectInfo* objects;
     struct AreaInfo* areas;
     size_t num_walls, num_doors, num_objects, num_areas;
+
+    // 1 + index of the first definition of every ID up to the highest one, 0 if it has none, see index_ids
+    uint16_t *wall_index, *door_index, *object_index, *area_index;
+    size_t num_wall_ids, num_door_ids, num_object_ids, num_area_ids;
+
+    uint64_t hash;
+    struct FileView view;
 };
 
 enum WallTypes {
@@ -51,14 +93,14 @@ enum WallActions {
 
 struct WallInfo {
     int id;
-    char name[NAME_MAX];
-
     enum WallTypes type;
 
-    char textures[4][LUMP_NAME_MAX];
+    uint16_t textures[4];
 
     enum WallActions actions[2];
     uint16_t tag;
+
+    uint16_t name;
 };
 
 enum DoorTypes {
@@ -81,18 +123,49 @@ enum DoorAxes {
     DAX_Y,
 };
 
+enum DoorTextures {
+    DTEX_NONE,
+    DTEX_LEFT,
+    DTEX_RIGHT,
+    DTEX_TRACK,
+    NUM_DOOR_TEXTURES,
+};
+
+enum DoorSectors {
+    DSEC_NONE,
+    DSEC_DOOR,
+    DSEC_LTRACK,
+    DSEC_RTRACK,
+    DSEC_BEFORE, // Tile in front of the left entrance
+    DSEC_AFTER,  // Tile in front of the right entrance
+    NUM_DOOR_SECTORS,
+};
+
+// Linedef of a door relative to the top left corner of its tile
+struct DoorLine {
+    int8_t x1, y1, x2, y2;
+    uint8_t textures[6];
+    uint8_t sector, back_sector;
+    uint16_t flags;
+    bool action;
+    int16_t x_offset;
+};
+
 struct DoorInfo {
     int id;
-    char name[NAME_MAX];
+    uint16_t name;
 
     enum DoorTypes type;
     enum DoorAxes axis;
 
-    char flats[2][LUMP_NAME_MAX];
-    char sides[2][LUMP_NAME_MAX];
-    char track[LUMP_NAME_MAX];
+    uint16_t flats[2];
+    uint16_t sides[2];
+    uint16_t track;
 
     uint16_t tag;
+
+    // Compiled by compile_door, the lines are the same for every door along an axis, see door_lines
+    uint16_t special;
 };
 
 enum ObjectTypes {
@@ -115,7 +188,7 @@ enum ThingFlags {
 
 struct ObjectInfo {
     int id;
-    char name[NAME_MAX];
+    uint16_t name;
     enum ObjectTypes type;
 
     uint16_t ednum, angle;
@@ -134,43 +207,87 @@ enum AreaTypes {
 
 struct AreaInfo {
     int id;
-    char name[NAME_MAX];
+    uint16_t name;
     enum AreaTypes type;
 
-    char flats[2][LUMP_NAME_MAX];
+    uint16_t flats[2];
     uint8_t brightness;
     uint16_t tag;
 };
 
-void config_init(const char*);
-void config_teardown();
+// Compiled config, memory-mapped and used in place on later runs. The checksum covers everything from config on.
+struct ConfigImage {
+    char magic[8];
+    uint32_t version;
+    uint32_t sizes[5];
+    uint64_t hash, checksum;
+
+    struct Config config;
+    uint64_t walls, doors, objects, areas, lumps, names;
+    uint64_t wall_index, door_index, object_index, area_index;
+};
+
+// Info object of a definition, fields it doesn't have come from its templates, see get_field
+struct InfoFields {
+    yyjson_val *info, *templates;
+    size_t index; // Of the ID within a range key like "108-111"
+};
+
+bool config_init(struct Config*, const char*, const char*);
+bool config_parse(struct Config*, const char*, const char*, size_t);
+void config_teardown(struct Config*);
+
+bool config_load_image(struct Config*, const char*, uint64_t);
+bool config_check_image(const struct ConfigImage*, size_t);
+bool config_check_ids(const struct Config*);
+bool image_fits(size_t, uint64_t, size_t, size_t, size_t);
+bool index_fits(const uint16_t*, size_t, const void*, size_t, size_t);
+void config_save_image(const struct Config*, const char*);
+
+bool intern_lump(struct Config*, uint16_t*, const char*);
 
 void parse_name(char*, size_t, yyjson_val*, const char*);
+bool parse_lump(struct Config*, uint16_t*, yyjson_val*, uint16_t);
+bool parse_info_name(struct Config*, uint16_t*, yyjson_val*);
 void parse_uint8(uint8_t*, yyjson_val*, uint8_t);
 void parse_uint16(uint16_t*, yyjson_val*, uint16_t);
+bool parse_id_range(const char*, int*, int*);
+size_t count_ids(yyjson_val*);
+bool index_ids(uint16_t**, size_t*, const void*, size_t, size_t);
+bool check_templates(yyjson_val*, yyjson_val*, int);
+yyjson_val* get_field(const struct InfoFields*, const char*);
+yyjson_val* find_field(yyjson_val*, yyjson_val*, const char*);
 
 void parse_map_format(enum MapFormats*, yyjson_val*);
+void parse_track_mode(enum TrackModes*, yyjson_val*);
+void parse_order(enum ArrayOrders*, yyjson_val*);
 
-void parse_walls(struct WallInfo**, size_t*, yyjson_val*);
+bool parse_walls(struct Config*, struct WallInfo**, size_t*, yyjson_val*, yyjson_val*);
+bool parse_wall(struct Config*, struct WallInfo*, int, const struct InfoFields*);
 void parse_wall_type(enum WallTypes*, yyjson_val*);
 void parse_wall_action(enum WallActions*, yyjson_val*);
 
-void parse_doors(struct DoorInfo**, size_t*, yyjson_val*);
-void parse_door_type(enum DoorTypes*, yyjson_val*);
+bool parse_doors(struct Config*, struct DoorInfo**, size_t*, yyjson_val*, yyjson_val*);
+bool parse_door(struct Config*, struct DoorInfo*, int, const struct InfoFields*);
+void parse_door_type(const struct Config*, enum DoorTypes*, yyjson_val*);
 void parse_door_axis(enum DoorAxes*, yyjson_val*);
+void compile_door(struct DoorInfo*);
+
+extern const struct DoorLine door_lines[2][DOOR_LINES];
 
-void parse_objects(struct ObjectInfo**, size_t*, yyjson_val*);
+bool parse_objects(struct Config*, struct ObjectInfo**, size_t*, yyjson_val*, yyjson_val*);
+bool parse_object(struct Config*, struct ObjectInfo*, int, const struct InfoFields*);
 void parse_object_type(enum ObjectTypes*, yyjson_val*);
-void parse_object_flags(enum ThingFlags*, yyjson_val*);
+void parse_object_flags(const struct Config*, enum ThingFlags*, const struct InfoFields*);
 
-void parse_areas(struct AreaInfo**, size_t*, yyjson_val*);
+bool parse_areas(struct Config*, struct AreaInfo**, size_t*, yyjson_val*, yyjson_val*);
+bool parse_area(struct Config*, struct AreaInfo*, int, const struct InfoFields*);
 void parse_area_type(enum AreaTypes*, yyjson_val*);
 
-const struct Config* get_config();
-const struct WallInfo* get_wall_info(int);
-const struct DoorInfo* get_door_info(int);
-const struct ObjectInfo* get_object_info(int);
-const struct AreaInfo* get_area_info(int);
-bool oid_is_pushwall(int);
-bool aid_is_secret_exit(int);
-bool aid_is_ambush(int);
+const struct WallInfo* get_wall_info(const struct Config*, int);
+const struct DoorInfo* get_door_info(const struct Config*, int);
+const struct ObjectInfo* get_object_info(const struct Config*, int);
+const struct AreaInfo* get_area_info(const struct Config*, int);
+bool oid_is_pushwall(const struct Config*, int);
+bool aid_is_secret_exit(const struct Config*, int);
+bool aid_is_ambush(const struct Config*, int);
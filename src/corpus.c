@@ -0,0 +1,321 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "corpus.h"
+#include "file.h"
+#include "pool.h"
+#include "serve.h"
+#include "stats.h"
+#include "trace.h"
+#include "verify.h"
+
+bool corpus(
+    const struct Config* config, const char* root, const char* output_dir, const char* mapping_name,
+    const char* cache_dir, bool dry_run, bool verify
+) {
+    double start = get_time();
+    struct Corpus corpus = {0};
+    corpus.config = config;
+    corpus.root = root;
+    corpus.output_dir = output_dir;
+    corpus.cache_dir = cache_dir;
+    corpus.dry_run = dry_run;
+    corpus.verify = verify;
+
+    bool success = true;
+    if (!make_dir(output_dir))
+        success = fail("corpus: Failed to create output directory \"%s\" (%s)", output_dir, strerror(errno));
+    success = success && (mapping_name == NULL || corpus_configs(&corpus, mapping_name)) && corpus_scan(&corpus, root);
+    if (success && corpus.num_mods == 0)
+        success = fail("corpus: No MAPHEAD/GAMEMAPS pairs found in \"%s\"", root);
+
+    // One mod per task, whichever thread is free takes the next one
+    if (success) {
+        printf("corpus: Converting %zu mod(s) from \"%s\"\n", corpus.num_mods, root);
+        pool_run(corpus_mod, &corpus, corpus.num_mods);
+
+        char* report_name = join_path(output_dir, "report.json");
+        success = report_name != NULL && corpus_report(&corpus, report_name, get_time() - start);
+        free(report_name);
+        for (size_t i = 0; i < corpus.num_mods; i++)
+            success = success && corpus.mods[i].success;
+    }
+
+    for (size_t i = 0; i < corpus.num_mods; i++) {
+        free(corpus.mods[i].maphead);
+        free(corpus.mods[i].gamemaps);
+        free(corpus.mods[i].output);
+    }
+    stats_free(corpus.mods);
+    for (size_t i = 0; i < corpus.num_configs; i++) {
+        config_teardown(&corpus.configs[i].config);
+        free(corpus.configs[i].name);
+    }
+
+    return success;
+}
+
+bool corpus_configs(struct Corpus* corpus, const char* mapping_name) {
+    size_t size;
+    char* source = read_file(mapping_name, &size);
+    if (source == NULL)
+        return fail("corpus_configs: Failed to open \"%s\" (%s)", mapping_name, strerror(errno));
+
+    yyjson_read_err error;
+    yyjson_doc* json = yyjson_read_opts(source, size, JSON_FLAGS, stats_allocator(), &error);
+    stats_free(source);
+    if (json == NULL)
+        return fail("corpus_configs: Failed to read \"%s\" (%s)", mapping_name, error.msg);
+
+    yyjson_val* root = yyjson_doc_get_root(json);
+    if (!yyjson_is_obj(root)) {
+        fail("corpus_configs: Expected root object in \"%s\", got %s", mapping_name, yyjson_get_type_desc(root));
+        yyjson_doc_free(json);
+        return false;
+    }
+
+    // Maps extensions to configs, e.g. {"wl6": "config.json", "sod": "spearres.json"}
+    bool success = true;
+    size_t i, n;
+    yyjson_val *key, *val;
+    yyjson_obj_foreach(root, i, n, key, val) {
+        const char *ext = yyjson_get_str(key), *name = yyjson_get_str(val);
+        if (name == NULL || strlen(ext) >= CORPUS_EXT_MAX) {
+            printf("! corpus_configs: Skipping \"%s\", expected an extension mapped to a config file\n", ext);
+            continue;
+        }
+        if (corpus->num_configs >= CORPUS_MAX_CONFIGS) {
+            printf("! corpus_configs: Too many configs (max %d), skipping \"%s\"\n", CORPUS_MAX_CONFIGS, ext);
+            continue;
+        }
+
+        struct CorpusConfig* it = &corpus->configs[corpus->num_configs];
+        for (size_t j = 0; ext[j] != '\0'; j++)
+            it->ext[j] = (char)tolower((unsigned char)ext[j]);
+        it->name = malloc(strlen(name) + 1);
+        if (it->name == NULL) {
+            success = fail("corpus_configs: Out of memory");
+            break;
+        }
+        strcpy(it->name, name);
+        if (!config_init(&it->config, name, NULL)) {
+            free(it->name);
+            success = false;
+            break;
+        }
+        ++corpus->num_configs;
+    }
+
+    yyjson_doc_free(json);
+    return success;
+}
+
+bool corpus_scan(struct Corpus* corpus, const char* dir) {
+    struct DirEntry* entries;
+    size_t num_entries;
+    if (!read_dir(dir, &entries, &num_entries)) {
+        if (dir == corpus->root)
+            return fail("corpus_scan: Failed to read directory \"%s\"", dir);
+        printf("! corpus_scan: Failed to read directory \"%s\", skipping it\n", dir);
+        return true;
+    }
+
+    // Mod files can be named in any case, e.g. "MAPHEAD.WL6" next to "gamemaps.wl6"
+    bool success = true;
+    for (size_t i = 0; i < num_entries && success; i++) {
+        const char* ext = entries[i].name + strlen("MAPHEAD.");
+        if (entries[i].dir || !has_prefix(entries[i].name, "MAPHEAD.") || *ext == '\0')
+            continue;
+
+        const char* gamemaps = NULL;
+        for (size_t j = 0; j < num_entries && gamemaps == NULL; j++)
+            if (!entries[j].dir && has_prefix(entries[j].name, "GAMEMAPS.") &&
+                strlen(entries[j].name) == strlen("GAMEMAPS.") + strlen(ext) &&
+                has_prefix(entries[j].name + strlen("GAMEMAPS."), ext))
+                gamemaps = entries[j].name;
+
+        if (gamemaps == NULL)
+            printf("! corpus_scan: No GAMEMAPS.%s next to \"%s/%s\"\n", ext, dir, entries[i].name);
+        else if (strlen(ext) >= CORPUS_EXT_MAX)
+            printf("! corpus_scan: Skipping \"%s/%s\", extension is too long\n", dir, entries[i].name);
+        else
+            success = corpus_add_mod(corpus, dir, entries[i].name, gamemaps, ext);
+    }
+
+    for (size_t i = 0; i < num_entries && success; i++)
+        if (entries[i].dir) {
+            char* path = join_path(dir, entries[i].name);
+            success = path != NULL ? corpus_scan(corpus, path) : fail("corpus_scan: Out of memory");
+            free(path);
+        }
+
+    free_dir(entries, num_entries);
+    return success;
+}
+
+bool corpus_add_mod(
+    struct Corpus* corpus, const char* dir, const char* maphead_name, const char* gamemaps_name, const char* ext
+) {
+    if (corpus->num_mods >= corpus->max_mods) {
+        size_t max_mods = corpus->max_mods ? corpus->max_mods * 2 : 64;
+        struct CorpusMod* grown = stats_realloc(corpus->mods, max_mods * sizeof(struct CorpusMod));
+        if (grown == NULL)
+            return fail("corpus_add_mod: Out of memory");
+        corpus->mods = grown;
+        corpus->max_mods = max_mods;
+    }
+
+    struct CorpusMod* mod = &corpus->mods[corpus->num_mods];
+    memset(mod, 0, sizeof(struct CorpusMod));
+    for (size_t i = 0; ext[i] != '\0'; i++)
+        mod->ext[i] = (char)tolower((unsigned char)ext[i]);
+    for (size_t i = 0; i < corpus->num_configs && mod->config == NULL; i++)
+        if (strcmp(corpus->configs[i].ext, mod->ext) == 0)
+            mod->config = &corpus->configs[i];
+
+    // Outputs are named after the mod's directory below the root, e.g. "mods/foo/bar" -> "foo_bar.wl6.wad"
+    const char* relative = dir + strlen(corpus->root);
+    while (*relative == '/' || *relative == '\\')
+        ++relative;
+    if (*relative == '\0')
+        relative = "mod";
+
+    size_t length = strlen(relative) + strlen(mod->ext) + 6;
+    char* output = malloc(length);
+    if (output == NULL)
+        return fail("corpus_add_mod: Out of memory");
+    snprintf(output, length, "%s.%s.wad", relative, mod->ext);
+    for (char* c = output; *c != '\0'; c++)
+        if (*c == '/' || *c == '\\')
+            *c = '_';
+
+    mod->maphead = join_path(dir, maphead_name);
+    mod->gamemaps = join_path(dir, gamemaps_name);
+    mod->output = join_path(corpus->output_dir, output);
+    free(output);
+    if (mod->maphead == NULL || mod->gamemaps == NULL || mod->output == NULL) {
+        free(mod->maphead);
+        free(mod->gamemaps);
+        free(mod->output);
+        return fail("corpus_add_mod: Out of memory");
+    }
+
+    ++corpus->num_mods;
+    return true;
+}
+
+void corpus_mod(void* ctx, size_t index) {
+    struct Corpus* corpus = ctx;
+    struct CorpusMod* mod = &corpus->mods[index];
+    double start = get_time();
+    trace_begin("mod", TRACE_NO_LEVEL);
+
+    // A mod that fails only takes itself down, its error ends up in the report
+    int levels[MAX_LEVELS];
+    const struct Config* config = mod->config != NULL ? &mod->config->config : corpus->config;
+    mod->success =
+        corpus_levels(mod->maphead, levels, &mod->num_levels) &&
+        map_convert(
+            config, mod->maphead, mod->gamemaps, levels, mod->num_levels, corpus->dry_run ? NULL : mod->output, false,
+            corpus->cache_dir, NULL
+        ) &&
+        (!corpus->verify || corpus->dry_run || verify_wad(mod->output));
+    if (!mod->success)
+        snprintf(mod->error, ERROR_MAX, "%s", get_error());
+    mod->time = get_time() - start;
+    trace_end("mod");
+}
+
+bool corpus_levels(const char* maphead_name, int* levels, size_t* num_levels) {
+    *num_levels = 0;
+    FILE* maphead = fopen(maphead_name, "rb");
+    if (maphead == NULL)
+        return fail("corpus_levels: Failed to open MAPHEAD \"%s\" (%s)", maphead_name, strerror(errno));
+
+    // Magic, then the offset of every level in GAMEMAPS, 0 for empty slots
+    uint16_t magic;
+    int32_t offsets[MAX_LEVELS];
+    size_t count = 0;
+    if (fread(&magic, sizeof(uint16_t), 1, maphead) == 1)
+        count = fread(offsets, sizeof(int32_t), MAX_LEVELS, maphead);
+    fclose(maphead);
+
+    for (size_t i = 0; i < count; i++)
+        if (s32le(offsets[i]) > 0)
+            levels[(*num_levels)++] = (int)i;
+    if (*num_levels == 0)
+        return fail("corpus_levels: No levels found in MAPHEAD \"%s\"", maphead_name);
+    return true;
+}
+
+bool corpus_report(const struct Corpus* corpus, const char* report_name, double time) {
+    size_t failed = 0;
+    for (size_t i = 0; i < corpus->num_mods; i++)
+        if (!corpus->mods[i].success) {
+            printf("! corpus: \"%s\" failed (%s)\n", corpus->mods[i].maphead, corpus->mods[i].error);
+            ++failed;
+        }
+    printf(
+        "corpus: Converted %zu of %zu mod(s) in %.3f ms\n", corpus->num_mods - failed, corpus->num_mods, time * 1000
+    );
+
+    FILE* output = fopen(report_name, "wb");
+    if (output == NULL)
+        return fail("corpus_report: Failed to open \"%s\" (%s)", report_name, strerror(errno));
+
+    fprintf(output, "{\"root\":");
+    write_json_string(output, corpus->root);
+    fprintf(
+        output, ",\"converted\":%zu,\"failed\":%zu,\"time_ms\":%.3f,\"mods\":[", corpus->num_mods - failed, failed,
+        time * 1000
+    );
+    for (size_t i = 0; i < corpus->num_mods; i++) {
+        const struct CorpusMod* mod = &corpus->mods[i];
+        const struct Config* config = mod->config != NULL ? &mod->config->config : corpus->config;
+        fprintf(output, "%s\n{\"maphead\":", i ? "," : "");
+        write_json_string(output, mod->maphead);
+        fprintf(output, ",\"gamemaps\":");
+        write_json_string(output, mod->gamemaps);
+        fprintf(output, ",\"config\":");
+        write_json_string(output, config->name);
+        fprintf(output, ",\"ok\":%s,\"time_ms\":%.3f", mod->success ? "true" : "false", mod->time * 1000);
+        if (mod->success) {
+            if (!corpus->dry_run) {
+                fprintf(output, ",\"output\":");
+                write_json_string(output, mod->output);
+            }
+            fprintf(output, ",\"levels\":%zu", mod->num_levels);
+        } else {
+            fprintf(output, ",\"error\":");
+            write_json_string(output, mod->error);
+        }
+        fputc('}', output);
+    }
+    fprintf(output, "\n]}\n");
+
+    bool success = !ferror(output);
+    fclose(output);
+    if (!success)
+        return fail("corpus_report: Failed to write \"%s\"", report_name);
+    printf("corpus_report: Saved report in \"%s\"\n", report_name);
+    return true;
+}
+
+char* join_path(const char* dir, const char* name) {
+    size_t length = strlen(dir) + strlen(name) + 2;
+    char* path = malloc(length);
+    if (path != NULL)
+        snprintf(path, length, "%s/%s", dir, name);
+    return path;
+}
+
+bool has_prefix(const char* string, const char* prefix) {
+    // Case-insensitive, mods come from DOS where file names were
+    for (; *prefix != '\0'; string++, prefix++)
+        if (tolower((unsigned char)*string) != tolower((unsigned char)*prefix))
+            return false;
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "config.h"
+#include "error.h"
+#include "map.h"
+
+#define CORPUS_MAX_CONFIGS 16
+#define CORPUS_EXT_MAX 8
+
+// Config used for mods whose files end in ext, see corpus_configs
+struct CorpusConfig {
+    char ext[CORPUS_EXT_MAX];
+    char* name;
+    struct Config config;
+};
+
+// MAPHEAD/GAMEMAPS pair found by corpus_scan, filled in once converted
+struct CorpusMod {
+    char *maphead, *gamemaps, *output;
+    char ext[CORPUS_EXT_MAX];
+    const struct CorpusConfig* config;
+
+    bool success;
+    double time;
+    size_t num_levels;
+    char error[ERROR_MAX];
+};
+
+struct Corpus {
+    const struct Config* config;
+    const char *root, *output_dir, *cache_dir;
+    bool dry_run, verify;
+
+    struct CorpusConfig configs[CORPUS_MAX_CONFIGS];
+    size_t num_configs;
+    struct CorpusMod* mods;
+    size_t num_mods, max_mods;
+};
+
+bool corpus(const struct Config*, const char*, const char*, const char*, const char*, bool, bool);
+bool corpus_configs(struct Corpus*, const char*);
+bool corpus_scan(struct Corpus*, const char*);
+bool corpus_add_mod(struct Corpus*, const char*, const char*, const char*, const char*);
+void corpus_mod(void*, size_t);
+bool corpus_levels(const char*, int*, size_t*);
+bool corpus_report(const struct Corpus*, const char*, double);
+
+char* join_path(const char*, const char*);
+bool has_prefix(const char*, const char*);
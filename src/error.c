@@ -0,0 +1,25 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "error.h"
+
+static _Thread_local char error[ERROR_MAX] = "";
+
+bool fail(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error, ERROR_MAX, format, args);
+    va_end(args);
+
+    printf("!!! %s\n", error);
+    return false;
+}
+
+const char* get_error() {
+    return error;
+}
+
+void set_error(const char* message) {
+    // Carries an error over from another thread, which already printed it
+    snprintf(error, ERROR_MAX, "%s", message);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdbool.h>
+
+#define ERROR_MAX 512
+
+bool fail(const char*, ...);
+const char* get_error();
+void set_error(const char*);
@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 200809L
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file.h"
+#include "stats.h"
+
+char* read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* data = stats_malloc(length > 0 ? length : 1);
+    if (data == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    *size = fread(data, sizeof(char), length > 0 ? length : 0, file);
+    fclose(file);
+    return data;
+}
+
+bool file_map(struct FileView* view, const char* path) {
+    view->data = NULL;
+    view->size = 0;
+
+#ifdef _WIN32
+    view->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (view->file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(view->file, &size) || size.QuadPart <= 0) {
+        CloseHandle(view->file);
+        return false;
+    }
+
+    view->mapping = CreateFileMappingA(view->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (view->mapping == NULL) {
+        CloseHandle(view->file);
+        return false;
+    }
+
+    view->data = MapViewOfFile(view->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view->data == NULL) {
+        CloseHandle(view->mapping);
+        CloseHandle(view->file);
+        return false;
+    }
+    view->size = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    view->data = data;
+    view->size = st.st_size;
+#endif
+
+    return true;
+}
+
+void file_unmap(struct FileView* view) {
+    if (view->data == NULL)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(view->data);
+    CloseHandle(view->mapping);
+    CloseHandle(view->file);
+#else
+    munmap(view->data, view->size);
+#endif
+
+    view->data = NULL;
+    view->size = 0;
+}
+
+bool read_dir(const char* path, struct DirEntry** entries, size_t* num_entries) {
+    *entries = NULL;
+    *num_entries = 0;
+    size_t max_entries = 0, length = strlen(path);
+    char* full = stats_malloc(length + FILENAME_MAX + 2);
+    if (full == NULL)
+        return false;
+
+#ifdef _WIN32
+    snprintf(full, length + FILENAME_MAX + 2, "%s\\*", path);
+    WIN32_FIND_DATAA found;
+    HANDLE find = FindFirstFileA(full, &found);
+    stats_free(full);
+    if (find == INVALID_HANDLE_VALUE)
+        return false;
+
+    bool success = true;
+    do {
+        const char* name = found.cFileName;
+        bool dir = (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+    DIR* stream = opendir(path);
+    if (stream == NULL) {
+        stats_free(full);
+        return false;
+    }
+
+    bool success = true;
+    for (struct dirent* found; success && (found = readdir(stream)) != NULL;) {
+        const char* name = found->d_name;
+        struct stat st;
+        snprintf(full, length + FILENAME_MAX + 2, "%s/%s", path, name);
+        bool dir = stat(full, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+
+        if (*num_entries >= max_entries) {
+            max_entries = max_entries ? max_entries * 2 : 16;
+            struct DirEntry* grown = stats_realloc(*entries, max_entries * sizeof(struct DirEntry));
+            if (grown == NULL) {
+                success = false;
+                break;
+            }
+            *entries = grown;
+        }
+
+        struct DirEntry* entry = &(*entries)[*num_entries];
+        entry->name = stats_malloc(strlen(name) + 1);
+        if (entry->name == NULL) {
+            success = false;
+            break;
+        }
+        strcpy(entry->name, name);
+        entry->dir = dir;
+        ++*num_entries;
+#ifdef _WIN32
+    } while (FindNextFileA(find, &found));
+    FindClose(find);
+#else
+    }
+    closedir(stream);
+    stats_free(full);
+#endif
+
+    if (!success) {
+        free_dir(*entries, *num_entries);
+        *entries = NULL;
+        *num_entries = 0;
+        return false;
+    }
+
+    // Listing order depends on the file system, sorting keeps runs over the same tree alike
+    if (*num_entries > 1)
+        qsort(*entries, *num_entries, sizeof(struct DirEntry), compare_entries);
+    return true;
+}
+
+void free_dir(struct DirEntry* entries, size_t num_entries) {
+    for (size_t i = 0; i < num_entries; i++)
+        stats_free(entries[i].name);
+    stats_free(entries);
+}
+
+int compare_entries(const void* a, const void* b) {
+    return strcmp(((const struct DirEntry*)a)->name, ((const struct DirEntry*)b)->name);
+}
+
+bool make_dir(const char* path) {
+#ifdef _WIN32
+    return _mkdir(path) == 0 || errno == EEXIST;
+#else
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+#endif
+}
+
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    // FNV-1a
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define HASH_INIT 0xCBF29CE484222325ULL
+
+struct FileView {
+    uint8_t* data;
+    size_t size;
+
+#ifdef _WIN32
+    void *file, *mapping;
+#endif
+};
+
+// Entry of a directory listing, see read_dir
+struct DirEntry {
+    char* name;
+    bool dir;
+};
+
+char* read_file(const char*, size_t*);
+
+bool file_map(struct FileView*, const char*);
+void file_unmap(struct FileView*);
+
+bool read_dir(const char*, struct DirEntry**, size_t*);
+void free_dir(struct DirEntry*, size_t);
+int compare_entries(const void*, const void*);
+bool make_dir(const char*);
+
+uint64_t hash_bytes(uint64_t, const void*, size_t);
@@ -0,0 +1,262 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "golden.h"
+#include "pk3.h"
+#include "serve.h"
+
+void golden_init(struct Golden* golden) {
+    memset(golden, 0, sizeof(struct Golden));
+    for (int i = 0; i < NUM_PHASES; i++)
+        golden->times[i] = -1;
+}
+
+void golden_lap(struct Golden* golden) {
+    // Phases that didn't run again, e.g. the config or cached levels, keep the time they had
+    for (int i = 0; i < NUM_PHASES; i++) {
+        double total = stats_time(i);
+        if (total < 0)
+            continue;
+
+        double time = (total - golden->totals[i]) * 1000;
+        golden->totals[i] = total;
+        if (time > 0 && (golden->times[i] < 0 || time < golden->times[i]))
+            golden->times[i] = time;
+    }
+}
+
+bool golden(
+    struct Golden* current, const char* golden_name, const char* const* output_names, size_t num_outputs,
+    double budget, bool update
+) {
+    bool success = true;
+    for (size_t i = 0; i < num_outputs && success; i++) {
+        if (output_names[i] == NULL)
+            continue;
+        // Entries of a PK3 are compressed, see verify_wad
+        if (is_pk3_name(output_names[i])) {
+            printf("! golden: \"%s\" is a PK3, only WADs are hashed\n", output_names[i]);
+            continue;
+        }
+        success = golden_hash(current, output_names[i], i);
+    }
+
+    // Baselines are only taken when asked for, a missing one must not let a regression through
+    if (success && update) {
+        success = golden_save(current, golden_name);
+    } else if (success) {
+        FILE* existing = fopen(golden_name, "rb");
+        if (existing == NULL) {
+            success = fail("golden: No baseline in \"%s\", take one with --golden-update", golden_name);
+        } else {
+            fclose(existing);
+            struct Golden baseline = {0};
+            success = golden_load(&baseline, golden_name) && golden_compare(&baseline, current, budget);
+            free(baseline.lumps);
+        }
+    }
+
+    free(current->lumps);
+    return success;
+}
+
+bool golden_hash(struct Golden* golden, const char* output_name, size_t output) {
+    struct FileView view;
+    if (!file_map(&view, output_name))
+        return fail("golden_hash: Failed to map \"%s\"", output_name);
+
+    const uint8_t* data = view.data;
+    size_t size = view.size;
+    uint32_t header[2];
+    if (size < 12 || (memcmp(data, "IWAD", 4) != 0 && memcmp(data, "PWAD", 4) != 0)) {
+        file_unmap(&view);
+        return fail("golden_hash: \"%s\" is not a WAD", output_name);
+    }
+    memcpy(header, data + 4, sizeof(header));
+    size_t num_lumps = u32le(header[0]), infotableofs = u32le(header[1]);
+    if (infotableofs > size || num_lumps > (size - infotableofs) / 16) {
+        file_unmap(&view);
+        return fail("golden_hash: Directory of \"%s\" is past the end of the file", output_name);
+    }
+
+    // Lumps are named after the map they belong to, so that maps can move around in the WAD
+    const uint8_t* directory = data + infotableofs;
+    struct GoldenLump lump = {0};
+    lump.output = output;
+    bool success = true;
+    for (size_t i = 0; i < num_lumps && success; i++) {
+        const uint8_t* entry = directory + i * 16;
+        uint32_t fields[2];
+        memcpy(fields, entry, sizeof(fields));
+        uint32_t filepos = u32le(fields[0]), lump_size = u32le(fields[1]);
+        if (filepos > size || lump_size > size - filepos) {
+            success = fail("golden_hash: Lump %zu of \"%s\" is past the end of the file", i, output_name);
+            break;
+        }
+
+        memcpy(lump.name, entry + 8, LUMP_NAME_MAX);
+        if (i + 1 < num_lumps && strncmp((const char*)entry + 24, "THINGS", LUMP_NAME_MAX) == 0)
+            memcpy(lump.map, lump.name, LUMP_NAME_MAX + 1);
+        else if (!is_map_lump(lump.name))
+            memset(lump.map, 0, sizeof(lump.map));
+        lump.hash = hash_bytes(HASH_INIT, data + filepos, lump_size);
+        success = golden_add_lump(golden, &lump);
+    }
+
+    file_unmap(&view);
+    return success;
+}
+
+bool golden_add_lump(struct Golden* golden, const struct GoldenLump* lump) {
+    if (golden->num_lumps >= golden->max_lumps) {
+        size_t max_lumps = golden->max_lumps > 0 ? golden->max_lumps * 2 : 64;
+        struct GoldenLump* lumps = realloc(golden->lumps, max_lumps * sizeof(struct GoldenLump));
+        if (lumps == NULL)
+            return fail("golden_add_lump: Out of memory");
+        golden->lumps = lumps;
+        golden->max_lumps = max_lumps;
+    }
+
+    golden->lumps[golden->num_lumps++] = *lump;
+    return true;
+}
+
+bool golden_save(const struct Golden* golden, const char* golden_name) {
+    FILE* output = fopen(golden_name, "wb");
+    if (output == NULL)
+        return fail("golden_save: Failed to open \"%s\" (%s)", golden_name, strerror(errno));
+
+    fprintf(output, "{\"lumps\":[");
+    for (size_t i = 0; i < golden->num_lumps; i++) {
+        const struct GoldenLump* lump = &golden->lumps[i];
+        fprintf(output, "%s\n{\"output\":%zu,\"map\":", i ? "," : "", lump->output);
+        write_json_string(output, lump->map);
+        fprintf(output, ",\"name\":");
+        write_json_string(output, lump->name);
+        fprintf(output, ",\"hash\":\"%016llx\"}", (unsigned long long)lump->hash);
+    }
+    fprintf(output, "\n],\"phases\":{");
+    bool first = true;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        if (golden->times[i] < 0)
+            continue;
+        fprintf(output, "%s\"%s\":%.3f", first ? "" : ",", stats_phase_name(i), golden->times[i]);
+        first = false;
+    }
+    fprintf(output, "}}\n");
+
+    bool success = !ferror(output);
+    fclose(output);
+    if (!success)
+        return fail("golden_save: Failed to write \"%s\"", golden_name);
+    printf("golden_save: Saved %zu lump(s) as the baseline in \"%s\"\n", golden->num_lumps, golden_name);
+    return true;
+}
+
+bool golden_load(struct Golden* golden, const char* golden_name) {
+    size_t size;
+    char* source = read_file(golden_name, &size);
+    if (source == NULL)
+        return fail("golden_load: Failed to open \"%s\" (%s)", golden_name, strerror(errno));
+
+    yyjson_read_err error;
+    yyjson_doc* json = yyjson_read_opts(source, size, JSON_FLAGS, stats_allocator(), &error);
+    stats_free(source);
+    if (json == NULL)
+        return fail("golden_load: Failed to read \"%s\" (%s)", golden_name, error.msg);
+
+    yyjson_val* root = yyjson_doc_get_root(json);
+    yyjson_val* lumps = yyjson_obj_get(root, "lumps");
+    yyjson_val* phases = yyjson_obj_get(root, "phases");
+    if (!yyjson_is_arr(lumps) || !yyjson_is_obj(phases)) {
+        yyjson_doc_free(json);
+        return fail("golden_load: Expected \"lumps\" and \"phases\" in \"%s\"", golden_name);
+    }
+
+    bool success = true;
+    size_t i, n;
+    yyjson_val* value;
+    yyjson_arr_foreach(lumps, i, n, value) {
+        const char* map = yyjson_get_str(yyjson_obj_get(value, "map"));
+        const char* name = yyjson_get_str(yyjson_obj_get(value, "name"));
+        const char* hash = yyjson_get_str(yyjson_obj_get(value, "hash"));
+        yyjson_val* output = yyjson_obj_get(value, "output");
+        if (map == NULL || name == NULL || hash == NULL || !yyjson_is_uint(output)) {
+            success = fail("golden_load: Lump %zu of \"%s\" is missing fields", i, golden_name);
+            break;
+        }
+
+        struct GoldenLump lump = {0};
+        lump.output = yyjson_get_uint(output);
+        strncpy(lump.map, map, LUMP_NAME_MAX);
+        strncpy(lump.name, name, LUMP_NAME_MAX);
+        lump.hash = strtoull(hash, NULL, 16);
+        if (!(success = golden_add_lump(golden, &lump)))
+            break;
+    }
+
+    for (int i = 0; i < NUM_PHASES; i++) {
+        yyjson_val* time = yyjson_obj_get(phases, stats_phase_name(i));
+        golden->times[i] = yyjson_is_num(time) ? yyjson_get_num(time) : -1;
+    }
+
+    yyjson_doc_free(json);
+    return success;
+}
+
+bool golden_compare(const struct Golden* baseline, const struct Golden* current, double budget) {
+    size_t issues = 0;
+    for (size_t i = 0; i < baseline->num_lumps; i++) {
+        const struct GoldenLump* lump = &baseline->lumps[i];
+        const struct GoldenLump* found = golden_find(current, lump);
+        if (found == NULL || found->hash != lump->hash) {
+            printf(
+                "! golden_compare: %s %s of output %zu %s\n", lump->map, lump->name, lump->output,
+                found == NULL ? "is missing" : "changed"
+            );
+            ++issues;
+        }
+    }
+    for (size_t i = 0; i < current->num_lumps; i++) {
+        const struct GoldenLump* lump = &current->lumps[i];
+        if (golden_find(baseline, lump) == NULL) {
+            printf("! golden_compare: %s %s of output %zu is new\n", lump->map, lump->name, lump->output);
+            ++issues;
+        }
+    }
+
+    // Times are only compared given a budget, they depend on the machine. Phases that didn't run on either side, e.g.
+    // cached levels, have nothing to compare
+    for (int i = 0; i < NUM_PHASES && budget >= 0; i++) {
+        double base = baseline->times[i], time = current->times[i];
+        if (base < 0 || time < 0)
+            continue;
+        double limit = base * (1 + budget / 100);
+        if (time > limit && time - base > GOLDEN_SLACK_MS) {
+            printf(
+                "! golden_compare: Phase %s took %.3f ms, over its budget of %.3f ms (baseline %.3f ms)\n",
+                stats_phase_name(i), time, limit, base
+            );
+            ++issues;
+        }
+    }
+
+    if (issues > 0)
+        return fail("golden_compare: Found %zu regression(s) against the baseline", issues);
+    if (budget < 0)
+        printf("golden_compare: All %zu lump(s) match\n", current->num_lumps);
+    else
+        printf("golden_compare: All %zu lump(s) match and every phase is within %.0f%%\n", current->num_lumps, budget);
+    return true;
+}
+
+const struct GoldenLump* golden_find(const struct Golden* golden, const struct GoldenLump* lump) {
+    for (size_t i = 0; i < golden->num_lumps; i++) {
+        const struct GoldenLump* it = &golden->lumps[i];
+        if (it->output == lump->output && strcmp(it->map, lump->map) == 0 && strcmp(it->name, lump->name) == 0)
+            return it;
+    }
+    return NULL;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "config.h"
+#include "error.h"
+#include "file.h"
+#include "map.h"
+#include "stats.h"
+
+// How much a phase may always take longer than its baseline to ignore noise
+#define GOLDEN_SLACK_MS 2.0
+
+// Conversions that are timed, the fastest run of each phase is kept so that a busy system doesn't fail it
+#define GOLDEN_RUNS 5
+
+// Lump of an output WAD, under the map whose marker it follows or "" before the first one
+struct GoldenLump {
+    size_t output;
+    char map[LUMP_NAME_MAX + 1], name[LUMP_NAME_MAX + 1];
+    uint64_t hash;
+};
+
+struct Golden {
+    struct GoldenLump* lumps;
+    size_t num_lumps, max_lumps;
+    double times[NUM_PHASES];
+
+    // Phase times of every run so far, see golden_lap
+    double totals[NUM_PHASES];
+};
+
+void golden_init(struct Golden*);
+void golden_lap(struct Golden*);
+bool golden(struct Golden*, const char*, const char* const*, size_t, double, bool);
+bool golden_hash(struct Golden*, const char*, size_t);
+bool golden_add_lump(struct Golden*, const struct GoldenLump*);
+bool golden_save(const struct Golden*, const char*);
+bool golden_load(struct Golden*, const char*);
+bool golden_compare(const struct Golden*, const struct Golden*, double);
+const struct GoldenLump* golden_find(const struct Golden*, const struct GoldenLump*);
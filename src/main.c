@@ -1,50 +1,236 @@
 #include <stdlib.h>
 
 #include "config.h"
+#include "corpus.h"
+#include "error.h"
+#include "golden.h"
 #include "map.h"
+#include "pool.h"
+#include "serve.h"
+#include "stats.h"
+#include "trace.h"
+#include "verify.h"
 
-int main(int argc, char** argv) {
-    printf("wolf2wad for WolfenDOOM Redux\n");
-    printf("Usage: wolf2wad [-c <file>] [-i <maphead> <gamemaps>] [-l <level>] [-o <file>]\n");
+// Accepts single levels, lists and ranges, e.g. "0", "0,2,5" or "0-9"
+bool parse_levels(const char* arg, int* levels, size_t* num_levels) {
+    *num_levels = 0;
+    while (*arg != '\0') {
+        char* end;
+        long first = strtol(arg, &end, 0), last = first;
+        if (end == arg)
+            return fail("parse_levels: Invalid level list \"%s\"", arg);
+
+        if (*end == '-') {
+            arg = end + 1;
+            last = strtol(arg, &end, 0);
+            if (end == arg || last < first)
+                return fail("parse_levels: Invalid level range \"%s\"", arg);
+        }
 
-    char *config_name = NULL, *maphead_name = NULL, *gamemaps_name = NULL;
-    char* output_name = NULL;
-    int level = 0;
+        for (long level = first; level <= last; level++) {
+            if (*num_levels >= MAX_LEVELS)
+                return fail("parse_levels: Too many levels (max %d)", MAX_LEVELS);
+            levels[(*num_levels)++] = (int)level;
+        }
+
+        arg = (*end == ',') ? end + 1 : end;
+        if (*end != '\0' && *end != ',')
+            return fail("parse_levels: Invalid level list \"%s\"", end);
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char *config_names[MAX_VARIANTS] = {NULL}, *output_names[MAX_VARIANTS] = {NULL};
+    size_t num_configs = 0, num_outputs = 0;
+    char *maphead_name = NULL, *gamemaps_name = NULL;
+    char *trace_name = NULL, *image_name = NULL, *levels_arg = "0";
+    char *socket_name = NULL, *corpus_root = NULL, *mapping_name = NULL, *cache_dir = NULL, *verify_name = NULL;
+    char* golden_name = NULL;
+    bool serving = false, update = false, dry_run = false, verify = false, golden_update = false, timed = false;
+    long threads = 1;
+    double budget = 0;
+    enum StatsFormats stats_format = STATS_NONE;
 
     for (int i = 0; i < argc; i++)
         if (strcmp(argv[i], "-c") == 0) {
-            config_name = argv[++i];
+            if (num_configs >= MAX_VARIANTS) {
+                fail("main: Expected at most %d configs", MAX_VARIANTS);
+                return EXIT_FAILURE;
+            }
+            config_names[num_configs++] = argv[++i];
         } else if (strcmp(argv[i], "-i") == 0) {
             maphead_name = argv[++i];
             gamemaps_name = argv[++i];
         } else if (strcmp(argv[i], "-l") == 0) {
-            level = strtoul(argv[++i], NULL, 0);
+            levels_arg = argv[++i];
         } else if (strcmp(argv[i], "-o") == 0) {
-            output_name = argv[++i];
+            if (num_outputs >= MAX_VARIANTS) {
+                fail("main: Expected at most %d outputs", MAX_VARIANTS);
+                return EXIT_FAILURE;
+            }
+            output_names[num_outputs++] = argv[++i];
+        } else if (strcmp(argv[i], "-u") == 0) {
+            update = true;
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            dry_run = true;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            threads = i + 1 < argc ? strtol(argv[++i], NULL, 0) : -1;
+        } else if (strcmp(argv[i], "--config-cache") == 0) {
+            image_name = argv[++i];
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            trace_name = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            serving = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                socket_name = argv[++i];
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                verify_name = argv[++i];
+        } else if (strcmp(argv[i], "--golden") == 0) {
+            golden_name = argv[++i];
+        } else if (strcmp(argv[i], "--golden-update") == 0) {
+            golden_name = argv[++i];
+            golden_update = true;
+        } else if (strcmp(argv[i], "--budget") == 0) {
+            budget = i + 1 < argc ? strtod(argv[++i], NULL) : -1;
+            timed = true;
+        } else if (strcmp(argv[i], "--corpus") == 0) {
+            corpus_root = argv[++i];
+        } else if (strcmp(argv[i], "--corpus-configs") == 0) {
+            mapping_name = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_format = STATS_TEXT;
+            if (i + 1 < argc && strcmp(argv[i + 1], "text") == 0) {
+                ++i;
+            } else if (i + 1 < argc && strcmp(argv[i + 1], "json") == 0) {
+                stats_format = STATS_JSON;
+                ++i;
+            }
         }
 
-    if (config_name == NULL) {
+    // Responses to jobs on stdin own it from the first byte, everything printed goes to stderr instead
+    if (serving && socket_name == NULL && !serve_claim_stdout())
+        return EXIT_FAILURE;
+
+    printf("wolf2wad for WolfenDOOM Redux\n");
+    printf("Usage: wolf2wad [-c <file>]... [-i <maphead> <gamemaps>] [-l <level[s]>] [-o <file>]... [-u] [--dry-run] [-j <threads>] [--config-cache <file>] [--cache <dir>] [--stats [text|json]] [--trace <file>] [--serve [socket]] [--corpus <dir> [--corpus-configs <file>]] [--verify [file]] [--golden <file> [--budget <percent>] | --golden-update <file>]\n");
+
+    int levels[MAX_LEVELS];
+    size_t num_levels;
+    if (levels_arg == NULL || !parse_levels(levels_arg, levels, &num_levels))
+        return EXIT_FAILURE;
+
+    if (threads < 0) {
+        fail("main: Thread count must be 0 (all cores) or more");
+        return EXIT_FAILURE;
+    }
+    if (timed && budget < 0) {
+        fail("main: Budget must be 0%% or more");
+        return EXIT_FAILURE;
+    }
+
+    // Verifying a single WAD needs neither a config nor levels
+    if (num_configs == 0 && verify_name == NULL) {
         printf("! Config file not specified, defaulting to \"config.json\"\n");
-        config_name = "config.json";
+        config_names[num_configs++] = "config.json";
+    }
+    if (num_configs > 1 && (serving || corpus_root != NULL)) {
+        fail("main: --serve and --corpus take a single config");
+        return EXIT_FAILURE;
+    }
+
+    if (corpus_root != NULL) {
+        if (num_outputs == 0) {
+            printf("! Output directory not specified, defaulting to \"output\"\n");
+            output_names[num_outputs++] = "output";
+        }
+    } else if (!serving && verify_name == NULL) {
+        if (maphead_name == NULL || gamemaps_name == NULL) {
+            printf("! MAPHEAD.* and GAMEMAPS.* not specified, defaulting to \"MAPHEAD.wl6\" and \"GAMEMAPS.wl6\"\n");
+            maphead_name = "MAPHEAD.wl6";
+            gamemaps_name = "GAMEMAPS.wl6";
+        }
+
+        // Every config gets an output of its own, in the same order
+        if (dry_run) {
+            for (size_t i = 0; i < num_outputs; i++)
+                output_names[i] = NULL;
+        } else if (num_outputs == 0 && num_configs == 1) {
+            printf("! Output file not specified, defaulting to \"output.wad\"\n");
+            output_names[num_outputs++] = "output.wad";
+        } else if (num_outputs != num_configs) {
+            fail("main: Expected an -o for each of the %zu configs, got %zu", num_configs, num_outputs);
+            return EXIT_FAILURE;
+        }
     }
 
-    if (maphead_name == NULL || gamemaps_name == NULL) {
-        printf("! MAPHEAD.* and GAMEMAPS.* not specified, defaulting to \"MAPHEAD.wl6\" and \"GAMEMAPS.wl6\"\n");
-        maphead_name = "MAPHEAD.wl6";
-        gamemaps_name = "GAMEMAPS.wl6";
+    // Phases are only timed while stats are on
+    if (golden_name != NULL && (serving || corpus_root != NULL || verify_name != NULL)) {
+        printf("! --golden and --golden-update only work when converting with -i, ignoring them\n");
+        golden_name = NULL;
+    } else if (golden_name != NULL && stats_format == STATS_NONE) {
+        stats_format = STATS_QUIET;
     }
 
-    if (output_name == NULL) {
-        printf("! Output file not specified, defaulting to \"output.wad\"\n");
-        output_name = "output.wad";
+    if (image_name != NULL && num_configs > 1) {
+        printf("! --config-cache only works with a single config, ignoring it\n");
+        image_name = NULL;
     }
 
-    config_init(config_name);
-    map_init(maphead_name, gamemaps_name, level);
-    map_to_wad(output_name);
+    stats_init(stats_format);
+
+    struct Config configs[MAX_VARIANTS] = {0};
+    const struct Config* variants[MAX_VARIANTS];
+    bool success = trace_init(trace_name) && pool_init(threads);
+    for (size_t i = 0; i < num_configs && success && verify_name == NULL; i++) {
+        success = config_init(&configs[i], config_names[i], image_name);
+        variants[i] = &configs[i];
+    }
+    if (success) {
+        if (verify_name != NULL) {
+            success = verify_wad(verify_name);
+        } else if (serving) {
+            success = serve(&configs[0], socket_name);
+        } else if (corpus_root != NULL) {
+            success = corpus(&configs[0], corpus_root, output_names[0], mapping_name, cache_dir, dry_run, verify);
+        } else {
+            // Configs and levels are timed more than once when times are compared or saved, see golden_lap
+            struct Golden current;
+            golden_init(&current);
+            golden_lap(&current);
+            int runs = golden_name != NULL && (timed || golden_update) ? GOLDEN_RUNS : 1;
+            for (int run = 0; run < runs && success; run++) {
+                for (size_t i = 0; i < num_configs && success && run > 0; i++) {
+                    config_teardown(&configs[i]);
+                    success = config_init(&configs[i], config_names[i], image_name);
+                }
+                golden_lap(&current);
+                success = success && map_convert_variants(
+                    variants, output_names, num_configs, maphead_name, gamemaps_name, levels, num_levels, update,
+                    cache_dir, NULL
+                );
+                golden_lap(&current);
+            }
+            for (size_t i = 0; i < num_configs && success && verify; i++)
+                if (output_names[i] != NULL)
+                    success = verify_wad(output_names[i]);
+            if (success && golden_name != NULL)
+                success = golden(
+                    &current, golden_name, output_names, num_configs, timed ? budget : -1, golden_update
+                );
+        }
+    }
 
-    map_teardown();
-    config_teardown();
+    for (size_t i = 0; i < num_configs; i++)
+        config_teardown(&configs[i]);
+    pool_teardown();
+    stats_print();
+    trace_teardown();
 
-    return EXIT_SUCCESS;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -1,148 +1,253 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cache.h"
 #include "config.h"
+#include "error.h"
+#include "file.h"
 #include "map.h"
+#include "pk3.h"
+#include "pool.h"
+#include "stats.h"
+#include "trace.h"
 
-static struct WolfMap wolfmap = {0};
-static struct DoomMap doommap = {0};
-
-void map_init(const char* maphead_name, const char* gamemaps_name, int level) {
-    if (level < 0 || level >= MAX_LEVELS) {
-        printf("!!! map_init: Level ID must range from 0 to 99\n");
-        exit(EXIT_FAILURE);
-    }
+bool map_init(
+    struct WolfMap* wolfmap, const char* maphead_name, const char* gamemaps_name, int level, unsigned planes
+) {
+    return map_load(wolfmap, maphead_name, gamemaps_name, level, planes) && map_decode(wolfmap);
+}
 
-    // Open MAPHEAD
-    FILE* maphead = fopen(maphead_name, "rb");
-    if (maphead == NULL) {
-        printf("!!! map_init: Failed to open MAPHEAD \"%s\"\n", maphead_name);
-        perror("!!! map_init");
-        exit(EXIT_FAILURE);
+bool map_load(
+    struct WolfMap* wolfmap, const char* maphead_name, const char* gamemaps_name, int level, unsigned planes
+) {
+    memset(wolfmap, 0, sizeof(struct WolfMap));
+    struct FileView maphead, gamemaps;
+    if (!file_map(&maphead, maphead_name))
+        return fail("map_load: Failed to open MAPHEAD \"%s\" (%s)", maphead_name, strerror(errno));
+    if (!file_map(&gamemaps, gamemaps_name)) {
+        file_unmap(&maphead);
+        return fail("map_load: Failed to open GAMEMAPS \"%s\" (%s)", gamemaps_name, strerror(errno));
     }
 
-    uint16_t magic;
-    fread(&magic, sizeof(uint16_t), 1, maphead);
-    magic = u16le(magic);
+    bool success = map_read(wolfmap, maphead.data, maphead.size, gamemaps.data, gamemaps.size, level, planes);
+    file_unmap(&maphead);
+    file_unmap(&gamemaps);
+    return success;
+}
 
-    int32_t level_offset;
-    if (fseek(maphead, level * sizeof(int32_t), SEEK_CUR) != 0) {
-        printf("!!! map_init: Failed to seek in MAPHEAD\n");
-        exit(EXIT_FAILURE);
+bool map_read(
+    struct WolfMap* wolfmap, const uint8_t* maphead, size_t maphead_size, const uint8_t* gamemaps,
+    size_t gamemaps_size, int level, unsigned planes
+) {
+    memset(wolfmap, 0, sizeof(struct WolfMap));
+    if (level < 0 || level >= MAX_LEVELS)
+        return fail("map_read: Level ID must range from 0 to 99");
+
+    // MAPHEAD: magic, then the offset of every level in GAMEMAPS
+    stats_begin(PHASE_HEADER);
+    if (maphead_size < 2 + (level + 1) * sizeof(int32_t)) {
+        stats_end();
+        return fail("map_read: No data found for level %d", level);
     }
-    fread(&level_offset, sizeof(int32_t), 1, maphead);
+    wolfmap->magic = read_u16le(maphead);
+    int32_t level_offset;
+    memcpy(&level_offset, maphead + 2 + level * sizeof(int32_t), sizeof(int32_t));
     if ((level_offset = s32le(level_offset)) <= 0) {
-        printf("!!! map_init: No data found for level %d\n", level);
-        exit(EXIT_FAILURE);
+        stats_end();
+        return fail("map_read: No data found for level %d", level);
     }
 
-    fclose(maphead);
-
-    // Open GAMEMAPS
-    FILE* gamemaps = fopen(gamemaps_name, "rb");
-    if (gamemaps == NULL) {
-        printf("!!! map_init: Failed to open GAMEMAPS \"%s\"\n", gamemaps_name);
-        perror("!!! map_init");
-        exit(EXIT_FAILURE);
+    // GAMEMAPS
+    if (gamemaps_size < 8 || strncmp((const char*)gamemaps, "TED5v1.0", 8) != 0) {
+        stats_end();
+        return fail(
+            "map_read: Invalid GAMEMAPS header (%.*s =/= TED5v1.0)", gamemaps_size < 8 ? 0 : 8, (const char*)gamemaps
+        );
     }
-
-    char header[8];
-    fread(header, sizeof(uint8_t), sizeof(header), gamemaps);
-    if (strncmp(header, "TED5v1.0", sizeof(header)) != 0) {
-        printf("!!! map_init: Invalid GAMEMAPS header (%s =/= TED5v1.0)\n", header);
-        exit(EXIT_FAILURE);
+    if ((size_t)level_offset + 38 > gamemaps_size) {
+        stats_end();
+        return fail("map_read: Level %d lies past the end of GAMEMAPS", level);
     }
 
-    if (fseek(gamemaps, level_offset, SEEK_SET) != 0) {
-        printf("!!! map_init: Failed to seek in GAMEMAPS\n");
-        exit(EXIT_FAILURE);
-    }
+    const uint8_t* header = gamemaps + level_offset;
+    wolfmap->id = level;
+    memcpy(wolfmap->offsets, header, MAX_PLANES * sizeof(int32_t));
+    memcpy(wolfmap->sizes, header + 12, MAX_PLANES * sizeof(uint16_t));
+    wolfmap->width = read_u16le(header + 18);
+    wolfmap->height = read_u16le(header + 20);
+    memcpy(wolfmap->name, header + 22, LEVEL_NAME_MAX);
 
-    wolfmap.id = level;
-    fread(wolfmap.offsets, sizeof(int32_t), MAX_PLANES, gamemaps);
-    fread(wolfmap.sizes, sizeof(uint16_t), MAX_PLANES, gamemaps);
-    fread(&wolfmap.width, sizeof(uint16_t), 1, gamemaps);
-    fread(&wolfmap.height, sizeof(uint16_t), 1, gamemaps);
-    fread(wolfmap.name, sizeof(uint8_t), LEVEL_NAME_MAX, gamemaps);
+    for (int i = 0; i < MAX_PLANES; i++) {
+        wolfmap->offsets[i] = s32le(wolfmap->offsets[i]);
+        wolfmap->sizes[i] = u16le(wolfmap->sizes[i]);
+    }
 
+    // Everything the planes are decoded from, which is all a cached conversion needs to match
+    uint64_t hash = hash_bytes(HASH_INIT, &wolfmap->id, sizeof(wolfmap->id));
+    hash = hash_bytes(hash, &wolfmap->magic, sizeof(wolfmap->magic));
+    hash = hash_bytes(hash, &wolfmap->width, sizeof(wolfmap->width));
+    hash = hash_bytes(hash, &wolfmap->height, sizeof(wolfmap->height));
+    hash = hash_bytes(hash, wolfmap->name, LEVEL_NAME_MAX);
     for (int i = 0; i < MAX_PLANES; i++) {
-        wolfmap.offsets[i] = s32le(wolfmap.offsets[i]);
-        wolfmap.sizes[i] = u16le(wolfmap.sizes[i]);
+        if (!(planes & (1 << i)))
+            continue;
+        if (wolfmap->sizes[i] <= 0) {
+            printf("! map_read: No data in plane %d\n", i);
+            continue;
+        }
+
+        if (wolfmap->offsets[i] < 0 || (size_t)wolfmap->offsets[i] + wolfmap->sizes[i] > gamemaps_size) {
+            map_teardown(wolfmap, NULL);
+            stats_end();
+            return fail("map_read: Failed to read plane %d", i);
+        }
+        wolfmap->carmack[i] = stats_malloc(wolfmap->sizes[i]);
+        if (wolfmap->carmack[i] == NULL) {
+            map_teardown(wolfmap, NULL);
+            stats_end();
+            return fail("map_read: Out of memory");
+        }
+        memcpy(wolfmap->carmack[i], gamemaps + wolfmap->offsets[i], wolfmap->sizes[i]);
+        wolfmap->encodings[i] = plane_encoding(
+            wolfmap->carmack[i], wolfmap->sizes[i], wolfmap->width * wolfmap->height * sizeof(uint16_t)
+        );
+        hash = hash_bytes(hash, &i, sizeof(i));
+        hash = hash_bytes(hash, wolfmap->carmack[i], wolfmap->sizes[i]);
     }
-    wolfmap.width = u16le(wolfmap.width);
-    wolfmap.height = u16le(wolfmap.height);
+    wolfmap->hash = hash;
 
-    printf("map_init: Loading level %d (%s)\n", wolfmap.id, wolfmap.name);
-    const size_t bufsize = wolfmap.width * wolfmap.height * sizeof(uint16_t);
+    stats_end();
+    return true;
+}
+
+bool map_decode(struct WolfMap* wolfmap) {
+    printf("map_decode: Loading level %d (%s)\n", wolfmap->id, wolfmap->name);
+    stats_begin(PHASE_DECODE);
+    const size_t bufsize = wolfmap->width * wolfmap->height * sizeof(uint16_t);
     for (int i = 0; i < MAX_PLANES; i++) {
-        if (wolfmap.sizes[i] <= 0) {
-            printf("! map_init: No data in plane %u\n", i);
-            wolfmap.planes[i] = NULL;
+        if (wolfmap->carmack[i] == NULL)
+            continue;
+
+        // Raw planes are already what the rest expects, so they are taken over as they are
+        if (wolfmap->encodings[i] == ENCODING_RAW) {
+            wolfmap->planes[i] = (uint16_t*)wolfmap->carmack[i];
+            wolfmap->carmack[i] = NULL;
             continue;
         }
 
-        uint8_t* rlew = malloc(bufsize);
-        if (rlew == NULL) {
-            printf("!!! map_init: Out of memory\n");
-            exit(EXIT_FAILURE);
+        uint8_t* rlew = wolfmap->encodings[i] == ENCODING_CARMACK ? stats_malloc(bufsize) : wolfmap->carmack[i];
+        wolfmap->planes[i] = stats_malloc(bufsize);
+        if (rlew == NULL || wolfmap->planes[i] == NULL) {
+            if (rlew != wolfmap->carmack[i])
+                stats_free(rlew);
+            stats_end();
+            return fail("map_decode: Out of memory");
         }
-        read_carmack(gamemaps, wolfmap.offsets[i], wolfmap.sizes[i], rlew);
 
-        wolfmap.planes[i] = malloc(bufsize);
-        if (wolfmap.planes[i] == NULL) {
-            printf("!!! map_init: Out of memory\n");
-            exit(EXIT_FAILURE);
+        if (wolfmap->encodings[i] == ENCODING_CARMACK) {
+            read_carmack(wolfmap->carmack[i], rlew);
+            read_rlew(rlew, (uint8_t*)wolfmap->planes[i], wolfmap->magic);
+            stats_free(rlew);
+        } else {
+            read_rlew(rlew, (uint8_t*)wolfmap->planes[i], wolfmap->magic);
         }
-        read_rlew(rlew, (uint8_t*)wolfmap.planes[i], magic);
-        free(rlew);
+        stats_free(wolfmap->carmack[i]);
+        wolfmap->carmack[i] = NULL;
     }
 
-    fclose(gamemaps);
+    stats_end();
+    return true;
 }
 
-void map_teardown() {
-    for (int i = 0; i < MAX_PLANES; i++)
-        if (wolfmap.planes[i] != NULL)
-            free(wolfmap.planes[i]);
-
-    if (doommap.things != NULL)
-        free(doommap.things);
-    if (doommap.lines != NULL)
-        free(doommap.lines);
-    if (doommap.sides != NULL)
-        free(doommap.sides);
-    if (doommap.vertices != NULL)
-        free(doommap.vertices);
-    if (doommap.sectors != NULL)
-        free(doommap.sectors);
-    if (doommap.linemap != NULL)
-        free(doommap.linemap);
-    if (doommap.sectormap != NULL)
-        free(doommap.sectormap);
+void map_teardown(struct WolfMap* wolfmap, struct DoomMap* doommap) {
+    if (wolfmap != NULL) {
+        for (int i = 0; i < MAX_PLANES; i++) {
+            if (wolfmap->planes[i] != NULL)
+                stats_free(wolfmap->planes[i]);
+            if (wolfmap->carmack[i] != NULL)
+                stats_free(wolfmap->carmack[i]);
+        }
+        memset(wolfmap, 0, sizeof(struct WolfMap));
+    }
+
+    if (doommap != NULL) {
+        if (doommap->things != NULL)
+            stats_free(doommap->things);
+        if (doommap->lines != NULL)
+            stats_free(doommap->lines);
+        if (doommap->sides != NULL)
+            stats_free(doommap->sides);
+        if (doommap->vertices != NULL)
+            stats_free(doommap->vertices);
+        if (doommap->sectors != NULL)
+            stats_free(doommap->sectors);
+        if (doommap->linemap != NULL)
+            stats_free(doommap->linemap);
+        if (doommap->tiles != NULL)
+            stats_free(doommap->tiles);
+        if (doommap->sectormap != NULL)
+            stats_free(doommap->sectormap);
+        if (doommap->sector_index != NULL)
+            stats_free(doommap->sector_index);
+        for (int i = 0; i < MAX_PLANES; i++)
+            if (doommap->planes[i] != NULL)
+                stats_free(doommap->planes[i]);
+        if (doommap->checkpoints != NULL)
+            stats_free(doommap->checkpoints);
+        if (doommap->plans != NULL) {
+            for (int16_t x = 0; x < doommap->width; x++)
+                stats_free(doommap->plans[x].ops);
+            stats_free(doommap->plans);
+        }
+        if (doommap->edits != NULL)
+            stats_free(doommap->edits);
+        if (doommap->vertex_index != NULL)
+            stats_free(doommap->vertex_index);
+        if (doommap->line_index != NULL)
+            stats_free(doommap->line_index);
+        if (doommap->track_sectors != NULL)
+            stats_free(doommap->track_sectors);
+        memset(doommap, 0, sizeof(struct DoomMap));
+    }
+}
+
+struct LineCell* map_cell(const struct DoomMap* doommap, int x, int y) {
+    // Banded maps keep their window column by column, the whole map is kept row by row
+    if (doommap->banded)
+        return &doommap->linemap[(x % MAP_WINDOW) * doommap->height + y];
+    return &doommap->linemap[y * doommap->width + x];
 }
 
 uint16_t read_u16le(const uint8_t* ptr) {
     return (uint16_t)((uint8_t)*ptr) | ((uint16_t)(uint8_t)(*(ptr + 1)) << 8);
 }
 
-void read_carmack(FILE* stream, size_t offset, size_t size, uint8_t* out) {
-    if (fseek(stream, offset, SEEK_SET) != 0) {
-        printf("!!! read_carmack: Seek failed\n");
-        exit(EXIT_FAILURE);
-    }
+uint8_t plane_encoding(const uint8_t* data, size_t size, size_t bufsize) {
+    // Carmack starts with the length of the RLEW data, which starts with the length of the plane
+    if (size >= 2 && carmack_literal(data + 2, size - 2, bufsize))
+        return ENCODING_CARMACK;
+    if (size >= 2 && read_u16le(data) == bufsize)
+        return ENCODING_RLEW;
+    if (size == bufsize)
+        return ENCODING_RAW;
+    return ENCODING_CARMACK;
+}
 
-    uint8_t* john = malloc(size);
-    if (john == NULL) {
-        printf("!!! read_carmack: Out of memory\n");
-        exit(EXIT_FAILURE);
-    }
-    fread(john, sizeof(uint8_t), size, stream);
+bool carmack_literal(const uint8_t* in, size_t size, uint16_t value) {
+    // Words whose high byte looks like a copy are escaped with a zero length, see read_carmack
+    uint8_t high = value >> 8;
+    if (high == CARMACK_NEAR || high == CARMACK_FAR)
+        return size >= 3 && in[0] == 0 && in[1] == high && in[2] == (value & 0xFF);
+    return size >= 2 && read_u16le(in) == value;
+}
 
+void read_carmack(const uint8_t* john, uint8_t* out) {
     // https://github.com/cxong/cwolfmap/blob/a641ad1dd4f3f84ee826b561cfc6cebe9872e936/cwolfmap/expand.c#L51
     const uint8_t* start = out;
     const uint8_t* end = out + read_u16le(john);
-    uint8_t* in = john + 2;
+    const uint8_t* in = john + 2;
 
     const uint8_t* copy;
     uint8_t length;
@@ -173,8 +278,6 @@ void read_carmack(FILE* stream, size_t offset, size_t size, uint8_t* out) {
             *out++ = *copy++;
         }
     }
-
-    free(john);
 }
 
 void read_rlew(uint8_t* in, uint8_t* out, uint16_t magic) {
@@ -199,691 +302,2002 @@ void read_rlew(uint8_t* in, uint8_t* out, uint16_t magic) {
         }
 }
 
-void map_to_wad(const char* output_name) {
-    if (wolfmap.planes[PLANE_OBJECTS] != NULL) {
-        for (int16_t x = 0; x < wolfmap.width; x++) {
-            for (int16_t y = 0; y < wolfmap.height; y++) {
-                size_t pos = y * wolfmap.width + x;
-                const struct ObjectInfo* obj = get_object_info(wolfmap.planes[PLANE_OBJECTS][pos]);
-                if (obj == NULL || obj->type != OBJ_THING)
-                    continue;
+bool map_to_wad(struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config) {
+    memset(doommap, 0, sizeof(struct DoomMap));
+    snprintf(doommap->name, LUMP_NAME_MAX, "MAP%02u", wolfmap->id + 1);
+    doommap->width = wolfmap->width;
+    doommap->height = wolfmap->height;
+
+    doommap->checkpoints = stats_calloc(wolfmap->width + 1, sizeof(struct MapCheckpoint));
+    if (doommap->checkpoints == NULL)
+        return fail("map_to_wad: Out of memory");
+
+    if (wolfmap->planes[PLANE_OBJECTS] != NULL) {
+        if (!map_things(doommap, wolfmap, config, 0, wolfmap->width))
+            return false;
+        if (doommap->num_things)
+            printf("map_to_wad: Placed %zu thing(s)\n", doommap->num_things);
+    }
+
+    if (wolfmap->planes[PLANE_WALLS] != NULL) {
+        // If asked to, big maps only keep the few columns of cells that are still looked at, see map_banded
+        size_t area = (size_t)wolfmap->width * wolfmap->height;
+        doommap->banded = config->banded && area > MAP_BANDED_AREA;
+        size_t cells = doommap->banded ? (size_t)MAP_WINDOW * wolfmap->height : area;
+        doommap->linemap = stats_calloc(cells, sizeof(struct LineCell));
+        if (doommap->linemap == NULL)
+            return fail("map_to_wad: Out of memory");
+
+        doommap->last_asector = 0xFFFE;
+        if (doommap->banded) {
+            if (!map_banded(doommap, wolfmap, config))
+                return false;
+        } else {
+            if (!map_sectors(doommap, wolfmap, config, 0))
+                return false;
+            if (!map_space(doommap, 0) || !map_lines(doommap, config, 0, NULL))
+                return false;
+        }
+        printf("map_to_wad: Placed %zu line(s), %zu sector(s)\n", doommap->num_lines, doommap->num_sectors);
+    }
+
+    return true;
+}
+
+bool map_banded(struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config) {
+    // Door track sectors come after every sector of the first pass, so that pass goes over the map by itself first
+    stats_begin(PHASE_SECTORS);
+    for (int16_t x = 0; x < doommap->width; x++)
+        if (!band_sectors(doommap, wolfmap, config, x))
+            return false;
+    doommap->checkpoints[doommap->width].sectors = doommap->num_sectors;
+    doommap->checkpoints[doommap->width].last_asector = doommap->last_asector;
+    stats_end();
+
+    // Then it finds the same sectors again, while track sectors carry on from where it ended. Space is two columns
+    // behind and lines are three, each looks at the columns on either side, so only MAP_WINDOW columns are kept.
+    struct LineBand out = {0};
+    struct LineStitch stitch = {0, NO_SECTOR, NO_SECTOR};
+    uint16_t asector = 0xFFFE;
+    bool success = true;
+    for (int x = 0; success && x < doommap->width + 2; x++) {
+        if (x < doommap->width) {
+            stats_begin(PHASE_SECTORS);
+            uint16_t track_asector = doommap->last_asector;
+            doommap->last_asector = asector;
+            success = band_sectors(doommap, wolfmap, config, x);
+            asector = doommap->last_asector;
+            doommap->last_asector = track_asector;
+            stats_end();
+        }
+        if (success && x >= 1 && x <= doommap->width) {
+            stats_begin(PHASE_SPACE);
+            for (int16_t y = 0; y < doommap->height; y++)
+                space_cell(doommap, x - 1, y);
+            stats_end();
+        }
+        if (success && x >= 2) {
+            stats_begin(PHASE_LINES);
+            out.num_ops = 0;
+            plan_column(&out, doommap, x - 2);
+            success = stitch_ops(doommap, config, &out, &stitch);
+            stats_end();
+        }
+    }
+    stats_free(out.ops);
+    if (!success)
+        return false;
+
+    while (stitch.x <= doommap->width)
+        checkpoint_lines(doommap, stitch.x++);
+    return true;
+}
+
+bool lines_settled(const struct DoomMap* doommap, int16_t x) {
+    const struct MapCheckpoint* checkpoint = &doommap->checkpoints[x];
+    return doommap->keeping && !doommap->diverged && doommap->num_lines == checkpoint->lines &&
+           doommap->num_sides == checkpoint->sides && doommap->num_vertices == checkpoint->vertices &&
+           doommap->num_track_sectors == checkpoint->tracks && doommap->num_edits == checkpoint->edits;
+}
+
+void keep_lines(struct DoomMap* doommap) {
+    // Lines were rewound to before every edit, those past the current one are done again on the kept data
+    for (size_t i = doommap->num_edits; i < doommap->kept.edits; i++) {
+        const struct LineEdit* edit = &doommap->edits[i];
+        if (edit->at_end)
+            doommap->lines[edit->line].end = edit->vertex;
+        else
+            doommap->lines[edit->line].start = edit->vertex;
+    }
+
+    doommap->num_sectors = doommap->kept.sectors;
+    doommap->last_asector = doommap->kept.last_asector;
+    doommap->num_lines = doommap->kept.lines;
+    doommap->num_sides = doommap->kept.sides;
+    doommap->num_vertices = doommap->kept.vertices;
+    doommap->num_track_sectors = doommap->kept.tracks;
+    doommap->num_edits = doommap->kept.edits;
+}
 
-                ++doommap.num_things;
-                doommap.things = (doommap.things == NULL)
-                                     ? calloc(doommap.num_things, sizeof(struct DoomThing))
-                                     : realloc(doommap.things, doommap.num_things * sizeof(struct DoomThing));
-                if (doommap.things == NULL) {
-                    printf("!!! map_to_wad: Out of memory\n");
-                    exit(EXIT_FAILURE);
+bool band_sectors(struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config, int16_t x) {
+    // The column takes the place of the one MAP_WINDOW columns before it
+    memset(map_cell(doommap, x, 0), 0, doommap->height * sizeof(struct LineCell));
+    for (int16_t y = 0; y < doommap->height; y++)
+        lookup_cell(doommap, wolfmap, config, x, y);
+    return sectors_column(doommap, wolfmap, config, x);
+}
+
+bool map_things(
+    struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config, int16_t from, int16_t to
+) {
+    stats_begin(PHASE_THINGS);
+    for (int16_t x = from; x < to; x++) {
+        doommap->checkpoints[x].things = doommap->num_things;
+        for (int16_t y = 0; y < wolfmap->height; y++) {
+            size_t pos = y * wolfmap->width + x;
+            const struct ObjectInfo* obj = get_object_info(config, wolfmap->planes[PLANE_OBJECTS][pos]);
+            if (obj == NULL || obj->type != OBJ_THING)
+                continue;
+
+            struct DoomThing* things =
+                (doommap->things == NULL)
+                    ? stats_calloc(doommap->num_things + 1, sizeof(struct DoomThing))
+                    : stats_realloc(doommap->things, (doommap->num_things + 1) * sizeof(struct DoomThing));
+            if (things == NULL)
+                return fail("map_things: Out of memory");
+            doommap->things = things;
+            ++doommap->num_things;
+
+            struct DoomThing* mobj = &doommap->things[doommap->num_things - 1];
+            mobj->x = (x * 64) + 32;
+            mobj->y = (y * -64) - 32;
+            mobj->angle = obj->angle;
+            mobj->ednum = obj->ednum;
+            mobj->flags = (uint16_t)obj->flags;
+            if (wolfmap->planes[PLANE_WALLS] != NULL && aid_is_ambush(config, wolfmap->planes[PLANE_WALLS][pos]))
+                mobj->flags |= TF_AMBUSH;
+        }
+    }
+
+    doommap->checkpoints[to].things = doommap->num_things;
+    stats_end();
+    return true;
+}
+
+// First pass: Make sectors
+bool map_sectors(struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config, int16_t from) {
+    stats_begin(PHASE_SECTORS);
+
+    // Tiles are looked up in parallel, sectors are numbered in order since ambush areas depend on earlier cells
+    struct MapBands bands = {doommap, wolfmap, config, from, pool_bands(wolfmap->width - from), NULL};
+    pool_run(sectors_band, &bands, bands.num_bands);
+    for (int16_t x = from; x < wolfmap->width; x++)
+        if (!sectors_column(doommap, wolfmap, config, x))
+            return false;
+
+    doommap->checkpoints[wolfmap->width].sectors = doommap->num_sectors;
+    doommap->checkpoints[wolfmap->width].last_asector = doommap->last_asector;
+    stats_end();
+    return true;
+}
+
+bool sectors_column(struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config, int16_t x) {
+    doommap->checkpoints[x].sectors = doommap->num_sectors;
+    doommap->checkpoints[x].last_asector = doommap->last_asector;
+    for (int16_t y = 0; y < wolfmap->height; y++) {
+        size_t pos = y * wolfmap->width + x;
+        uint16_t id = wolfmap->planes[PLANE_WALLS][pos];
+        struct LineCell* cell = map_cell(doommap, x, y);
+
+        uint16_t sector_id, sector_special = ST_NORMAL;
+        if (cell->door != NULL || cell->secret) {
+            sector_special = cell->secret ? ST_SECRET : ST_NORMAL;
+            sector_id = doommap->last_asector--;
+        } else if (cell->wall != NULL) {
+            sector_id = cell->wall->type == WALL_MIDTEX ? id : NO_SECTOR;
+        } else if (cell->area != NULL) {
+            switch (cell->area->type) {
+                default:
+                    sector_id = id;
+                    break;
+
+                case AREA_SLIME5: {
+                    sector_special = ST_SLIME5;
+                    sector_id = id;
+                    break;
+                }
+
+                case AREA_SLIME10: {
+                    sector_special = ST_SLIME10;
+                    sector_id = id;
+                    break;
                 }
 
-                struct DoomThing* mobj = &doommap.things[doommap.num_things - 1];
-                mobj->x = (x * 64) + 32;
-                mobj->y = (y * -64) - 32;
-                mobj->angle = obj->angle;
-                mobj->ednum = obj->ednum;
-                mobj->flags = (uint16_t)obj->flags;
-                if (wolfmap.planes[PLANE_WALLS] != NULL && aid_is_ambush(wolfmap.planes[PLANE_WALLS][pos]))
-                    mobj->flags |= TF_AMBUSH;
+                case AREA_SLIME20: {
+                    sector_special = ST_SLIME20;
+                    sector_id = id;
+                    break;
+                }
+
+                case AREA_AMBUSH: {
+                    struct LineCell* neighbor;
+                    if ((y > 0 && (neighbor = map_cell(doommap, x, y - 1))->wall == NULL && neighbor->door == NULL) ||
+                        (x > 0 && (neighbor = map_cell(doommap, x - 1, y))->wall == NULL && neighbor->door == NULL)) {
+                        sector_id = cell->tile = neighbor->tile;
+                        cell->area = neighbor->area;
+                    } else if ((y < (wolfmap->height - 1) &&
+                                get_wall_info(
+                                    config, id = (wolfmap->planes[PLANE_WALLS][(y + 1) * wolfmap->width + x])
+                                ) == NULL &&
+                                get_door_info(config, id) == NULL && !aid_is_ambush(config, id)) ||
+                               (x < (wolfmap->width - 1) &&
+                                get_wall_info(
+                                    config, id = (wolfmap->planes[PLANE_WALLS][y * wolfmap->width + (x + 1)])
+                                ) == NULL &&
+                                get_door_info(config, id) == NULL && !aid_is_ambush(config, id))) {
+                        sector_id = cell->tile = id;
+                        cell->area = get_area_info(config, id);
+                    } else {
+                        sector_id = doommap->last_asector--;
+                    }
+
+                    break;
+                }
             }
+        } else {
+            sector_id = id;
         }
 
-        if (doommap.num_things)
-            printf("map_to_wad: Placed %zu thing(s)\n", doommap.num_things);
+        cell->sector =
+            sector_id == NO_SECTOR
+                ? NO_SECTOR
+                : add_custom_sector(
+                      doommap, sector_id, 0, (cell->door == NULL && !cell->secret) ? 64 : 0,
+                      cell->door == NULL ? (cell->area == NULL ? config->flats[FLAT_FLOOR]
+                                                               : cell->area->flats[FLAT_FLOOR])
+                                         : cell->door->flats[FLAT_FLOOR],
+                      cell->door == NULL ? (cell->area == NULL ? config->flats[FLAT_CEILING]
+                                                               : cell->area->flats[FLAT_CEILING])
+                                         : cell->door->flats[FLAT_CEILING],
+                      cell->area == NULL ? config->brightness : cell->area->brightness, sector_special,
+                      cell->door != NULL ? cell->door->tag : (cell->area != NULL ? cell->area->tag : 0)
+                  );
+        if (doommap->oom)
+            return fail("sectors_column: Out of memory");
+    }
+
+    return true;
+}
+
+void sectors_band(void* ctx, size_t band) {
+    const struct MapBands* bands = ctx;
+    const struct WolfMap* wolfmap = bands->wolfmap;
+    const struct Config* config = bands->config;
+    int16_t start, end;
+    band_range(bands, band, &start, &end);
+
+    for (int16_t x = start; x < end; x++)
+        for (int16_t y = 0; y < wolfmap->height; y++)
+            lookup_cell(bands->doommap, wolfmap, config, x, y);
+}
+
+void lookup_cell(
+    struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config, int16_t x, int16_t y
+) {
+    size_t pos = y * wolfmap->width + x;
+    uint16_t id = wolfmap->planes[PLANE_WALLS][pos];
+    struct LineCell* cell = map_cell(doommap, x, y);
+    cell->tile = id;
+    cell->wall = get_wall_info(config, id);
+    cell->door = cell->wall == NULL ? get_door_info(config, id) : NULL;
+    cell->area = ((cell->wall == NULL || cell->wall->type == WALL_MIDTEX) && cell->door == NULL)
+                     ? get_area_info(config, id)
+                     : NULL;
+    cell->secret =
+        wolfmap->planes[PLANE_OBJECTS] != NULL && oid_is_pushwall(config, wolfmap->planes[PLANE_OBJECTS][pos]);
+}
+
+// Second pass: Check space
+bool map_space(struct DoomMap* doommap, int16_t from) {
+    stats_begin(PHASE_SPACE);
+    if (doommap->tiles == NULL) {
+        doommap->tile_words = (doommap->width + 63) / 64;
+        doommap->tiles = stats_calloc(NUM_TILE_BITS * doommap->height * doommap->tile_words, sizeof(uint64_t));
+        if (doommap->tiles == NULL)
+            return fail("map_space: Out of memory");
     }
 
-    if (wolfmap.planes[PLANE_WALLS] != NULL) {
-        if (doommap.linemap == NULL) {
-            doommap.linemap = calloc(wolfmap.width * wolfmap.height, sizeof(struct LineCell));
-            if (doommap.linemap == NULL) {
-                printf("!!! map_to_wad: Out of memory\n");
-                exit(EXIT_FAILURE);
+    // Rows are independent here, but the flags need the bits of the rows above and below first
+    struct MapBands bands = {doommap, NULL, NULL, from, pool_bands(doommap->height), NULL};
+    pool_run(tiles_band, &bands, bands.num_bands);
+    pool_run(space_band, &bands, bands.num_bands);
+    stats_end();
+    return true;
+}
+
+void tiles_band(void* ctx, size_t band) {
+    const struct MapBands* bands = ctx;
+    struct DoomMap* doommap = bands->doommap;
+    int16_t start, end;
+    row_range(bands, band, &start, &end);
+
+    for (int16_t y = start; y < end; y++)
+        for (size_t w = 0; w < doommap->tile_words; w++) {
+            uint64_t words[NUM_TILE_BITS] = {0};
+            int16_t last = (w + 1) * 64 < doommap->width ? (int16_t)((w + 1) * 64) : doommap->width;
+            for (int16_t x = (int16_t)(w * 64); x < last; x++) {
+                uint32_t tiles = cell_tiles(map_cell(doommap, x, y));
+                for (int i = 0; i < NUM_TILE_BITS; i++)
+                    words[i] |= (uint64_t)((tiles >> i) & 1) << (x % 64);
             }
-            memset(doommap.linemap, 0, wolfmap.width * wolfmap.height * sizeof(struct LineCell));
-        }
-
-        // First pass: Make sectors
-        doommap.last_asector = 0xFFFE;
-        for (int16_t x = 0; x < wolfmap.width; x++) {
-            for (int16_t y = 0; y < wolfmap.height; y++) {
-                size_t pos = y * wolfmap.width + x;
-                uint16_t id = wolfmap.planes[PLANE_WALLS][pos];
-                struct LineCell* cell = &doommap.linemap[pos];
-
-                cell->tile = id;
-                cell->wall = get_wall_info(id);
-                cell->door = cell->wall == NULL ? get_door_info(id) : NULL;
-                cell->area = ((cell->wall == NULL || cell->wall->type == WALL_MIDTEX) && cell->door == NULL)
-                                 ? get_area_info(id)
-                                 : NULL;
-                cell->secret =
-                    wolfmap.planes[PLANE_OBJECTS] != NULL && oid_is_pushwall(wolfmap.planes[PLANE_OBJECTS][pos]);
-
-                uint16_t sector_id, sector_special = ST_NORMAL;
-                if (cell->door != NULL || cell->secret) {
-                    sector_special = cell->secret ? ST_SECRET : ST_NORMAL;
-                    sector_id = doommap.last_asector--;
-                } else if (cell->wall != NULL) {
-                    sector_id = cell->wall->type == WALL_MIDTEX ? id : NO_SECTOR;
-                } else if (cell->area != NULL) {
-                    switch (cell->area->type) {
-                        default:
-                            sector_id = id;
-                            break;
-
-                        case AREA_SLIME5: {
-                            sector_special = ST_SLIME5;
-                            sector_id = id;
-                            break;
-                        }
-
-                        case AREA_SLIME10: {
-                            sector_special = ST_SLIME10;
-                            sector_id = id;
-                            break;
-                        }
-
-                        case AREA_SLIME20: {
-                            sector_special = ST_SLIME20;
-                            sector_id = id;
-                            break;
-                        }
-
-                        case AREA_AMBUSH: {
-                            struct LineCell* neighbor;
-                            if ((y > 0 && (neighbor = &doommap.linemap[(y - 1) * wolfmap.width + x])->wall == NULL &&
-                                 neighbor->door == NULL) ||
-                                (x > 0 && (neighbor = &doommap.linemap[y * wolfmap.width + (x - 1)])->wall == NULL &&
-                                 neighbor->door == NULL)) {
-                                sector_id = cell->tile = neighbor->tile;
-                                cell->area = neighbor->area;
-                            } else if ((y < (wolfmap.height - 1) &&
-                                        get_wall_info(
-                                            id = (wolfmap.planes[PLANE_WALLS][(y + 1) * wolfmap.width + x])
-                                        ) == NULL &&
-                                        get_door_info(id) == NULL && !aid_is_ambush(id)) ||
-                                       (x < (wolfmap.width - 1) &&
-                                        get_wall_info(
-                                            id = (wolfmap.planes[PLANE_WALLS][y * wolfmap.width + (x + 1)])
-                                        ) == NULL &&
-                                        get_door_info(id) == NULL && !aid_is_ambush(id))) {
-                                sector_id = cell->tile = id;
-                                cell->area = get_area_info(id);
-                            } else {
-                                sector_id = doommap.last_asector--;
-                            }
-
-                            break;
-                        }
+
+            for (int i = 0; i < NUM_TILE_BITS; i++)
+                doommap->tiles[(i * doommap->height + y) * doommap->tile_words + w] = words[i];
+        }
+}
+
+void space_band(void* ctx, size_t band) {
+    static const int dx[4] = {1, 0, -1, 0}, dy[4] = {0, -1, 0, 1};
+    const struct MapBands* bands = ctx;
+    struct DoomMap* doommap = bands->doommap;
+    int16_t start, end;
+    row_range(bands, band, &start, &end);
+
+    for (int16_t y = start; y < end; y++)
+        for (size_t w = 0; w < doommap->tile_words; w++) {
+            uint64_t wall = tile_word(doommap, TILE_WALL, y, w, 0);
+            uint64_t midtex = tile_word(doommap, TILE_MIDTEX, y, w, 0);
+            uint64_t floor = tile_word(doommap, TILE_FLOOR, y, w, 0);
+
+            // Right, top, left and bottom
+            uint64_t faces[4], sides[4];
+            for (int i = 0; i < 4; i++) {
+                int ny = y + dy[i];
+                faces[i] = wall & ((midtex & tile_word(doommap, TILE_OPEN_MIDTEX, ny, w, dx[i])) |
+                                   (~midtex & tile_word(doommap, TILE_OPEN, ny, w, dx[i])));
+
+                // Floors get a linedef towards the outside or towards a different sector of their kind
+                uint64_t candidates = floor & ~faces[i];
+                uint64_t outside = ~tile_word(doommap, TILE_INSIDE, ny, w, dx[i]);
+                uint64_t other = candidates & ~outside &
+                                 ((midtex & tile_word(doommap, TILE_MIDTEX, ny, w, dx[i])) |
+                                  (~midtex & tile_word(doommap, TILE_AREA, ny, w, dx[i])));
+                sides[i] = candidates & outside;
+
+                // Sector numbers don't fit in a bitset, so these are compared one by one
+                for (int b = 0; other != 0; b++, other >>= 1)
+                    if (other & 1) {
+                        int x = (int)(w * 64) + b;
+                        if (map_cell(doommap, x, y)->sector !=
+                            map_cell(doommap, x + dx[i], ny)->sector)
+                            sides[i] |= (uint64_t)1 << b;
                     }
-                } else {
-                    sector_id = id;
-                }
+            }
 
-                cell->sector =
-                    sector_id == NO_SECTOR
-                        ? NO_SECTOR
-                        : add_custom_sector(
-                              sector_id, 0, (cell->door == NULL && !cell->secret) ? 64 : 0,
-                              cell->door == NULL ? (cell->area == NULL ? get_config()->flats[FLAT_FLOOR]
-                                                                       : cell->area->flats[FLAT_FLOOR])
-                                                 : cell->door->flats[FLAT_FLOOR],
-                              cell->door == NULL ? (cell->area == NULL ? get_config()->flats[FLAT_CEILING]
-                                                                       : cell->area->flats[FLAT_CEILING])
-                                                 : cell->door->flats[FLAT_CEILING],
-                              cell->area == NULL ? get_config()->brightness : cell->area->brightness, sector_special,
-                              cell->door != NULL ? cell->door->tag : (cell->area != NULL ? cell->area->tag : 0)
-                          );
+            int16_t first = w * 64 > (size_t)bands->from ? (int16_t)(w * 64) : bands->from;
+            int16_t last = (w + 1) * 64 < doommap->width ? (int16_t)((w + 1) * 64) : doommap->width;
+            for (int16_t x = first; x < last; x++) {
+                struct LineCell* cell = map_cell(doommap, x, y);
+                int b = x % 64;
+                cell->fright = (faces[0] >> b) & 1;
+                cell->ftop = (faces[1] >> b) & 1;
+                cell->fleft = (faces[2] >> b) & 1;
+                cell->fbottom = (faces[3] >> b) & 1;
+                cell->sright = (sides[0] >> b) & 1;
+                cell->stop = (sides[1] >> b) & 1;
+                cell->sleft = (sides[2] >> b) & 1;
+                cell->sbottom = (sides[3] >> b) & 1;
             }
         }
+}
 
-        // Second pass: Check space
-        for (int16_t x = 0; x < wolfmap.width; x++) {
-            for (int16_t y = 0; y < wolfmap.height; y++) {
-                struct LineCell* cell = &doommap.linemap[y * wolfmap.width + x];
+uint32_t cell_tiles(const struct LineCell* cell) {
+    // Bit i is TileBits i of the cell
+    bool wall = cell->wall != NULL, midtex = wall && cell->wall->type == WALL_MIDTEX;
+    bool door = cell->door != NULL;
+    return (1 << TILE_INSIDE) | (wall << TILE_WALL) | (midtex << TILE_MIDTEX) | ((!wall && !door) << TILE_AREA) |
+           ((cell->sector != NO_SECTOR) << TILE_FLOOR) | ((!door && !(wall && !midtex && !cell->secret)) << TILE_OPEN) |
+           ((!door && !(wall && !cell->secret)) << TILE_OPEN_MIDTEX);
+}
 
-                if (cell->wall != NULL) {
-                    cell->fright = place_free(cell, x + 1, y);
-                    cell->ftop = place_free(cell, x, y - 1);
-                    cell->fleft = place_free(cell, x - 1, y);
-                    cell->fbottom = place_free(cell, x, y + 1);
-                }
+void space_cell(struct DoomMap* doommap, int16_t x, int16_t y) {
+    // Same as space_band for a single cell, from the cells around it instead of the bitsets
+    static const int dx[4] = {1, 0, -1, 0}, dy[4] = {0, -1, 0, 1};
+    struct LineCell* cell = map_cell(doommap, x, y);
+    uint32_t tiles = cell_tiles(cell);
+    bool wall = tiles & (1 << TILE_WALL), midtex = tiles & (1 << TILE_MIDTEX), floor = tiles & (1 << TILE_FLOOR);
+    bool faces[4], sides[4];
+    for (int i = 0; i < 4; i++) {
+        int nx = x + dx[i], ny = y + dy[i];
+        bool inside = nx >= 0 && nx < doommap->width && ny >= 0 && ny < doommap->height;
+        const struct LineCell* neighbor = inside ? map_cell(doommap, nx, ny) : NULL;
+        uint32_t around = inside ? cell_tiles(neighbor) : 0;
+        faces[i] = wall && (around & (1 << (midtex ? TILE_OPEN_MIDTEX : TILE_OPEN)));
+        bool other = inside && (around & (1 << (midtex ? TILE_MIDTEX : TILE_AREA))) && cell->sector != neighbor->sector;
+        sides[i] = floor && !faces[i] && (!inside || other);
+    }
+
+    cell->fright = faces[0];
+    cell->ftop = faces[1];
+    cell->fleft = faces[2];
+    cell->fbottom = faces[3];
+    cell->sright = sides[0];
+    cell->stop = sides[1];
+    cell->sleft = sides[2];
+    cell->sbottom = sides[3];
+}
+
+uint64_t tile_word(const struct DoomMap* doommap, enum TileBits bits, int y, size_t w, int dx) {
+    // Bit b of the result is the tile at (w * 64 + b + dx, y)
+    if (y < 0 || y >= doommap->height)
+        return 0;
+
+    const uint64_t* row = &doommap->tiles[(bits * doommap->height + y) * doommap->tile_words];
+    if (dx > 0)
+        return (row[w] >> 1) | (w + 1 < doommap->tile_words ? row[w + 1] << 63 : 0);
+    if (dx < 0)
+        return (row[w] << 1) | (w > 0 ? row[w - 1] >> 63 : 0);
+    return row[w];
+}
+
+// Third pass: Make linedefs
+bool map_lines(struct DoomMap* doommap, const struct Config* config, int16_t from, const bool* replan) {
+    stats_begin(PHASE_LINES);
+    if (doommap->plans == NULL &&
+        (doommap->plans = stats_calloc(doommap->width > 0 ? doommap->width : 1, sizeof(struct LineBand))) == NULL)
+        return fail("map_lines: Out of memory");
+
+    // Columns are planned in parallel and kept for map_update, then stitched in column order so every index matches
+    // a serial run
+    struct MapBands bands = {doommap, NULL, config, from, pool_bands(doommap->width - from), replan};
+    pool_run(lines_band, &bands, bands.num_bands);
+    // Updates can keep whatever comes after the last column planned again, see stitch_lines
+    int16_t settle = doommap->width;
+    while (replan != NULL && settle > from && !replan[settle - 1])
+        --settle;
+    bool success = stitch_lines(doommap, config, from, settle);
+    stats_end();
+    return success;
+}
+
+void lines_band(void* ctx, size_t band) {
+    const struct MapBands* bands = ctx;
+    struct DoomMap* doommap = bands->doommap;
+    int16_t start, end;
+    band_range(bands, band, &start, &end);
 
-                if (cell->sector != NO_SECTOR) {
-                    cell->sright = (!cell->fright && floor_free(cell, x + 1, y));
-                    cell->stop = (!cell->ftop && floor_free(cell, x, y - 1));
-                    cell->sleft = (!cell->fleft && floor_free(cell, x - 1, y));
-                    cell->sbottom = (!cell->fbottom && floor_free(cell, x, y + 1));
+    for (int16_t x = start; x < end; x++) {
+        if (bands->replan != NULL && !bands->replan[x])
+            continue;
+        struct LineBand* out = &doommap->plans[x];
+        out->num_ops = 0;
+        out->oom = false;
+        plan_column(out, doommap, x);
+    }
+}
+
+void plan_column(struct LineBand* out, const struct DoomMap* doommap, int16_t x) {
+    for (int16_t y = 0; y < doommap->height; y++) {
+        const struct LineCell* cell = map_cell(doommap, x, y);
+
+        if (cell->door != NULL) {
+            plan_door(out, doommap, cell, x, y);
+            continue;
+        }
+
+        const struct LineCell* neighbor;
+        if (cell->sright) {
+            neighbor = y <= 0 ? NULL : map_cell(doommap, x, y - 1);
+
+            if (neighbor != NULL && neighbor->sright && neighbor->sector == cell->sector &&
+                (x >= (doommap->width - 1) || map_cell(doommap, x + 1, y)->tile ==
+                                                 map_cell(doommap, x + 1, y - 1)->tile)) {
+                plan_extend(out, x, y, LINE_RIGHT, false, (x + 1) * 64, (y + 1) * -64);
+            } else {
+                plan_line(
+                    out, x, y, LINE_RIGHT, (x + 1) * 64, (y + 1) * -64, (x + 1) * 64, (y + 0) * -64, LUMP_NONE,
+                    LUMP_NONE, LUMP_NONE, LUMP_NONE, LUMP_NONE, LUMP_NONE,
+                    (x + 1) >= doommap->width ? NO_SECTOR : map_cell(doommap, x + 1, y)->sector,
+                    cell->sector, LF_TWO_SIDED | LF_BLOCK_SOUND,
+                    (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? LT_TELEPORT : LT_NORMAL,
+                    (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? cell->area->tag : 0, 0, 0
+                );
+            }
+        }
+
+        if (cell->stop) {
+            neighbor = x <= 0 ? NULL : map_cell(doommap, x - 1, y);
+
+            if (neighbor != NULL && neighbor->stop && neighbor->sector == cell->sector &&
+                (y <= 0 || map_cell(doommap, x, y - 1)->tile ==
+                               map_cell(doommap, x - 1, y - 1)->tile)) {
+                plan_extend(out, x, y, LINE_TOP, false, (x + 1) * 64, (y + 0) * -64);
+            } else {
+                plan_line(
+                    out, x, y, LINE_TOP, (x + 1) * 64, (y + 0) * -64, (x + 0) * 64, (y + 0) * -64, LUMP_NONE,
+                    LUMP_NONE, LUMP_NONE, LUMP_NONE, LUMP_NONE, LUMP_NONE,
+                    (y - 1) < 0 ? NO_SECTOR : map_cell(doommap, x, y - 1)->sector,
+                    cell->sector, LF_TWO_SIDED | LF_BLOCK_SOUND,
+                    (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? LT_TELEPORT : LT_NORMAL,
+                    (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? cell->area->tag : 0, 0, 0
+                );
+            }
+        }
+
+        if (cell->sleft) {
+            neighbor = y <= 0 ? NULL : map_cell(doommap, x, y - 1);
+
+            if (neighbor != NULL && neighbor->sleft && neighbor->sector == cell->sector &&
+                (x <= 0 || map_cell(doommap, x - 1, y)->tile ==
+                               map_cell(doommap, x - 1, y - 1)->tile)) {
+                plan_extend(out, x, y, LINE_LEFT, true, (x + 0) * 64, (y + 1) * -64);
+            } else {
+                plan_line(
+                    out, x, y, LINE_LEFT, (x + 0) * 64, (y + 0) * -64, (x + 0) * 64, (y + 1) * -64, LUMP_NONE,
+                    LUMP_NONE, LUMP_NONE, LUMP_NONE, LUMP_NONE, LUMP_NONE,
+                    (x - 1) < 0 ? NO_SECTOR : map_cell(doommap, x - 1, y)->sector,
+                    cell->sector, LF_TWO_SIDED | LF_BLOCK_SOUND,
+                    (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? LT_TELEPORT : LT_NORMAL,
+                    (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? cell->area->tag : 0, 0, 0
+                );
+            }
+        }
+
+        if (cell->sbottom) {
+            neighbor = x <= 0 ? NULL : map_cell(doommap, x - 1, y);
+
+            if (neighbor != NULL && neighbor->sbottom && neighbor->sector == cell->sector &&
+                (y >= (doommap->height - 1) || map_cell(doommap, x, y + 1)->tile ==
+                                                  map_cell(doommap, x - 1, y + 1)->tile)) {
+                plan_extend(out, x, y, LINE_BOTTOM, true, (x + 1) * 64, (y + 1) * -64);
+            } else {
+                plan_line(
+                    out, x, y, LINE_BOTTOM, (x + 0) * 64, (y + 1) * -64, (x + 1) * 64, (y + 1) * -64, LUMP_NONE,
+                    LUMP_NONE, LUMP_NONE, LUMP_NONE, LUMP_NONE, LUMP_NONE,
+                    (y + 1) >= doommap->height ? NO_SECTOR : map_cell(doommap, x, y + 1)->sector,
+                    cell->sector, LF_TWO_SIDED | LF_BLOCK_SOUND,
+                    (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? LT_TELEPORT : LT_NORMAL,
+                    (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? cell->area->tag : 0, 0, 0
+                );
+            }
+        }
+
+        if (cell->fright) {
+            neighbor = y <= 0 ? NULL : map_cell(doommap, x, y - 1);
+
+            if (neighbor != NULL && neighbor->wall == cell->wall && neighbor->fright &&
+                neighbor->sector == cell->sector &&
+                map_cell(doommap, x + 1, y)->tile ==
+                    map_cell(doommap, x + 1, y - 1)->tile) {
+                plan_extend(out, x, y, LINE_RIGHT, false, (x + 1) * 64, (y + 1) * -64);
+            } else {
+                neighbor = map_cell(doommap, x + 1, y);
+                plan_line(
+                    out, x, y, LINE_RIGHT, (x + 1) * 64, (y + 1) * -64, (x + 1) * 64, (y + 0) * -64,
+                    (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_Y] : LUMP_NONE,
+                    (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_Y] : LUMP_NONE,
+                    LUMP_NONE,
+                    (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_Y]
+                                                                      : LUMP_NONE,
+                    (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_Y]
+                                                                       : LUMP_NONE,
+                    LUMP_NONE, neighbor->sector, cell->sector,
+                    cell->wall->type == WALL_MIDTEX
+                        ? (cell->secret ? (LF_TWO_SIDED | LF_UNPEG_LOW)
+                                        : (LF_TWO_SIDED | LF_UNPEG_LOW | LF_BLOCKING | LF_BLOCK_SOUND))
+                        : (cell->sector == NO_SECTOR ? (LF_BLOCKING | LF_UNPEG_LOW)
+                                                     : (LF_TWO_SIDED | LF_SECRET)),
+                    cell->sector == NO_SECTOR
+                        ? (cell->wall->actions[SIDE_Y] == WACT_EXIT
+                               ? ((neighbor->area != NULL && neighbor->area->type == AREA_SECRET_EXIT)
+                                      ? LT_SECRET_EXIT
+                                      : LT_EXIT)
+                               : LT_NORMAL)
+                        : ((cell->secret && cell->wall->type != WALL_MIDTEX) ? LT_SECRET : LT_NORMAL),
+                    cell->wall->tag, 0, 0
+                );
+            }
+        }
+
+        if (cell->ftop) {
+            neighbor = x <= 0 ? NULL : map_cell(doommap, x - 1, y);
+
+            if (neighbor != NULL && neighbor->wall == cell->wall && neighbor->ftop &&
+                neighbor->sector == cell->sector &&
+                map_cell(doommap, x, y - 1)->tile ==
+                    map_cell(doommap, x - 1, y - 1)->tile) {
+                plan_extend(out, x, y, LINE_TOP, false, (x + 1) * 64, (y + 0) * -64);
+            } else {
+                neighbor = map_cell(doommap, x, y - 1);
+                plan_line(
+                    out, x, y, LINE_TOP, (x + 1) * 64, (y + 0) * -64, (x + 0) * 64, (y + 0) * -64,
+                    (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_X] : LUMP_NONE,
+                    (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_X] : LUMP_NONE,
+                    LUMP_NONE,
+                    (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_X]
+                                                                      : LUMP_NONE,
+                    (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_X]
+                                                                       : LUMP_NONE,
+                    LUMP_NONE, neighbor->sector, cell->sector,
+                    cell->wall->type == WALL_MIDTEX
+                        ? (cell->secret ? (LF_TWO_SIDED | LF_UNPEG_LOW)
+                                        : (LF_TWO_SIDED | LF_UNPEG_LOW | LF_BLOCKING | LF_BLOCK_SOUND))
+                        : (cell->sector == NO_SECTOR ? (LF_BLOCKING | LF_UNPEG_LOW)
+                                                     : (LF_TWO_SIDED | LF_SECRET)),
+                    cell->sector == NO_SECTOR
+                        ? (cell->wall->actions[SIDE_X] == WACT_EXIT
+                               ? ((neighbor->area != NULL && neighbor->area->type == AREA_SECRET_EXIT)
+                                      ? LT_SECRET_EXIT
+                                      : LT_EXIT)
+                               : LT_NORMAL)
+                        : ((cell->secret && cell->wall->type != WALL_MIDTEX) ? LT_SECRET : LT_NORMAL),
+                    cell->wall->tag, 0, 0
+                );
+            }
+        }
+
+        if (cell->fleft) {
+            neighbor = y <= 0 ? NULL : map_cell(doommap, x, y - 1);
+
+            if (neighbor != NULL && neighbor->wall == cell->wall && neighbor->fleft &&
+                neighbor->sector == cell->sector &&
+                map_cell(doommap, x - 1, y)->tile ==
+                    map_cell(doommap, x - 1, y - 1)->tile) {
+                plan_extend(out, x, y, LINE_LEFT, true, (x + 0) * 64, (y + 1) * -64);
+            } else {
+                neighbor = map_cell(doommap, x - 1, y);
+                plan_line(
+                    out, x, y, LINE_LEFT, (x + 0) * 64, (y + 0) * -64, (x + 0) * 64, (y + 1) * -64,
+                    (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_Y] : LUMP_NONE,
+                    (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_Y] : LUMP_NONE,
+                    LUMP_NONE,
+                    (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_Y]
+                                                                      : LUMP_NONE,
+                    (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_Y]
+                                                                       : LUMP_NONE,
+                    LUMP_NONE, neighbor->sector, cell->sector,
+                    cell->wall->type == WALL_MIDTEX
+                        ? (cell->secret ? (LF_TWO_SIDED | LF_UNPEG_LOW)
+                                        : (LF_TWO_SIDED | LF_UNPEG_LOW | LF_BLOCKING | LF_BLOCK_SOUND))
+                        : (cell->sector == NO_SECTOR ? (LF_BLOCKING | LF_UNPEG_LOW)
+                                                     : (LF_TWO_SIDED | LF_SECRET)),
+                    cell->sector == NO_SECTOR
+                        ? (cell->wall->actions[SIDE_Y] == WACT_EXIT
+                               ? ((neighbor->area != NULL && neighbor->area->type == AREA_SECRET_EXIT)
+                                      ? LT_SECRET_EXIT
+                                      : LT_EXIT)
+                               : LT_NORMAL)
+                        : ((cell->secret && cell->wall->type != WALL_MIDTEX) ? LT_SECRET : LT_NORMAL),
+                    cell->wall->tag, 0, 0
+                );
+            }
+        }
+
+        if (cell->fbottom) {
+            neighbor = x <= 0 ? NULL : map_cell(doommap, x - 1, y);
+
+            if (neighbor != NULL && neighbor->wall == cell->wall && neighbor->fbottom &&
+                neighbor->sector == cell->sector &&
+                map_cell(doommap, x, y + 1)->tile ==
+                    map_cell(doommap, x - 1, y + 1)->tile) {
+                plan_extend(out, x, y, LINE_BOTTOM, true, (x + 1) * 64, (y + 1) * -64);
+            } else {
+                neighbor = map_cell(doommap, x, y + 1);
+                plan_line(
+                    out, x, y, LINE_BOTTOM, (x + 0) * 64, (y + 1) * -64, (x + 1) * 64, (y + 1) * -64,
+                    (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_X] : LUMP_NONE,
+                    (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_X] : LUMP_NONE,
+                    LUMP_NONE,
+                    (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_X]
+                                                                      : LUMP_NONE,
+                    (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_X]
+                                                                       : LUMP_NONE,
+                    LUMP_NONE, neighbor->sector, cell->sector,
+                    cell->wall->type == WALL_MIDTEX
+                        ? (cell->secret ? (LF_TWO_SIDED | LF_UNPEG_LOW)
+                                        : (LF_TWO_SIDED | LF_UNPEG_LOW | LF_BLOCKING | LF_BLOCK_SOUND))
+                        : (cell->sector == NO_SECTOR ? (LF_BLOCKING | LF_UNPEG_LOW)
+                                                     : (LF_TWO_SIDED | LF_SECRET)),
+                    cell->sector == NO_SECTOR
+                        ? (cell->wall->actions[SIDE_X] == WACT_EXIT
+                               ? ((neighbor->area != NULL && neighbor->area->type == AREA_SECRET_EXIT)
+                                      ? LT_SECRET_EXIT
+                                      : LT_EXIT)
+                               : LT_NORMAL)
+                        : ((cell->secret && cell->wall->type != WALL_MIDTEX) ? LT_SECRET : LT_NORMAL),
+                    cell->wall->tag, 0, 0
+                );
+            }
+        }
+    }
+}
+
+void band_range(const struct MapBands* bands, size_t band, int16_t* start, int16_t* end) {
+    size_t columns = bands->doommap->width - bands->from;
+    *start = bands->from + (int16_t)(columns * band / bands->num_bands);
+    *end = bands->from + (int16_t)(columns * (band + 1) / bands->num_bands);
+}
+
+void row_range(const struct MapBands* bands, size_t band, int16_t* start, int16_t* end) {
+    *start = (int16_t)(bands->doommap->height * band / bands->num_bands);
+    *end = (int16_t)(bands->doommap->height * (band + 1) / bands->num_bands);
+}
+
+bool stitch_lines(struct DoomMap* doommap, const struct Config* config, int16_t from, int16_t settle) {
+    struct LineStitch stitch = {from, NO_SECTOR, NO_SECTOR};
+    for (int16_t x = from; x < doommap->width; x++) {
+        // Columns past settle weren't planned again, so once everything up to one came out as before so does the rest
+        if (x >= settle && lines_settled(doommap, x)) {
+            while (stitch.x < x)
+                checkpoint_lines(doommap, stitch.x++);
+            keep_lines(doommap);
+            printf("stitch_lines: Kept the lines from column %d on\n", x);
+            return true;
+        }
+        if (!stitch_ops(doommap, config, &doommap->plans[x], &stitch))
+            return false;
+    }
+
+    while (stitch.x <= doommap->width)
+        checkpoint_lines(doommap, stitch.x++);
+    return true;
+}
+
+bool stitch_ops(
+    struct DoomMap* doommap, const struct Config* config, const struct LineBand* in, struct LineStitch* stitch
+) {
+    if (in->oom)
+        return fail("map_lines: Out of memory");
+
+    for (size_t i = 0; i < in->num_ops; i++) {
+        const struct LineOp* op = &in->ops[i];
+        while (stitch->x <= op->x)
+            checkpoint_lines(doommap, stitch->x++);
+
+        struct LineCell* cell = map_cell(doommap, op->x, op->y);
+        switch (op->type) {
+            case OP_TRACKS:
+                stitch->ltrack_sector = add_track_sector(doommap, config, op->sector);
+                stitch->rtrack_sector = add_track_sector(doommap, config, op->back_sector);
+                break;
+
+            case OP_EXTEND: {
+                struct LineCell* neighbor = (op->field == LINE_RIGHT || op->field == LINE_LEFT)
+                                                ? map_cell(doommap, op->x, op->y - 1)
+                                                : map_cell(doommap, op->x - 1, op->y);
+                set_cell_line(doommap, cell, op->field, *cell_line(neighbor, op->field));
+                set_line_vertex(
+                    doommap, *cell_line(cell, op->field), op->end,
+                    add_vertex(doommap, op->vertices[0].x, op->vertices[0].y)
+                );
+                break;
+            }
+
+            case OP_LINE: {
+                // The end vertex comes first, like when both were nested add_line arguments
+                uint16_t end = add_vertex(doommap, op->vertices[1].x, op->vertices[1].y);
+                uint16_t start = add_vertex(doommap, op->vertices[0].x, op->vertices[0].y);
+                uint16_t sector = op->sector == SECTOR_LTRACK   ? stitch->ltrack_sector
+                                  : op->sector == SECTOR_RTRACK ? stitch->rtrack_sector
+                                                                : op->sector;
+                uint16_t back_sector = op->back_sector == SECTOR_LTRACK   ? stitch->ltrack_sector
+                                       : op->back_sector == SECTOR_RTRACK ? stitch->rtrack_sector
+                                                                          : op->back_sector;
+                uint16_t line = add_line(
+                    doommap, start, end, op->textures[0], op->textures[1], op->textures[2], op->textures[3],
+                    op->textures[4], op->textures[5], sector, back_sector, op->flags, op->special, op->tag,
+                    op->x_offset, op->y_offset
+                );
+                if (op->field != LINE_NONE)
+                    set_cell_line(doommap, cell, op->field, line);
+                break;
+            }
+        }
+
+        if (doommap->oom)
+            return fail("map_lines: Out of memory");
+    }
+
+    return true;
+}
+
+struct LineOp* plan_op(struct LineBand* out, enum LineOps type, int16_t x, int16_t y) {
+    if (out->num_ops >= out->max_ops) {
+        size_t max_ops = out->max_ops ? out->max_ops * 2 : 256;
+        struct LineOp* ops = stats_realloc(out->ops, max_ops * sizeof(struct LineOp));
+        if (ops == NULL) {
+            out->oom = true;
+            return NULL;
+        }
+        out->ops = ops;
+        out->max_ops = max_ops;
+    }
+
+    struct LineOp* op = &out->ops[out->num_ops++];
+    memset(op, 0, sizeof(struct LineOp));
+    op->type = type;
+    op->x = x;
+    op->y = y;
+    return op;
+}
+
+void plan_line(
+    struct LineBand* out, int16_t x, int16_t y, enum LineFields field, int16_t x1, int16_t y1, int16_t x2, int16_t y2,
+    uint16_t upper, uint16_t middle, uint16_t lower, uint16_t back_upper, uint16_t back_middle, uint16_t back_lower,
+    uint16_t sector, uint16_t back_sector, uint16_t flags, uint16_t special, uint16_t tag, int16_t x_offset,
+    int16_t y_offset
+) {
+    struct LineOp* op = plan_op(out, OP_LINE, x, y);
+    if (op == NULL)
+        return;
+
+    op->field = field;
+    op->vertices[0].x = x1;
+    op->vertices[0].y = y1;
+    op->vertices[1].x = x2;
+    op->vertices[1].y = y2;
+    op->textures[0] = upper;
+    op->textures[1] = middle;
+    op->textures[2] = lower;
+    op->textures[3] = back_upper;
+    op->textures[4] = back_middle;
+    op->textures[5] = back_lower;
+    op->sector = sector;
+    op->back_sector = back_sector;
+    op->flags = flags;
+    op->special = special;
+    op->tag = tag;
+    op->x_offset = x_offset;
+    op->y_offset = y_offset;
+}
+
+void plan_extend(struct LineBand* out, int16_t x, int16_t y, enum LineFields field, bool end, int16_t vx, int16_t vy) {
+    struct LineOp* op = plan_op(out, OP_EXTEND, x, y);
+    if (op == NULL)
+        return;
+
+    // Extends the same field of the cell above (right/left) or to the left (top/bottom)
+    op->field = field;
+    op->end = end;
+    op->vertices[0].x = vx;
+    op->vertices[0].y = vy;
+}
+
+void plan_tracks(struct LineBand* out, int16_t x, int16_t y, uint16_t before, uint16_t after) {
+    struct LineOp* op = plan_op(out, OP_TRACKS, x, y);
+    if (op == NULL)
+        return;
+
+    // The sectors the left and right tracks open into
+    op->sector = before;
+    op->back_sector = after;
+}
+
+void plan_door(struct LineBand* out, const struct DoomMap* doommap, const struct LineCell* cell, int16_t x, int16_t y) {
+    const struct DoorInfo* door = cell->door;
+    uint16_t textures[NUM_DOOR_TEXTURES] = {LUMP_NONE, door->sides[SIDE_LEFT], door->sides[SIDE_RIGHT], door->track};
+
+    // The entrances face along the axis, and there is nothing past the edge of the map
+    int16_t dx = door->axis == DAX_Y, dy = door->axis == DAX_X;
+    uint16_t sectors[NUM_DOOR_SECTORS] = {
+        NO_SECTOR,
+        cell->sector,
+        SECTOR_LTRACK,
+        SECTOR_RTRACK,
+        (x - dx < 0 || y - dy < 0) ? NO_SECTOR : map_cell(doommap, x - dx, y - dy)->sector,
+        (x + dx >= doommap->width || y + dy >= doommap->height)
+            ? NO_SECTOR
+            : map_cell(doommap, x + dx, y + dy)->sector,
+    };
+
+    plan_tracks(out, x, y, sectors[DSEC_BEFORE], sectors[DSEC_AFTER]);
+    for (int i = 0; i < DOOR_LINES; i++) {
+        const struct DoorLine* line = &door_lines[door->axis][i];
+
+        // An entrance that opens into a wall is turned around into a one-sided wall of the track
+        if ((line->sector == DSEC_BEFORE || line->sector == DSEC_AFTER) && sectors[line->sector] == NO_SECTOR) {
+            plan_line(
+                out, x, y, LINE_NONE, x * 64 + line->x2, y * -64 + line->y2, x * 64 + line->x1, y * -64 + line->y1,
+                LUMP_NONE, door->track, LUMP_NONE, LUMP_NONE, LUMP_NONE, LUMP_NONE, sectors[line->back_sector],
+                NO_SECTOR, LF_BLOCKING | LF_UNPEG_LOW, LT_NORMAL, 0, 0, 0
+            );
+            continue;
+        }
+
+        plan_line(
+            out, x, y, LINE_NONE, x * 64 + line->x1, y * -64 + line->y1, x * 64 + line->x2, y * -64 + line->y2,
+            textures[line->textures[0]], textures[line->textures[1]], textures[line->textures[2]],
+            textures[line->textures[3]], textures[line->textures[4]], textures[line->textures[5]],
+            sectors[line->sector], sectors[line->back_sector], line->flags, line->action ? door->special : LT_NORMAL, 0,
+            line->x_offset, 0
+        );
+    }
+}
+
+int16_t* cell_line(struct LineCell* cell, enum LineFields field) {
+    switch (field) {
+        default:
+        case LINE_RIGHT:
+            return &cell->right;
+        case LINE_TOP:
+            return &cell->top;
+        case LINE_LEFT:
+            return &cell->left;
+        case LINE_BOTTOM:
+            return &cell->bottom;
+    }
+}
+
+bool map_update(struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config) {
+    bool rebuild = doommap->checkpoints == NULL || doommap->banded || doommap->config != config ||
+                   doommap->config_hash != config->hash || doommap->width != wolfmap->width ||
+                   doommap->height != wolfmap->height;
+    for (int i = 0; i < MAX_PLANES && !rebuild; i++)
+        rebuild = (doommap->planes[i] == NULL) != (wolfmap->planes[i] == NULL);
+
+    if (rebuild) {
+        map_teardown(NULL, doommap);
+        return map_to_wad(doommap, wolfmap, config) && map_keep(doommap, wolfmap, config, 0, wolfmap->width);
+    }
+
+    // Everything is emitted column by column, so find the columns that were edited
+    int16_t width = doommap->width, dirty = width, dirty_end = -1;
+    for (int i = 0; i < MAX_PLANES; i++)
+        if (i != PLANE_MISC && wolfmap->planes[i] != NULL)
+            for (size_t pos = 0; pos < (size_t)width * doommap->height; pos++)
+                if (wolfmap->planes[i][pos] != doommap->planes[i][pos]) {
+                    int16_t x = (int16_t)(pos % width);
+                    dirty = x < dirty ? x : dirty;
+                    dirty_end = x > dirty_end ? x : dirty_end;
                 }
+
+    snprintf(doommap->name, LUMP_NAME_MAX, "MAP%02u", wolfmap->id + 1);
+    if (dirty >= width) {
+        printf("map_update: No changes\n");
+        return map_keep(doommap, wolfmap, config, width, width);
+    }
+
+    if (wolfmap->planes[PLANE_OBJECTS] != NULL && !update_things(doommap, wolfmap, config, dirty, dirty_end + 1))
+        return false;
+
+    if (wolfmap->planes[PLANE_WALLS] != NULL) {
+        // Ambush areas look ahead one column, and the flags of the second pass look at the columns around
+        int16_t from = dirty > 0 ? dirty - 1 : 0;
+        struct ColumnSnapshot previous = {NULL, from > 0 ? from - 1 : 0, from > 0 ? from - 1 : 0, 0};
+        if (from > 0 && !snapshot_column(doommap, &previous))
+            return fail("map_update: Out of memory");
+
+        // Everything past the current counts stays in place, so that whatever comes out the same can be kept
+        size_t num_sectors = doommap->checkpoints[width].sectors;
+        uint16_t last_asector = doommap->checkpoints[width].last_asector;
+        doommap->kept = (struct MapCheckpoint){
+            doommap->num_things, doommap->num_sectors, doommap->last_asector, doommap->num_lines, doommap->num_sides,
+            doommap->num_vertices, doommap->num_track_sectors, doommap->num_edits
+        };
+        doommap->keeping = true;
+        doommap->diverged = false;
+        doommap->num_sectors = doommap->checkpoints[from].sectors;
+        doommap->last_asector = doommap->checkpoints[from].last_asector;
+        if (!update_sectors(doommap, wolfmap, config, dirty_end + 1, &previous)) {
+            stats_free(previous.cells);
+            return false;
+        }
+
+        // Cells past where the sectors settled are the same, only the flags of the next column can change
+        int16_t settled = previous.to;
+        if (settled < width) {
+            if (!snapshot_column(doommap, &previous)) {
+                stats_free(previous.cells);
+                return fail("map_update: Out of memory");
             }
+
+            stats_begin(PHASE_SPACE);
+            for (int16_t x = previous.from; x < previous.to; x++)
+                for (int16_t y = 0; y < doommap->height; y++)
+                    space_cell(doommap, x, y);
+            stats_end();
+        } else if (!map_space(doommap, previous.from)) {
+            stats_free(previous.cells);
+            return false;
         }
 
-        // Third pass: Make linedefs
-        for (int16_t x = 0; x < wolfmap.width; x++) {
-            for (int16_t y = 0; y < wolfmap.height; y++) {
-                size_t pos = y * wolfmap.width + x;
-                struct LineCell* cell = &doommap.linemap[pos];
-
-                if (cell->door != NULL) {
-                    uint16_t ltrack_sector = add_custom_sector(
-                        doommap.last_asector--, 0, 64, get_config()->flats[FLAT_FLOOR],
-                        get_config()->flats[FLAT_CEILING], get_config()->brightness, ST_NORMAL, 0
-                    );
-
-                    uint16_t rtrack_sector = add_custom_sector(
-                        doommap.last_asector--, 0, 64, get_config()->flats[FLAT_FLOOR],
-                        get_config()->flats[FLAT_CEILING], get_config()->brightness, ST_NORMAL, 0
-                    );
-
-                    uint16_t action;
-                    switch (cell->door->type) {
-                        default:
-                        case DOOR_NORMAL:
-                            action = LT_DOOR;
-                            break;
-                        case DOOR_FAST:
-                            action = LT_DOOR_FAST;
-                            break;
-                        case DOOR_RED:
-                            action = LT_DOOR_RED;
-                            break;
-                        case DOOR_YELLOW:
-                            action = LT_DOOR_YELLOW;
-                            break;
-                        case DOOR_BLUE:
-                            action = LT_DOOR_BLUE;
-                            break;
-                        case DOOR_RED_CARD:
-                            action = LT_DOOR_RED_CARD;
-                            break;
-                        case DOOR_YELLOW_CARD:
-                            action = LT_DOOR_YELLOW_CARD;
-                            break;
-                        case DOOR_BLUE_CARD:
-                            action = LT_DOOR_BLUE_CARD;
-                            break;
-                        case DOOR_RED_SKULL:
-                            action = LT_DOOR_RED_SKULL;
-                            break;
-                        case DOOR_YELLOW_SKULL:
-                            action = LT_DOOR_YELLOW_SKULL;
-                            break;
-                        case DOOR_BLUE_SKULL:
-                            action = LT_DOOR_BLUE_SKULL;
-                            break;
-                    }
+        // Linedefs of a column only look at the cells of adjacent columns, so only those around a change are planned
+        // again and everything is stitched from the first of them
+        bool* replan = stats_calloc(width, sizeof(bool));
+        if (replan == NULL) {
+            stats_free(previous.cells);
+            return fail("map_update: Out of memory");
+        }
+        int16_t lines_from = width, replanned = 0;
+        for (int16_t x = previous.from; x < previous.to; x++) {
+            if (!column_changed(doommap, &previous, x))
+                continue;
+            for (int16_t i = x > 0 ? x - 1 : 0; i <= x + 1 && i < width; i++) {
+                replanned += !replan[i];
+                replan[i] = true;
+            }
+            if (lines_from == width)
+                lines_from = x > 0 ? x - 1 : 0;
+        }
+        stats_free(previous.cells);
+
+        // Lines of earlier columns that get rewound might not be indexed like that anymore
+        const struct MapCheckpoint* checkpoint = &doommap->checkpoints[lines_from];
+        doommap->diverged = false;
+        while (doommap->num_edits > checkpoint->edits) {
+            const struct LineEdit* edit = &doommap->edits[--doommap->num_edits];
+            doommap->lines[edit->line].start = edit->start;
+            doommap->lines[edit->line].end = edit->end;
+            if (edit->line < checkpoint->lines)
+                index_line(doommap, edit->line);
+        }
+        doommap->num_lines = checkpoint->lines;
+        doommap->num_sides = checkpoint->sides;
+        doommap->num_vertices = checkpoint->vertices;
+        doommap->num_track_sectors = checkpoint->tracks;
+
+        // Door track sectors come after the first pass' sectors. If those moved, the tracks of earlier doors are
+        // added again in the same order and their sides move along with them
+        if (doommap->num_sectors == num_sectors && doommap->last_asector == last_asector) {
+            doommap->num_sectors += checkpoint->tracks;
+            doommap->last_asector = (uint16_t)(doommap->last_asector - checkpoint->tracks);
+        } else {
+            doommap->keeping = false;
+            size_t tracks_from = doommap->num_sectors;
+            for (size_t i = 0; i < doommap->num_sides; i++)
+                if (doommap->sides[i].sector != NO_SECTOR && doommap->sides[i].sector >= num_sectors)
+                    doommap->sides[i].sector = (uint16_t)(doommap->sides[i].sector - num_sectors + tracks_from);
+            for (size_t i = 0; i < doommap->num_track_sectors; i++)
+                doommap->track_sectors[i].sector = add_track(doommap, config);
+        }
+        if (doommap->oom) {
+            stats_free(replan);
+            return fail("map_update: Out of memory");
+        }
 
-                    if (cell->door->axis == DAX_Y) {
-                        // Entrance
-                        add_line(
-                            add_vertex((x + 0) * 64, (y + 0) * -64), add_vertex((x + 0) * 64, (y + 1) * -64), "-", "-",
-                            "-", "-", "-", "-", doommap.linemap[y * wolfmap.width + (x - 1)].sector, ltrack_sector,
-                            LF_TWO_SIDED, 0, 0, 0, 0
-                        );
-                        add_line(
-                            add_vertex((x + 1) * 64, (y + 1) * -64), add_vertex((x + 1) * 64, (y + 0) * -64), "-", "-",
-                            "-", "-", "-", "-", doommap.linemap[y * wolfmap.width + (x + 1)].sector, rtrack_sector,
-                            LF_TWO_SIDED, 0, 0, 0, 0
-                        );
-
-                        // Side
-                        add_line(
-                            add_vertex((x + 0) * 64, (y + 0) * -64), add_vertex((x + 0) * 64 + 29, (y + 0) * -64), "-",
-                            cell->door->track, "-", "-", "-", "-", ltrack_sector, NO_SECTOR, LF_BLOCKING | LF_UNPEG_LOW,
-                            0, 0, 0, 0
-                        );
-                        add_line(
-                            add_vertex((x + 0) * 64 + 35, (y + 0) * -64), add_vertex((x + 1) * 64, (y + 0) * -64), "-",
-                            cell->door->track, "-", "-", "-", "-", rtrack_sector, NO_SECTOR, LF_BLOCKING | LF_UNPEG_LOW,
-                            0, 0, 35, 0
-                        );
-                        add_line(
-                            add_vertex((x + 1) * 64, (y + 1) * -64), add_vertex((x + 0) * 64 + 35, (y + 1) * -64), "-",
-                            cell->door->track, "-", "-", "-", "-", rtrack_sector, NO_SECTOR, LF_BLOCKING | LF_UNPEG_LOW,
-                            0, 0, 0, 0
-                        );
-                        add_line(
-                            add_vertex((x + 0) * 64 + 29, (y + 1) * -64), add_vertex((x + 0) * 64, (y + 1) * -64), "-",
-                            cell->door->track, "-", "-", "-", "-", ltrack_sector, NO_SECTOR, LF_BLOCKING | LF_UNPEG_LOW,
-                            0, 0, 35, 0
-                        );
-
-                        // Door
-                        add_line(
-                            add_vertex((x + 0) * 64 + 29, (y + 0) * -64), add_vertex((x + 0) * 64 + 29, (y + 1) * -64),
-                            cell->door->sides[SIDE_LEFT], "-", "-", "-", "-", "-", ltrack_sector, cell->sector,
-                            LF_TWO_SIDED, action, 0, 0, 0
-                        );
-                        add_line(
-                            add_vertex((x + 0) * 64 + 35, (y + 1) * -64), add_vertex((x + 0) * 64 + 35, (y + 0) * -64),
-                            cell->door->sides[SIDE_RIGHT], "-", "-", "-", "-", "-", rtrack_sector, cell->sector,
-                            LF_TWO_SIDED, action, 0, 0, 0
-                        );
-                        add_line(
-                            add_vertex((x + 0) * 64 + 29, (y + 0) * -64), add_vertex((x + 0) * 64 + 35, (y + 0) * -64),
-                            "-", cell->door->track, "-", "-", "-", "-", cell->sector, NO_SECTOR,
-                            LF_BLOCKING | LF_UNPEG_LOW, LT_NORMAL, 0, 29, 0
-                        );
-                        add_line(
-                            add_vertex((x + 0) * 64 + 35, (y + 1) * -64), add_vertex((x + 0) * 64 + 29, (y + 1) * -64),
-                            "-", cell->door->track, "-", "-", "-", "-", cell->sector, NO_SECTOR,
-                            LF_BLOCKING | LF_UNPEG_LOW, LT_NORMAL, 0, 29, 0
-                        );
-                    } else if (cell->door->axis == DAX_X) {
-                        // Entrance
-                        add_line(
-                            add_vertex((x + 1) * 64, (y + 0) * -64), add_vertex((x + 0) * 64, (y + 0) * -64), "-", "-",
-                            "-", "-", "-", "-", doommap.linemap[(y - 1) * wolfmap.width + x].sector, ltrack_sector,
-                            LF_TWO_SIDED, 0, 0, 0, 0
-                        );
-                        add_line(
-                            add_vertex((x + 0) * 64, (y + 1) * -64), add_vertex((x + 1) * 64, (y + 1) * -64), "-", "-",
-                            "-", "-", "-", "-", doommap.linemap[(y + 1) * wolfmap.width + x].sector, rtrack_sector,
-                            LF_TWO_SIDED, 0, 0, 0, 0
-                        );
-
-                        // Side
-                        add_line(
-                            add_vertex((x + 0) * 64, (y + 1) * -64), add_vertex((x + 0) * 64, (y + 0) * -64 - 35), "-",
-                            cell->door->track, "-", "-", "-", "-", rtrack_sector, NO_SECTOR, LF_BLOCKING | LF_UNPEG_LOW,
-                            0, 0, 0, 0
-                        );
-                        add_line(
-                            add_vertex((x + 0) * 64, (y + 0) * -64 - 29), add_vertex((x + 0) * 64, (y + 0) * -64), "-",
-                            cell->door->track, "-", "-", "-", "-", ltrack_sector, NO_SECTOR, LF_BLOCKING | LF_UNPEG_LOW,
-                            0, 0, 35, 0
-                        );
-                        add_line(
-                            add_vertex((x + 1) * 64, (y + 0) * -64 - 35), add_vertex((x + 1) * 64, (y + 1) * -64), "-",
-                            cell->door->track, "-", "-", "-", "-", rtrack_sector, NO_SECTOR, LF_BLOCKING | LF_UNPEG_LOW,
-                            0, 0, 35, 0
-                        );
-                        add_line(
-                            add_vertex((x + 1) * 64, (y + 0) * -64), add_vertex((x + 1) * 64, (y + 0) * -64 - 29), "-",
-                            cell->door->track, "-", "-", "-", "-", ltrack_sector, NO_SECTOR, LF_BLOCKING | LF_UNPEG_LOW,
-                            0, 0, 0, 0
-                        );
-
-                        // Door
-                        add_line(
-                            add_vertex((x + 1) * 64, (y + 0) * -64 - 29), add_vertex((x + 0) * 64, (y + 0) * -64 - 29),
-                            cell->door->sides[SIDE_RIGHT], "-", "-", "-", "-", "-", ltrack_sector, cell->sector,
-                            LF_TWO_SIDED, action, 0, 0, 0
-                        );
-                        add_line(
-                            add_vertex((x + 0) * 64, (y + 0) * -64 - 35), add_vertex((x + 1) * 64, (y + 0) * -64 - 35),
-                            cell->door->sides[SIDE_LEFT], "-", "-", "-", "-", "-", rtrack_sector, cell->sector,
-                            LF_TWO_SIDED, action, 0, 0, 0
-                        );
-                        add_line(
-                            add_vertex((x + 0) * 64, (y + 0) * -64 - 35), add_vertex((x + 0) * 64, (y + 0) * -64 - 29),
-                            "-", cell->door->track, "-", "-", "-", "-", cell->sector, NO_SECTOR,
-                            LF_BLOCKING | LF_UNPEG_LOW, LT_NORMAL, 0, 29, 0
-                        );
-                        add_line(
-                            add_vertex((x + 1) * 64, (y + 0) * -64 - 29), add_vertex((x + 1) * 64, (y + 0) * -64 - 35),
-                            "-", cell->door->track, "-", "-", "-", "-", cell->sector, NO_SECTOR,
-                            LF_BLOCKING | LF_UNPEG_LOW, LT_NORMAL, 0, 29, 0
-                        );
-                    }
+        printf(
+            "map_update: Numbered sectors again from column %d to %d, planning %d column(s) of lines from column %d\n",
+            from, settled - 1, replanned, lines_from
+        );
+        bool success = lines_from >= width || map_lines(doommap, config, lines_from, replan);
+        doommap->keeping = false;
+        stats_free(replan);
+        if (!success)
+            return false;
+    }
+
+    return map_keep(doommap, wolfmap, config, dirty, dirty_end + 1);
+}
+
+bool map_keep(
+    struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config, int16_t from, int16_t to
+) {
+    // Banded maps are always converted from scratch, so their planes aren't kept. Updates only copy the edited columns
+    const size_t size = doommap->width * doommap->height * sizeof(uint16_t);
+    for (int i = 0; i < MAX_PLANES && !doommap->banded; i++) {
+        if (wolfmap->planes[i] == NULL)
+            continue;
+
+        if (doommap->planes[i] == NULL && (doommap->planes[i] = stats_malloc(size)) == NULL)
+            return fail("map_keep: Out of memory");
+        for (size_t pos = from; pos < size / sizeof(uint16_t) && from < to; pos += doommap->width)
+            memcpy(&doommap->planes[i][pos], &wolfmap->planes[i][pos], (to - from) * sizeof(uint16_t));
+    }
+
+    doommap->config = config;
+    doommap->config_hash = config->hash;
+    return true;
+}
+
+bool update_things(
+    struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config, int16_t from, int16_t to
+) {
+    // Things only depend on their own tile, so those of later columns move along after the ones placed again
+    struct MapCheckpoint* checkpoints = doommap->checkpoints;
+    size_t last = checkpoints[to].things, num_kept = doommap->num_things - last;
+    struct DoomThing* kept = NULL;
+    if (num_kept > 0) {
+        if ((kept = stats_malloc(num_kept * sizeof(struct DoomThing))) == NULL)
+            return fail("update_things: Out of memory");
+        memcpy(kept, &doommap->things[last], num_kept * sizeof(struct DoomThing));
+    }
+
+    doommap->num_things = checkpoints[from].things;
+    bool success = map_things(doommap, wolfmap, config, from, to);
+    if (success && num_kept > 0) {
+        size_t num_things = doommap->num_things;
+        struct DoomThing* things = stats_realloc(doommap->things, (num_things + num_kept) * sizeof(struct DoomThing));
+        if (things == NULL) {
+            success = fail("update_things: Out of memory");
+        } else {
+            doommap->things = things;
+            memcpy(&things[num_things], kept, num_kept * sizeof(struct DoomThing));
+            doommap->num_things += num_kept;
+            for (int16_t x = to + 1; x <= doommap->width; x++)
+                checkpoints[x].things = checkpoints[x].things - last + num_things;
+        }
+    }
+
+    if (kept != NULL)
+        stats_free(kept);
+    return success;
+}
+
+bool update_sectors(
+    struct DoomMap* doommap, const struct WolfMap* wolfmap, const struct Config* config, int16_t settle,
+    struct ColumnSnapshot* previous
+) {
+    // Columns are numbered again until one past settle starts from the same sectors as before with the same cells
+    // next to it, everything from there would come out the same
+    stats_begin(PHASE_SECTORS);
+    const struct MapCheckpoint* checkpoints = doommap->checkpoints;
+    int16_t x = previous->to;
+    for (; x < doommap->width; x++) {
+        if (x >= settle && !doommap->diverged && doommap->num_sectors == checkpoints[x].sectors &&
+            doommap->last_asector == checkpoints[x].last_asector && !column_changed(doommap, previous, x - 1))
+            break;
+
+        if (!snapshot_column(doommap, previous)) {
+            stats_end();
+            return fail("update_sectors: Out of memory");
+        }
+        for (int16_t y = 0; y < doommap->height; y++)
+            lookup_cell(doommap, wolfmap, config, x, y);
+        if (!sectors_column(doommap, wolfmap, config, x)) {
+            stats_end();
+            return false;
+        }
+    }
+
+    if (x < doommap->width) {
+        doommap->num_sectors = checkpoints[doommap->width].sectors;
+        doommap->last_asector = checkpoints[doommap->width].last_asector;
+    } else {
+        doommap->checkpoints[x].sectors = doommap->num_sectors;
+        doommap->checkpoints[x].last_asector = doommap->last_asector;
+    }
+    stats_end();
+    return true;
+}
+
+bool snapshot_column(const struct DoomMap* doommap, struct ColumnSnapshot* snapshot) {
+    size_t column = (size_t)(snapshot->to - snapshot->from);
+    if (column >= snapshot->max_columns) {
+        size_t max_columns = snapshot->max_columns ? snapshot->max_columns * 2 : 8;
+        struct LineCell* cells =
+            stats_realloc(snapshot->cells, max_columns * doommap->height * sizeof(struct LineCell));
+        if (cells == NULL)
+            return false;
+        snapshot->cells = cells;
+        snapshot->max_columns = max_columns;
+    }
+
+    for (int16_t y = 0; y < doommap->height; y++)
+        snapshot->cells[column * doommap->height + y] = *map_cell(doommap, snapshot->to, y);
+    ++snapshot->to;
+    return true;
+}
+
+bool column_changed(const struct DoomMap* doommap, const struct ColumnSnapshot* previous, int16_t x) {
+    const struct LineCell* column = &previous->cells[(size_t)(x - previous->from) * doommap->height];
+    for (int16_t y = 0; y < doommap->height; y++) {
+        const struct LineCell* a = map_cell(doommap, x, y);
+        const struct LineCell* b = &column[y];
+        if (a->tile != b->tile || a->area != b->area || a->wall != b->wall || a->door != b->door ||
+            a->secret != b->secret || a->sector != b->sector || a->fright != b->fright || a->ftop != b->ftop ||
+            a->fleft != b->fleft || a->fbottom != b->fbottom || a->sright != b->sright || a->stop != b->stop ||
+            a->sleft != b->sleft || a->sbottom != b->sbottom)
+            return true;
+    }
+
+    return false;
+}
+
+bool map_audit(const struct DoomMap* doommap, const struct Config* config) {
+    stats_begin(PHASE_AUDIT);
+    printf(
+        "map_audit: %.8s has %zu thing(s), %zu line(s), %zu side(s), %zu vertices, %zu sector(s)\n", doommap->name,
+        doommap->num_things, doommap->num_lines, doommap->num_sides, doommap->num_vertices, doommap->num_sectors
+    );
+
+    size_t issues = 0;
+    const char* names[] = {"line(s)", "side(s)", "vertices", "sector(s)"};
+    size_t counts[] = {doommap->num_lines, doommap->num_sides, doommap->num_vertices, doommap->num_sectors};
+    for (int i = 0; i < 4; i++)
+        if (counts[i] > VANILLA_MAX_INDEX) {
+            printf(
+                "! map_audit: %.8s has %zu %s, vanilla Doom allows %d\n", doommap->name, counts[i], names[i],
+                VANILLA_MAX_INDEX
+            );
+            ++issues;
+        }
 
+    // Tiles the config doesn't know are reported once per ID, at the first place they're used
+    uint64_t seen[PLANE_OBJECTS + 1][(UINT16_MAX + 1) / 64] = {0};
+    for (int16_t x = 0; x < doommap->width; x++)
+        for (int16_t y = 0; y < doommap->height; y++) {
+            size_t pos = y * doommap->width + x;
+            for (int i = PLANE_WALLS; i <= PLANE_OBJECTS; i++) {
+                if (doommap->planes[i] == NULL)
                     continue;
-                }
 
-                struct LineCell* neighbor;
-                if (cell->sright) {
-                    neighbor = y <= 0 ? NULL : &doommap.linemap[(y - 1) * wolfmap.width + x];
+                uint16_t id = doommap->planes[i][pos];
+                bool known = i == PLANE_WALLS ? (id >= AREA_TILE_FIRST && id <= AREA_TILE_LAST) ||
+                                                    get_wall_info(config, id) != NULL ||
+                                                    get_door_info(config, id) != NULL ||
+                                                    get_area_info(config, id) != NULL
+                                              : id == 0 || get_object_info(config, id) != NULL;
+                if (known || (seen[i][id / 64] & (1ULL << (id % 64))))
+                    continue;
 
-                    if (neighbor != NULL && neighbor->sright && neighbor->sector == cell->sector &&
-                        (x >= (wolfmap.width - 1) || doommap.linemap[y * wolfmap.width + (x + 1)].tile ==
-                                                         doommap.linemap[(y - 1) * wolfmap.width + (x + 1)].tile)) {
-                        cell->right = neighbor->right;
-                        doommap.lines[cell->right].start = add_vertex((x + 1) * 64, (y + 1) * -64);
-                    } else {
-                        cell->right = add_line(
-                            add_vertex((x + 1) * 64, (y + 1) * -64), add_vertex((x + 1) * 64, (y + 0) * -64), "-", "-",
-                            "-", "-", "-", "-",
-                            (x + 1) >= wolfmap.width ? NO_SECTOR : doommap.linemap[y * wolfmap.width + (x + 1)].sector,
-                            cell->sector, LF_TWO_SIDED | LF_BLOCK_SOUND,
-                            (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? LT_TELEPORT : LT_NORMAL,
-                            (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? cell->area->tag : 0, 0, 0
-                        );
-                    }
-                }
+                seen[i][id / 64] |= 1ULL << (id % 64);
+                printf(
+                    "! map_audit: %.8s has unknown %s %u at (%d, %d)\n", doommap->name,
+                    i == PLANE_WALLS ? "tile" : "object", id, x, y
+                );
+                ++issues;
+            }
+        }
 
-                if (cell->stop) {
-                    neighbor = x <= 0 ? NULL : &doommap.linemap[y * wolfmap.width + (x - 1)];
+    stats_end();
+    if (issues > 0)
+        return fail("map_audit: Found %zu issue(s) in %.8s", issues, doommap->name);
+    return true;
+}
 
-                    if (neighbor != NULL && neighbor->stop && neighbor->sector == cell->sector &&
-                        (y <= 0 || doommap.linemap[(y - 1) * wolfmap.width + x].tile ==
-                                       doommap.linemap[(y - 1) * wolfmap.width + (x - 1)].tile)) {
-                        cell->top = neighbor->top;
-                        doommap.lines[cell->top].start = add_vertex((x + 1) * 64, (y + 0) * -64);
-                    } else {
-                        cell->top = add_line(
-                            add_vertex((x + 1) * 64, (y + 0) * -64), add_vertex((x + 0) * 64, (y + 0) * -64), "-", "-",
-                            "-", "-", "-", "-",
-                            (y - 1) < 0 ? NO_SECTOR : doommap.linemap[(y - 1) * wolfmap.width + x].sector, cell->sector,
-                            LF_TWO_SIDED | LF_BLOCK_SOUND,
-                            (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? LT_TELEPORT : LT_NORMAL,
-                            (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? cell->area->tag : 0, 0, 0
-                        );
-                    }
-                }
+bool map_convert(
+    const struct Config* config, const char* maphead_name, const char* gamemaps_name, const int* levels,
+    size_t num_levels, const char* output_name, bool update, const char* cache_dir, struct DoomMap* maps
+) {
+    return map_convert_variants(
+        &config, &output_name, 1, maphead_name, gamemaps_name, levels, num_levels, update, cache_dir, maps
+    );
+}
 
-                if (cell->sleft) {
-                    neighbor = y <= 0 ? NULL : &doommap.linemap[(y - 1) * wolfmap.width + x];
+bool map_convert_variants(
+    const struct Config* const* configs, const char* const* output_names, size_t num_variants,
+    const char* maphead_name, const char* gamemaps_name, const int* levels, size_t num_levels, bool update,
+    const char* cache_dir, struct DoomMap* maps
+) {
+    if (num_variants < 1 || num_variants > MAX_VARIANTS)
+        return fail("map_convert: Expected 1 to %d config(s), got %zu", MAX_VARIANTS, num_variants);
+    if (maps != NULL && num_variants > 1)
+        return fail("map_convert: Only a single config can keep its maps");
+
+    struct MapPipeline* pipeline = stats_calloc(1, sizeof(struct MapPipeline));
+    if (pipeline == NULL)
+        return fail("map_convert: Out of memory");
+    pipeline->maphead_name = maphead_name;
+    pipeline->gamemaps_name = gamemaps_name;
+    pipeline->levels = levels;
+    pipeline->num_levels = num_levels;
+    pipeline->maps = maps;
+    pipeline->num_variants = num_variants;
+
+    // Without outputs, levels are only converted and audited
+    pipeline->dry_run = output_names[0] == NULL;
+    bool success = true;
+    for (size_t i = 0; i < num_variants && success; i++) {
+        struct MapVariant* variant = &pipeline->variants[i];
+        variant->config = configs[i];
+        success = pipeline->dry_run || wad_open(&variant->writer, output_names[i], num_levels, update);
+    }
+    if (success && mtx_init(&pipeline->lock, mtx_plain) != thrd_success) {
+        success = fail("map_convert: Failed to create mutex");
+    } else if (success && cnd_init(&pipeline->changed) != thrd_success) {
+        mtx_destroy(&pipeline->lock);
+        success = fail("map_convert: Failed to create condition variable");
+    }
+    if (!success) {
+        for (size_t i = 0; i < num_variants; i++)
+            wad_close(&pipeline->variants[i].writer, false);
+        stats_free(pipeline);
+        return false;
+    }
 
-                    if (neighbor != NULL && neighbor->sleft && neighbor->sector == cell->sector &&
-                        (x <= 0 || doommap.linemap[y * wolfmap.width + (x - 1)].tile ==
-                                       doommap.linemap[(y - 1) * wolfmap.width + (x - 1)].tile)) {
-                        cell->left = neighbor->left;
-                        doommap.lines[cell->left].end = add_vertex((x + 0) * 64, (y + 1) * -64);
-                    } else {
-                        cell->left = add_line(
-                            add_vertex((x + 0) * 64, (y + 0) * -64), add_vertex((x + 0) * 64, (y + 1) * -64), "-", "-",
-                            "-", "-", "-", "-",
-                            (x - 1) < 0 ? NO_SECTOR : doommap.linemap[y * wolfmap.width + (x - 1)].sector, cell->sector,
-                            LF_TWO_SIDED | LF_BLOCK_SOUND,
-                            (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? LT_TELEPORT : LT_NORMAL,
-                            (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? cell->area->tag : 0, 0, 0
-                        );
-                    }
-                }
+    // Audits and kept maps need the converted map itself, which a cache hit skips
+    if (cache_dir != NULL && !pipeline->dry_run && maps == NULL) {
+        if (make_dir(cache_dir))
+            pipeline->cache_dir = cache_dir;
+        else
+            printf("! map_convert: Failed to create cache \"%s\" (%s)\n", cache_dir, strerror(errno));
+    }
 
-                if (cell->sbottom) {
-                    neighbor = x <= 0 ? NULL : &doommap.linemap[y * wolfmap.width + (x - 1)];
+    // Levels are decoded and written on threads of their own while this one converts, which needs the pool
+    thrd_t decoder, writer;
+    bool decoding = thrd_create(&decoder, pipeline_decode, pipeline) == thrd_success;
+    bool writing = decoding && thrd_create(&writer, pipeline_write, pipeline) == thrd_success;
+    if (!writing) {
+        fail("map_convert: Failed to start pipeline threads");
+        pipeline_fail(pipeline);
+    }
 
-                    if (neighbor != NULL && neighbor->sbottom && neighbor->sector == cell->sector &&
-                        (y >= (wolfmap.height - 1) || doommap.linemap[(y + 1) * wolfmap.width + x].tile ==
-                                                          doommap.linemap[(y + 1) * wolfmap.width + (x - 1)].tile)) {
-                        cell->bottom = neighbor->bottom;
-                        doommap.lines[cell->bottom].end = add_vertex((x + 1) * 64, (y + 1) * -64);
-                    } else {
-                        cell->bottom = add_line(
-                            add_vertex((x + 0) * 64, (y + 1) * -64), add_vertex((x + 1) * 64, (y + 1) * -64), "-", "-",
-                            "-", "-", "-", "-",
-                            (y + 1) >= wolfmap.height ? NO_SECTOR : doommap.linemap[(y + 1) * wolfmap.width + x].sector,
-                            cell->sector, LF_TWO_SIDED | LF_BLOCK_SOUND,
-                            (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? LT_TELEPORT : LT_NORMAL,
-                            (cell->area != NULL && cell->area->type == AREA_TELEPORT) ? cell->area->tag : 0, 0, 0
-                        );
-                    }
-                }
+    for (size_t i = 0; writing && i < num_levels; i++) {
+        // A level's slot is only reused once the writer is done with it
+        if (!pipeline_wait(pipeline, &pipeline->decoded, i + 1))
+            break;
+        if (i >= PIPELINE_DEPTH && !pipeline_wait(pipeline, &pipeline->written, i + 1 - PIPELINE_DEPTH))
+            break;
 
-                if (cell->fright) {
-                    neighbor = y <= 0 ? NULL : &doommap.linemap[(y - 1) * wolfmap.width + x];
+        // Every config reads the same decoded planes, each one is a task of its own
+        pipeline->level = i;
+        pool_run(pipeline_convert, pipeline, num_variants);
+        map_teardown(&pipeline->wolfmaps[i % PIPELINE_DEPTH], NULL);
+        mtx_lock(&pipeline->lock);
+        bool failed = pipeline->failed;
+        mtx_unlock(&pipeline->lock);
+        if (failed)
+            break;
+        pipeline_advance(pipeline, &pipeline->converted);
+    }
 
-                    if (neighbor != NULL && neighbor->wall == cell->wall && neighbor->fright &&
-                        neighbor->sector == cell->sector &&
-                        doommap.linemap[y * wolfmap.width + (x + 1)].tile ==
-                            doommap.linemap[(y - 1) * wolfmap.width + (x + 1)].tile) {
-                        cell->right = neighbor->right;
-                        doommap.lines[cell->right].start = add_vertex((x + 1) * 64, (y + 1) * -64);
-                    } else {
-                        neighbor = &doommap.linemap[y * wolfmap.width + (x + 1)];
-                        cell->right = add_line(
-                            add_vertex((x + 1) * 64, (y + 1) * -64), add_vertex((x + 1) * 64, (y + 0) * -64),
-                            (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_Y] : "-",
-                            (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_Y] : "-",
-                            "-",
-                            (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_Y] : "-",
-                            (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_Y]
-                                                                               : "-",
-                            "-", neighbor->sector, cell->sector,
-                            cell->wall->type == WALL_MIDTEX
-                                ? (cell->secret ? (LF_TWO_SIDED | LF_UNPEG_LOW)
-                                                : (LF_TWO_SIDED | LF_UNPEG_LOW | LF_BLOCKING | LF_BLOCK_SOUND))
-                                : (cell->sector == NO_SECTOR ? (LF_BLOCKING | LF_UNPEG_LOW)
-                                                             : (LF_TWO_SIDED | LF_SECRET)),
-                            cell->sector == NO_SECTOR
-                                ? (cell->wall->actions[SIDE_Y] == WACT_EXIT
-                                       ? ((neighbor->area != NULL && neighbor->area->type == AREA_SECRET_EXIT)
-                                              ? LT_SECRET_EXIT
-                                              : LT_EXIT)
-                                       : LT_NORMAL)
-                                : ((cell->secret && cell->wall->type != WALL_MIDTEX) ? LT_SECRET : LT_NORMAL),
-                            cell->wall->tag, 0, 0
-                        );
-                    }
-                }
+    if (writing) {
+        pipeline_wait(pipeline, &pipeline->written, num_levels);
+        thrd_join(writer, NULL);
+    }
+    if (decoding)
+        thrd_join(decoder, NULL);
+    cnd_destroy(&pipeline->changed);
+    mtx_destroy(&pipeline->lock);
+
+    bool failed = pipeline->failed || pipeline->flagged;
+    for (int i = 0; i < PIPELINE_DEPTH; i++)
+        map_teardown(&pipeline->wolfmaps[i], NULL);
+    for (size_t i = 0; i < num_variants; i++) {
+        struct MapVariant* variant = &pipeline->variants[i];
+        for (int j = 0; j < PIPELINE_DEPTH; j++) {
+            map_teardown(NULL, &variant->doommaps[j]);
+            free_lumps(&variant->cached[j]);
+            free_lumps(&variant->lumps[j]);
+        }
+        if (!pipeline->dry_run && !wad_close(&variant->writer, !failed))
+            success = false;
+    }
+    if (failed)
+        set_error(pipeline->error);
+    stats_free(pipeline);
+    return success && !failed;
+}
 
-                if (cell->ftop) {
-                    neighbor = x <= 0 ? NULL : &doommap.linemap[y * wolfmap.width + (x - 1)];
+struct DoomMap* pipeline_map(struct MapPipeline* pipeline, struct MapVariant* variant, size_t i) {
+    return pipeline->maps != NULL ? &pipeline->maps[i] : &variant->doommaps[i % PIPELINE_DEPTH];
+}
 
-                    if (neighbor != NULL && neighbor->wall == cell->wall && neighbor->ftop &&
-                        neighbor->sector == cell->sector &&
-                        doommap.linemap[(y - 1) * wolfmap.width + x].tile ==
-                            doommap.linemap[(y - 1) * wolfmap.width + (x - 1)].tile) {
-                        cell->top = neighbor->top;
-                        doommap.lines[cell->top].start = add_vertex((x + 1) * 64, (y + 0) * -64);
-                    } else {
-                        neighbor = &doommap.linemap[(y - 1) * wolfmap.width + x];
-                        cell->top = add_line(
-                            add_vertex((x + 1) * 64, (y + 0) * -64), add_vertex((x + 0) * 64, (y + 0) * -64),
-                            (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_X] : "-",
-                            (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_X] : "-",
-                            "-",
-                            (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_X] : "-",
-                            (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_X]
-                                                                               : "-",
-                            "-", neighbor->sector, cell->sector,
-                            cell->wall->type == WALL_MIDTEX
-                                ? (cell->secret ? (LF_TWO_SIDED | LF_UNPEG_LOW)
-                                                : (LF_TWO_SIDED | LF_UNPEG_LOW | LF_BLOCKING | LF_BLOCK_SOUND))
-                                : (cell->sector == NO_SECTOR ? (LF_BLOCKING | LF_UNPEG_LOW)
-                                                             : (LF_TWO_SIDED | LF_SECRET)),
-                            cell->sector == NO_SECTOR
-                                ? (cell->wall->actions[SIDE_X] == WACT_EXIT
-                                       ? ((neighbor->area != NULL && neighbor->area->type == AREA_SECRET_EXIT)
-                                              ? LT_SECRET_EXIT
-                                              : LT_EXIT)
-                                       : LT_NORMAL)
-                                : ((cell->secret && cell->wall->type != WALL_MIDTEX) ? LT_SECRET : LT_NORMAL),
-                            cell->wall->tag, 0, 0
-                        );
-                    }
-                }
+bool pipeline_wait(struct MapPipeline* pipeline, const size_t* counter, size_t count) {
+    mtx_lock(&pipeline->lock);
+    while (*counter < count && !pipeline->failed)
+        cnd_wait(&pipeline->changed, &pipeline->lock);
+    bool failed = pipeline->failed;
+    mtx_unlock(&pipeline->lock);
+    return !failed;
+}
 
-                if (cell->fleft) {
-                    neighbor = y <= 0 ? NULL : &doommap.linemap[(y - 1) * wolfmap.width + x];
+void pipeline_advance(struct MapPipeline* pipeline, size_t* counter) {
+    mtx_lock(&pipeline->lock);
+    ++*counter;
+    cnd_broadcast(&pipeline->changed);
+    mtx_unlock(&pipeline->lock);
+}
 
-                    if (neighbor != NULL && neighbor->wall == cell->wall && neighbor->fleft &&
-                        neighbor->sector == cell->sector &&
-                        doommap.linemap[y * wolfmap.width + (x - 1)].tile ==
-                            doommap.linemap[(y - 1) * wolfmap.width + (x - 1)].tile) {
-                        cell->left = neighbor->left;
-                        doommap.lines[cell->left].end = add_vertex((x + 0) * 64, (y + 1) * -64);
-                    } else {
-                        neighbor = &doommap.linemap[y * wolfmap.width + (x - 1)];
-                        cell->left = add_line(
-                            add_vertex((x + 0) * 64, (y + 0) * -64), add_vertex((x + 0) * 64, (y + 1) * -64),
-                            (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_Y] : "-",
-                            (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_Y] : "-",
-                            "-",
-                            (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_Y] : "-",
-                            (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_Y]
-                                                                               : "-",
-                            "-", neighbor->sector, cell->sector,
-                            cell->wall->type == WALL_MIDTEX
-                                ? (cell->secret ? (LF_TWO_SIDED | LF_UNPEG_LOW)
-                                                : (LF_TWO_SIDED | LF_UNPEG_LOW | LF_BLOCKING | LF_BLOCK_SOUND))
-                                : (cell->sector == NO_SECTOR ? (LF_BLOCKING | LF_UNPEG_LOW)
-                                                             : (LF_TWO_SIDED | LF_SECRET)),
-                            cell->sector == NO_SECTOR
-                                ? (cell->wall->actions[SIDE_Y] == WACT_EXIT
-                                       ? ((neighbor->area != NULL && neighbor->area->type == AREA_SECRET_EXIT)
-                                              ? LT_SECRET_EXIT
-                                              : LT_EXIT)
-                                       : LT_NORMAL)
-                                : ((cell->secret && cell->wall->type != WALL_MIDTEX) ? LT_SECRET : LT_NORMAL),
-                            cell->wall->tag, 0, 0
-                        );
-                    }
-                }
+void pipeline_fail(struct MapPipeline* pipeline) {
+    // Only the first error is reported, every stage stops at its next wait
+    mtx_lock(&pipeline->lock);
+    if (!pipeline->failed)
+        snprintf(pipeline->error, ERROR_MAX, "%s", get_error());
+    pipeline->failed = true;
+    cnd_broadcast(&pipeline->changed);
+    mtx_unlock(&pipeline->lock);
+}
 
-                if (cell->fbottom) {
-                    neighbor = x <= 0 ? NULL : &doommap.linemap[y * wolfmap.width + (x - 1)];
+int pipeline_decode(void* arg) {
+    struct MapPipeline* pipeline = arg;
+    for (size_t i = 0; i < pipeline->num_levels; i++) {
+        if (i >= PIPELINE_DEPTH && !pipeline_wait(pipeline, &pipeline->converted, i + 1 - PIPELINE_DEPTH))
+            break;
 
-                    if (neighbor != NULL && neighbor->wall == cell->wall && neighbor->fbottom &&
-                        neighbor->sector == cell->sector &&
-                        doommap.linemap[(y + 1) * wolfmap.width + x].tile ==
-                            doommap.linemap[(y + 1) * wolfmap.width + (x - 1)].tile) {
-                        cell->bottom = neighbor->bottom;
-                        doommap.lines[cell->bottom].end = add_vertex((x + 1) * 64, (y + 1) * -64);
-                    } else {
-                        neighbor = &doommap.linemap[(y + 1) * wolfmap.width + x];
-                        cell->bottom = add_line(
-                            add_vertex((x + 0) * 64, (y + 1) * -64), add_vertex((x + 1) * 64, (y + 1) * -64),
-                            (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_X] : "-",
-                            (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_X] : "-",
-                            "-",
-                            (cell->secret && cell->wall->type != WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_X] : "-",
-                            (!cell->secret || cell->wall->type == WALL_MIDTEX) ? cell->wall->textures[SIDE_BACK_X]
-                                                                               : "-",
-                            "-", neighbor->sector, cell->sector,
-                            cell->wall->type == WALL_MIDTEX
-                                ? (cell->secret ? (LF_TWO_SIDED | LF_UNPEG_LOW)
-                                                : (LF_TWO_SIDED | LF_UNPEG_LOW | LF_BLOCKING | LF_BLOCK_SOUND))
-                                : (cell->sector == NO_SECTOR ? (LF_BLOCKING | LF_UNPEG_LOW)
-                                                             : (LF_TWO_SIDED | LF_SECRET)),
-                            cell->sector == NO_SECTOR
-                                ? (cell->wall->actions[SIDE_X] == WACT_EXIT
-                                       ? ((neighbor->area != NULL && neighbor->area->type == AREA_SECRET_EXIT)
-                                              ? LT_SECRET_EXIT
-                                              : LT_EXIT)
-                                       : LT_NORMAL)
-                                : ((cell->secret && cell->wall->type != WALL_MIDTEX) ? LT_SECRET : LT_NORMAL),
-                            cell->wall->tag, 0, 0
-                        );
-                    }
+        // A level converted before with the same planes and config is read back, it's only decoded if any is missing
+        size_t slot = i % PIPELINE_DEPTH;
+        struct WolfMap* wolfmap = &pipeline->wolfmaps[slot];
+        trace_begin("decode", pipeline->levels[i]);
+        bool success = map_load(
+            wolfmap, pipeline->maphead_name, pipeline->gamemaps_name, pipeline->levels[i],
+            pipeline->dry_run ? PLANES_CONVERT : PLANES_ALL
+        );
+        bool cached = success && pipeline->cache_dir != NULL;
+        for (size_t j = 0; j < pipeline->num_variants && success && pipeline->cache_dir != NULL; j++) {
+            struct MapVariant* variant = &pipeline->variants[j];
+            variant->cached[slot].key = cache_key(wolfmap, variant->config);
+            cached = cache_load(pipeline->cache_dir, &variant->cached[slot]) && cached;
+        }
+        success = success && (cached || map_decode(wolfmap));
+        stats_end();
+        trace_end("decode");
+        if (!success) {
+            pipeline_fail(pipeline);
+            break;
+        }
+        pipeline_advance(pipeline, &pipeline->decoded);
+    }
+    return 0;
+}
+
+void pipeline_convert(void* arg, size_t index) {
+    struct MapPipeline* pipeline = arg;
+    struct MapVariant* variant = &pipeline->variants[index];
+    size_t i = pipeline->level, slot = i % PIPELINE_DEPTH;
+    struct DoomMap* doommap = pipeline_map(pipeline, variant, i);
+    if (pipeline->maps == NULL)
+        map_teardown(NULL, doommap);
+
+    struct MapLumps* lumps = &variant->lumps[slot];
+    *lumps = variant->cached[slot];
+    memset(&variant->cached[slot], 0, sizeof(struct MapLumps));
+    bool success = true;
+    if (lumps->cached) {
+        printf("map_convert: Reusing \"%.8s\" from the cache\n", lumps->name);
+    } else {
+        trace_begin("level", pipeline->levels[i]);
+        success = map_update(doommap, &pipeline->wolfmaps[slot], variant->config);
+        stats_end();
+        trace_end("level");
+
+        // Packed here rather than by the writer, so that PK3 entries can be compressed on the pool
+        success = success && (pipeline->dry_run || pack_map(lumps, variant->config, doommap));
+    }
+    success = success && (!variant->writer.pk3 || pk3_compress(lumps));
+    if (!success)
+        pipeline_fail(pipeline);
+}
+
+int pipeline_write(void* arg) {
+    struct MapPipeline* pipeline = arg;
+    for (size_t i = 0; i < pipeline->num_levels; i++) {
+        if (!pipeline_wait(pipeline, &pipeline->converted, i + 1))
+            break;
+
+        // Levels that fail their audit don't keep the rest from being audited
+        bool success = true;
+        for (size_t j = 0; j < pipeline->num_variants && success; j++) {
+            struct MapVariant* variant = &pipeline->variants[j];
+            const struct DoomMap* doommap = pipeline_map(pipeline, variant, i);
+            struct MapLumps* lumps = &variant->lumps[i % PIPELINE_DEPTH];
+            if (pipeline->dry_run) {
+                if (!map_audit(doommap, variant->config) && !pipeline->flagged) {
+                    mtx_lock(&pipeline->lock);
+                    snprintf(pipeline->error, ERROR_MAX, "%s", get_error());
+                    pipeline->flagged = true;
+                    mtx_unlock(&pipeline->lock);
                 }
+            } else {
+                if (!lumps->cached && pipeline->cache_dir != NULL)
+                    cache_store(pipeline->cache_dir, lumps);
+                success = wad_add_map(&variant->writer, lumps);
             }
+            free_lumps(lumps);
+        }
+
+        if (!success) {
+            pipeline_fail(pipeline);
+            break;
+        }
+        pipeline_advance(pipeline, &pipeline->written);
+    }
+    return 0;
+}
+
+bool wad_open(struct WadWriter* writer, const char* output_name, size_t num_maps, bool update) {
+    memset(writer, 0, sizeof(struct WadWriter));
+    writer->name = output_name;
+
+    // A PK3 is always written anew, its entries go first and their directory after them
+    if (is_pk3_name(output_name)) {
+        if (update)
+            printf("! wad_open: \"%s\" can't be updated in place, writing it anew\n", output_name);
+        writer->pk3 = true;
+        writer->stream = fopen(output_name, "wb");
+        if (writer->stream == NULL)
+            return fail("wad_open: Failed to open output \"%s\" (%s)", output_name, strerror(errno));
+        writer->entries = stats_calloc(num_maps > 0 ? num_maps : 1, sizeof(struct Pk3Entry));
+        if (writer->entries == NULL) {
+            fclose(writer->stream);
+            return fail("wad_open: Out of memory");
+        }
+        return true;
+    }
+
+    // Updating a WAD that doesn't exist yet just writes a new one
+    if (update) {
+        writer->stream = fopen(output_name, "r+b");
+        if (writer->stream == NULL && errno != ENOENT)
+            return fail("wad_open: Failed to open \"%s\" (%s)", output_name, strerror(errno));
+        writer->update = writer->stream != NULL;
+    }
+
+    if (writer->update) {
+        if (!read_wad_directory(
+                writer->stream, &writer->directory, &writer->num_lumps, &writer->infotableofs, num_maps * MAP_LUMPS
+            )) {
+            fclose(writer->stream);
+            return fail("wad_open: \"%s\" is not a valid WAD", output_name);
+        }
+
+        // New data and the new directory go past everything that is in use, see wad_close
+        writer->end = writer->infotableofs + writer->num_lumps * 16;
+        for (size_t i = 0; i < writer->num_lumps; i++) {
+            const struct WadLump* lump = &writer->directory[i];
+            if (lump->size > 0 && lump->filepos + lump->size > writer->end)
+                writer->end = lump->filepos + lump->size;
+        }
+        writer->append = writer->end;
+        return true;
+    }
+
+    writer->stream = fopen(output_name, "wb");
+    if (writer->stream == NULL)
+        return fail("wad_open: Failed to open output \"%s\" (%s)", output_name, strerror(errno));
+    writer->directory = stats_malloc((num_maps * MAP_LUMPS > 0 ? num_maps * MAP_LUMPS : 1) * sizeof(struct WadLump));
+    if (writer->directory == NULL) {
+        fclose(writer->stream);
+        return fail("wad_open: Out of memory");
+    }
+
+    // Directory @ 12, filled in by wad_close once every map's lumps have followed it
+    writer->infotableofs = 12;
+    writer->append = 12 + num_maps * MAP_LUMPS * 16;
+    write_string(writer->stream, "PWAD", 4);           // identification @ 0 -> 4
+    write_u32le(writer->stream, num_maps * MAP_LUMPS); // numlumps @ 4 -> 8
+    write_u32le(writer->stream, 12);                   // infotableofs @ 8 -> 12
+    for (size_t i = 0; i < num_maps * MAP_LUMPS; i++)
+        write_lump(writer->stream, 0, 0, "");
+    if (ferror(writer->stream)) {
+        wad_close(writer, false);
+        return fail("wad_open: Failed to write \"%s\"", output_name);
+    }
+    return true;
+}
+
+bool wad_open_buffer(struct WadWriter* writer, size_t num_maps) {
+    memset(writer, 0, sizeof(struct WadWriter));
+    writer->name = "memory";
+
+    // Same layout as a new WAD file, the header and directory are filled in by wad_close
+    writer->infotableofs = 12;
+    writer->append = 12 + num_maps * MAP_LUMPS * 16;
+    writer->max_size = writer->append;
+    writer->buffer = stats_calloc(writer->max_size, 1);
+    writer->directory = stats_malloc((num_maps * MAP_LUMPS > 0 ? num_maps * MAP_LUMPS : 1) * sizeof(struct WadLump));
+    if (writer->buffer == NULL || writer->directory == NULL) {
+        stats_free(writer->buffer);
+        stats_free(writer->directory);
+        return fail("wad_open_buffer: Out of memory");
+    }
+    return true;
+}
+
+bool wad_add_map(struct WadWriter* writer, const struct MapLumps* lumps) {
+    stats_begin(PHASE_WRITE);
+    if (writer->update) {
+        bool success = update_wad_map(
+            writer->stream, lumps, writer->directory, &writer->num_lumps, &writer->append, &writer->changed
+        );
+        stats_end();
+        return success || fail("wad_add_map: Failed to update \"%s\"", writer->name);
+    }
+    if (writer->pk3) {
+        bool success = pk3_add_entry(writer, &lumps->entry);
+        stats_end();
+        if (!success)
+            return fail("wad_add_map: Failed to write \"%s\"", writer->name);
+        printf("wad_add_map: Saved as \"%s\" in \"%s\"\n", lumps->entry.name, writer->name);
+        return true;
+    }
+
+    const char* names[MAP_LUMPS] = {lumps->name, "THINGS",  "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS",
+                                    "SSECTORS",  "NODES",   "SECTORS",  "REJECT",   "BLOCKMAP"};
+    const bool stored[MAP_LUMPS] = {false, true, true, true, true, false, false, false, true, false, false};
+    for (int i = 0; i < MAP_LUMPS; i++) {
+        struct WadLump* lump = &writer->directory[writer->num_lumps++];
+        memset(lump->name, 0, LUMP_NAME_MAX);
+        strncpy(lump->name, names[i], LUMP_NAME_MAX);
+        lump->filepos = stored[i] ? writer->append : 0;
+        lump->size = lumps->sizes[i];
+        if (lumps->sizes[i] > 0 && !wad_write(writer, lumps->data[i], lumps->sizes[i])) {
+            stats_end();
+            return fail("wad_add_map: Failed to write \"%s\"", writer->name);
         }
+    }
+    stats_end();
+
+    printf("wad_add_map: Saved as \"%.8s\" in \"%s\"\n", lumps->name, writer->name);
+    return true;
+}
+
+bool wad_write(struct WadWriter* writer, const void* data, size_t size) {
+    // Lumps are only ever appended, a stream is already where they go
+    if (writer->stream != NULL) {
+        writer->append += size;
+        return fwrite(data, size, 1, writer->stream) == 1;
+    }
+
+    if (writer->append + size > writer->max_size) {
+        size_t max_size = writer->max_size * 2 > writer->append + size ? writer->max_size * 2 : writer->append + size;
+        uint8_t* grown = stats_realloc(writer->buffer, max_size);
+        if (grown == NULL)
+            return false;
+        writer->buffer = grown;
+        writer->max_size = max_size;
+    }
+    memcpy(writer->buffer + writer->append, data, size);
+    writer->append += size;
+    return true;
+}
 
-        printf("map_to_wad: Placed %zu line(s), %zu sector(s)\n", doommap.num_lines, doommap.num_sectors);
-    }
-
-    FILE* output = fopen(output_name, "wb");
-    if (output == NULL) {
-        printf("!!! map_to_wad: Failed to open output \"%s\"\n", output_name);
-        perror("!!! map_to_wad");
-        exit(EXIT_FAILURE);
-    }
-
-    write_string(output, "PWAD", 4); // identification @ 0 -> 4
-    write_u32le(output, 11);         // numlumps @ 4 -> 8
-    write_u32le(output, 12);         // infotableofs @ 8 -> 12
-
-    // MAPxx
-    char map_name[LUMP_NAME_MAX];
-    snprintf(map_name, LUMP_NAME_MAX, "MAP%02u", wolfmap.id + 1);
-    write_u32le(output, 0);                        // filepos @ 12 -> 16
-    write_u32le(output, 0);                        // size @ 16 -> 20
-    write_string(output, map_name, LUMP_NAME_MAX); // name @ 20 -> 28
-
-    // THINGS
-    size_t things_size = doommap.num_things * sizeof(struct DoomThing);
-    write_u32le(output, 188);                      // filepos @ 28 -> 32
-    write_u32le(output, things_size);              // size @ 32 -> 36
-    write_string(output, "THINGS", LUMP_NAME_MAX); // name @ 36 -> 44
-
-    // LINEDEFS
-    size_t linedefs_size = doommap.num_lines * sizeof(struct DoomLine);
-    write_u32le(output, 188 + things_size);          // filepos @ 44 - 48
-    write_u32le(output, linedefs_size);              // size @ 48 -> 52
-    write_string(output, "LINEDEFS", LUMP_NAME_MAX); // name @ 52 -> 60
-
-    // SIDEDEFS
-    size_t sidedefs_size = doommap.num_sides * sizeof(struct DoomSide);
-    write_u32le(output, 188 + things_size + linedefs_size); // filepos @ 60 -> 64
-    write_u32le(output, sidedefs_size);                     // size @ 64 -> 68
-    write_string(output, "SIDEDEFS", LUMP_NAME_MAX);        // name @ 68 -> 76
-
-    // VERTEXES
-    size_t vertexes_size = doommap.num_vertices * sizeof(struct DoomVertex);
-    write_u32le(output, 188 + things_size + linedefs_size + sidedefs_size); // filepos @ 76 -> 80
-    write_u32le(output, vertexes_size);                                     // size @ 80 -> 84
-    write_string(output, "VERTEXES", LUMP_NAME_MAX);                        // name @ 84 -> 92
-
-    // SEGS
-    write_u32le(output, 0);                      // filepos @ 92 -> 96
-    write_u32le(output, 0);                      // size @ 96 -> 100
-    write_string(output, "SEGS", LUMP_NAME_MAX); // name @ 100 -> 108
-
-    // SSECTORS
-    write_u32le(output, 0);                          // filepos @ 108 -> 112
-    write_u32le(output, 0);                          // size @ 112 -> 116
-    write_string(output, "SSECTORS", LUMP_NAME_MAX); // name @ 116 -> 124
-
-    // NODES
-    write_u32le(output, 0);                       // filepos @ 124 -> 128
-    write_u32le(output, 0);                       // size @ 128 -> 132
-    write_string(output, "NODES", LUMP_NAME_MAX); // name @ 132 -> 140
-
-    // SECTORS
-    size_t sectors_size = doommap.num_sectors * sizeof(struct DoomSector);
-    write_u32le(output, 188 + things_size + linedefs_size + sidedefs_size + vertexes_size); // filepos @ 140 -> 144
-    write_u32le(output, sectors_size);                                                      // size @ 144 -> 148
-    write_string(output, "SECTORS", LUMP_NAME_MAX);                                         // name @ 148 -> 156
-
-    // REJECT
-    write_u32le(output, 0);                        // filepos @ 156 -> 160
-    write_u32le(output, 0);                        // size @ 160 -> 164
-    write_string(output, "REJECT", LUMP_NAME_MAX); // name @ 164 -> 172
-
-    // BLOCKMAP
-    write_u32le(output, 0);                          // filepos @ 172 -> 176
-    write_u32le(output, 0);                          // size @ 176 -> 180
-    write_string(output, "BLOCKMAP", LUMP_NAME_MAX); // name @ 180 -> 188
-
-    if (doommap.things != NULL)
-        fwrite(doommap.things, sizeof(struct DoomThing), doommap.num_things, output);
-    if (doommap.lines != NULL)
-        fwrite(doommap.lines, sizeof(struct DoomLine), doommap.num_lines, output);
-    if (doommap.sides != NULL)
-        fwrite(doommap.sides, sizeof(struct DoomSide), doommap.num_sides, output);
-    if (doommap.vertices != NULL)
-        fwrite(doommap.vertices, sizeof(struct DoomVertex), doommap.num_vertices, output);
-    if (doommap.sectors != NULL)
-        fwrite(doommap.sectors, sizeof(struct DoomSector), doommap.num_sectors, output);
-
-    fclose(output);
-    printf("map_to_wad: Saved as \"%s\" in \"%s\"\n", map_name, output_name);
-}
-
-bool place_free(struct LineCell* from, int x, int y) {
-    if (x < 0 || x >= wolfmap.width || y < 0 || y >= wolfmap.height)
+bool wad_close(struct WadWriter* writer, bool finish) {
+    if (writer->buffer != NULL) {
+        // The WAD stays in the buffer for the caller to take
+        if (finish) {
+            memcpy(writer->buffer, "PWAD", 4);
+            pack_u32le(writer->buffer + 4, writer->num_lumps);
+            pack_u32le(writer->buffer + 8, writer->infotableofs);
+            for (size_t i = 0; i < writer->num_lumps; i++)
+                pack_lump(writer->buffer + writer->infotableofs + i * 16, &writer->directory[i]);
+        } else {
+            stats_free(writer->buffer);
+            writer->buffer = NULL;
+        }
+        stats_free(writer->directory);
+        writer->directory = NULL;
+        return finish;
+    }
+    if (writer->stream == NULL)
         return false;
 
-    size_t pos = y * wolfmap.width + x;
-    struct LineCell* cell = &doommap.linemap[pos];
+    // An update never overwrites data in use, its directory goes after the new data and the header is written last.
+    // Until then the file still reads as it was, so an unfinished update leaves it as it was and an unfinished new
+    // WAD is removed
+    bool success = true;
+    if (finish) {
+        stats_begin(PHASE_WRITE);
+        FILE* stream = writer->stream;
+        if (writer->pk3) {
+            pk3_finish(writer);
+        } else if (!writer->update || writer->changed) {
+            if (writer->update)
+                writer->infotableofs = writer->append;
+            fseek(stream, writer->infotableofs, SEEK_SET);
+            for (size_t i = 0; i < writer->num_lumps; i++)
+                write_lump(stream, writer->directory[i].filepos, writer->directory[i].size, writer->directory[i].name);
+            if (fflush(stream) == 0 && !ferror(stream)) {
+                fseek(stream, 4, SEEK_SET);
+                write_u32le(stream, writer->num_lumps);
+                write_u32le(stream, writer->infotableofs);
+            }
+        }
+        success = fflush(stream) == 0 && !ferror(stream);
+        stats_end();
+    }
+
+    fclose(writer->stream);
+    stats_free(writer->directory);
+    stats_free(writer->entries);
+    writer->stream = NULL;
+    writer->directory = NULL;
+    writer->entries = NULL;
+    if (!finish && !writer->update)
+        remove(writer->name);
+    if (finish && !success)
+        return fail("wad_close: Failed to write \"%s\"", writer->name);
+    return success;
+}
+
+bool read_wad_directory(
+    FILE* stream, struct WadLump** directory, size_t* num_lumps, uint32_t* infotableofs, size_t extra
+) {
+    char identification[4];
+    uint32_t header[2];
+    if (fread(identification, 4, 1, stream) != 1 || fread(header, 4, 2, stream) != 2 ||
+        (strncmp(identification, "IWAD", 4) != 0 && strncmp(identification, "PWAD", 4) != 0))
+        return false;
+
+    fseek(stream, 0, SEEK_END);
+    long size = ftell(stream);
+    *num_lumps = u32le(header[0]);
+    *infotableofs = u32le(header[1]);
+    if (size < 0 || *infotableofs + (uint64_t)*num_lumps * 16 > (uint64_t)size)
+        return false;
+
+    *directory = stats_malloc((*num_lumps + extra) * sizeof(struct WadLump));
+    if (*directory == NULL)
+        return false;
+
+    fseek(stream, *infotableofs, SEEK_SET);
+    for (size_t i = 0; i < *num_lumps; i++) {
+        struct WadLump* lump = &(*directory)[i];
+        uint32_t entry[2];
+        if (fread(entry, 4, 2, stream) != 2 || fread(lump->name, LUMP_NAME_MAX, 1, stream) != 1) {
+            stats_free(*directory);
+            *directory = NULL;
+            return false;
+        }
+        lump->filepos = u32le(entry[0]);
+        lump->size = u32le(entry[1]);
+    }
+
+    return true;
+}
 
-    if (cell->door != NULL ||
-        (cell->wall != NULL &&
-         (cell->wall->type != WALL_MIDTEX || (from->wall != NULL && from->wall->type == WALL_MIDTEX)) &&
-         (wolfmap.planes[PLANE_OBJECTS] == NULL || !oid_is_pushwall(wolfmap.planes[PLANE_OBJECTS][pos]))))
+bool update_wad_map(
+    FILE* stream, const struct MapLumps* lumps, struct WadLump* directory, size_t* num_lumps, uint32_t* append,
+    bool* changed
+) {
+    // Replace everything from the marker up to the next lump that doesn't belong to a map, or append a new map
+    size_t first = 0;
+    while (first < *num_lumps && strncmp(directory[first].name, lumps->name, LUMP_NAME_MAX) != 0)
+        ++first;
+    size_t last = first < *num_lumps ? first + 1 : first;
+    while (last < *num_lumps && is_map_lump(directory[last].name))
+        ++last;
+
+    const char* names[MAP_LUMPS] = {lumps->name, "THINGS",  "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS",
+                                    "SSECTORS",  "NODES",   "SECTORS",  "REJECT",   "BLOCKMAP"};
+    struct WadLump entries[MAP_LUMPS];
+    size_t written = 0, total = 0;
+    bool success = true;
+    for (int i = 0; i < MAP_LUMPS && success; i++) {
+        memset(entries[i].name, 0, LUMP_NAME_MAX);
+        strncpy(entries[i].name, names[i], LUMP_NAME_MAX);
+        entries[i].filepos = 0;
+        entries[i].size = lumps->sizes[i];
+        total += lumps->sizes[i];
+        success = update_wad_lump(stream, directory, first, last, &entries[i], lumps->data[i], append, &written);
+    }
+    if (!success)
         return false;
 
+    // Unchanged lumps keep their entries, so an update that changed nothing doesn't need a new directory
+    bool same = last - first == MAP_LUMPS && written == 0;
+    for (size_t i = 0; i < MAP_LUMPS && same; i++)
+        same = strncmp(directory[first + i].name, entries[i].name, LUMP_NAME_MAX) == 0 &&
+               directory[first + i].filepos == entries[i].filepos && directory[first + i].size == entries[i].size;
+    *changed = *changed || !same;
+
+    printf(
+        "update_wad_map: %s \"%.8s\" (%zu of %zu byte(s) written)\n", first < *num_lumps ? "Replaced" : "Appended",
+        lumps->name, written, total
+    );
+    memmove(&directory[first + MAP_LUMPS], &directory[last], (*num_lumps - last) * sizeof(struct WadLump));
+    memcpy(&directory[first], entries, sizeof(entries));
+    *num_lumps += first + MAP_LUMPS - last;
     return true;
 }
 
-bool floor_free(struct LineCell* from, int x, int y) {
-    if (x < 0 || x >= wolfmap.width || y < 0 || y >= wolfmap.height)
+bool update_wad_lump(
+    FILE* stream, const struct WadLump* directory, size_t first, size_t last, struct WadLump* lump, const void* data,
+    uint32_t* append, size_t* written
+) {
+    if (lump->size == 0)
         return true;
 
-    struct LineCell* cell = &doommap.linemap[y * wolfmap.width + x];
-    if (cell->sector != from->sector && cell->sector != NO_SECTOR)
-        if (from->wall != NULL && from->wall->type == WALL_MIDTEX) {
-            if (cell->wall != NULL && cell->wall->type == WALL_MIDTEX)
-                return true;
-        } else if (cell->wall == NULL && cell->door == NULL) {
+    // Unchanged lumps stay where they are, everything else goes past the data in use instead of overwriting it
+    const struct WadLump* old = NULL;
+    for (size_t i = first + 1; i < last && old == NULL; i++)
+        if (strncmp(directory[i].name, lump->name, LUMP_NAME_MAX) == 0 && directory[i].size == lump->size)
+            old = &directory[i];
+
+    if (old != NULL) {
+        uint8_t* previous = stats_malloc(lump->size);
+        if (previous == NULL)
+            return fail("update_wad_lump: Out of memory");
+
+        fseek(stream, old->filepos, SEEK_SET);
+        bool same = fread(previous, lump->size, 1, stream) == 1 && memcmp(previous, data, lump->size) == 0;
+        stats_free(previous);
+        if (same) {
+            lump->filepos = old->filepos;
             return true;
         }
+    }
+
+    lump->filepos = *append;
+    *append += lump->size;
+    fseek(stream, lump->filepos, SEEK_SET);
+    fwrite(data, lump->size, 1, stream);
+    *written += lump->size;
+    return !ferror(stream);
+}
 
+bool is_map_lump(const char* name) {
+    static const char* names[] = {"THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS",     "SSECTORS",
+                                  "NODES",  "SECTORS",  "REJECT",   "BLOCKMAP", "BEHAVIOR", "SCRIPTS"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(*names); i++)
+        if (strncmp(name, names[i], LUMP_NAME_MAX) == 0)
+            return true;
     return false;
 }
 
+bool pack_map(struct MapLumps* lumps, const struct Config* config, const struct DoomMap* doommap) {
+    // Sides and sectors are expanded here, so that texture names are only copied out of the config once
+    stats_begin(PHASE_WRITE);
+    uint64_t key = lumps->key;
+    memset(lumps, 0, sizeof(struct MapLumps));
+    lumps->key = key;
+    memcpy(lumps->name, doommap->name, LUMP_NAME_MAX);
+    size_t sidedefs_size = doommap->num_sides * SIDEDEF_SIZE, sectors_size = doommap->num_sectors * SECTOR_SIZE;
+    size_t linedefs_size = doommap->num_lines * sizeof(struct DoomLine);
+    size_t vertexes_size = doommap->num_vertices * sizeof(struct DoomVertex);
+
+    // Reordered lines and vertices are copies, the map itself stays in scan order for map_update
+    bool reorder = config->order == ORDER_MORTON;
+    size_t size = sidedefs_size + sectors_size + (reorder ? linedefs_size + vertexes_size : 0);
+    lumps->buffer = stats_malloc(size > 0 ? size : 1);
+    size_t* side_order = NULL;
+    if (reorder)
+        side_order = stats_malloc((doommap->num_sides > 0 ? doommap->num_sides : 1) * sizeof(size_t));
+    if (lumps->buffer == NULL || (reorder && side_order == NULL)) {
+        stats_free(side_order);
+        return fail("pack_map: Out of memory");
+    }
+
+    uint8_t *sidedefs = lumps->buffer, *sectors = lumps->buffer + sidedefs_size;
+    const void *linedefs = doommap->lines, *vertexes = doommap->vertices;
+    if (reorder) {
+        struct DoomLine* lines = (struct DoomLine*)(sectors + sectors_size);
+        struct DoomVertex* vertices = (struct DoomVertex*)(sectors + sectors_size + linedefs_size);
+        if (!order_map(doommap, lines, vertices, side_order)) {
+            stats_free(side_order);
+            return false;
+        }
+        linedefs = lines;
+        vertexes = vertices;
+    }
+    for (size_t i = 0; i < doommap->num_sides; i++)
+        pack_side(&sidedefs[i * SIDEDEF_SIZE], config, &doommap->sides[reorder ? side_order[i] : i]);
+    for (size_t i = 0; i < doommap->num_sectors; i++)
+        pack_sector(&sectors[i * SECTOR_SIZE], config, &doommap->sectors[i]);
+    stats_free(side_order);
+
+    lumps->data[LUMP_THINGS] = doommap->things;
+    lumps->sizes[LUMP_THINGS] = doommap->num_things * sizeof(struct DoomThing);
+    lumps->data[LUMP_LINEDEFS] = linedefs;
+    lumps->sizes[LUMP_LINEDEFS] = linedefs_size;
+    lumps->data[LUMP_SIDEDEFS] = sidedefs;
+    lumps->sizes[LUMP_SIDEDEFS] = sidedefs_size;
+    lumps->data[LUMP_VERTEXES] = vertexes;
+    lumps->sizes[LUMP_VERTEXES] = vertexes_size;
+    lumps->data[LUMP_SECTORS] = sectors;
+    lumps->sizes[LUMP_SECTORS] = sectors_size;
+    stats_end();
+    return true;
+}
+
+bool order_map(
+    const struct DoomMap* doommap, struct DoomLine* lines, struct DoomVertex* vertices, size_t* side_order
+) {
+    size_t count = doommap->num_vertices;
+    if (doommap->num_lines > count)
+        count = doommap->num_lines;
+    if (doommap->num_sides > count)
+        count = doommap->num_sides;
+    struct OrderKey* keys = stats_malloc((count > 0 ? count : 1) * sizeof(struct OrderKey));
+    uint16_t* remap = stats_malloc((count > 0 ? count : 1) * sizeof(uint16_t));
+    if (keys == NULL || remap == NULL) {
+        stats_free(keys);
+        stats_free(remap);
+        return fail("order_map: Out of memory");
+    }
+
+    // Vertices by their position, lines by their midpoint
+    for (size_t i = 0; i < doommap->num_vertices; i++) {
+        const struct DoomVertex* vertex = &doommap->vertices[i];
+        keys[i] = (struct OrderKey){morton_key(vertex->x, vertex->y), i};
+    }
+    qsort(keys, doommap->num_vertices, sizeof(struct OrderKey), compare_keys);
+    for (size_t i = 0; i < doommap->num_vertices; i++) {
+        vertices[i] = doommap->vertices[keys[i].index];
+        remap[keys[i].index] = (uint16_t)i;
+    }
+
+    for (size_t i = 0; i < doommap->num_lines; i++) {
+        const struct DoomVertex *start = &doommap->vertices[doommap->lines[i].start],
+                                *end = &doommap->vertices[doommap->lines[i].end];
+        keys[i] = (struct OrderKey){morton_key((start->x + end->x) >> 1, (start->y + end->y) >> 1), i};
+    }
+    qsort(keys, doommap->num_lines, sizeof(struct OrderKey), compare_keys);
+    for (size_t i = 0; i < doommap->num_lines; i++) {
+        lines[i] = doommap->lines[keys[i].index];
+        lines[i].start = remap[lines[i].start];
+        lines[i].end = remap[lines[i].end];
+    }
+
+    // Sides by sector, and within one in the order of the lines they belong to
+    for (size_t i = 0; i < doommap->num_sides; i++)
+        keys[i] = (struct OrderKey){(uint64_t)doommap->sides[i].sector << 32 | UINT32_MAX, i};
+    for (size_t i = 0; i < doommap->num_lines; i++) {
+        if (lines[i].front != NO_SIDEDEF)
+            keys[lines[i].front].key = (keys[lines[i].front].key & ~(uint64_t)UINT32_MAX) | (i * 2);
+        if (lines[i].back != NO_SIDEDEF)
+            keys[lines[i].back].key = (keys[lines[i].back].key & ~(uint64_t)UINT32_MAX) | (i * 2 + 1);
+    }
+    qsort(keys, doommap->num_sides, sizeof(struct OrderKey), compare_keys);
+    for (size_t i = 0; i < doommap->num_sides; i++) {
+        side_order[i] = keys[i].index;
+        remap[keys[i].index] = (uint16_t)i;
+    }
+    for (size_t i = 0; i < doommap->num_lines; i++) {
+        if (lines[i].front != NO_SIDEDEF)
+            lines[i].front = remap[lines[i].front];
+        if (lines[i].back != NO_SIDEDEF)
+            lines[i].back = remap[lines[i].back];
+    }
+
+    stats_free(keys);
+    stats_free(remap);
+    return true;
+}
+
+uint64_t morton_key(int x, int y) {
+    // Interleaves the bits of both coordinates, offset so that negative ones sort first
+    uint64_t key = 0;
+    uint32_t ux = (uint32_t)(x + 32768) & 0xFFFF, uy = (uint32_t)(y + 32768) & 0xFFFF;
+    for (int i = 0; i < 16; i++)
+        key |= (uint64_t)((ux >> i) & 1) << (i * 2) | (uint64_t)((uy >> i) & 1) << (i * 2 + 1);
+    return key;
+}
+
+int compare_keys(const void* a, const void* b) {
+    // Ties keep their scan order, so the output doesn't depend on the qsort implementation
+    const struct OrderKey *ka = a, *kb = b;
+    if (ka->key != kb->key)
+        return ka->key < kb->key ? -1 : 1;
+    return ka->index < kb->index ? -1 : ka->index > kb->index;
+}
+
+void free_lumps(struct MapLumps* lumps) {
+    if (lumps->buffer != NULL)
+        stats_free(lumps->buffer);
+    if (lumps->entry.data != NULL)
+        stats_free(lumps->entry.data);
+    memset(lumps, 0, sizeof(struct MapLumps));
+}
+
+void pack_side(uint8_t* record, const struct Config* config, const struct DoomSide* side) {
+    int16_t offsets[2] = {s16le(side->x_offset), s16le(side->y_offset)};
+    uint16_t sector = u16le(side->sector);
+    memcpy(record, offsets, 4);
+    for (int i = 0; i < 3; i++)
+        memcpy(record + 4 + i * LUMP_NAME_MAX, config->lumps[side->textures[i]], LUMP_NAME_MAX);
+    memcpy(record + 28, &sector, 2);
+}
+
+void pack_sector(uint8_t* record, const struct Config* config, const struct DoomSector* sector) {
+    int16_t heights[2] = {s16le(sector->floor), s16le(sector->ceiling)};
+    uint16_t fields[3] = {u16le(sector->brightness), u16le(sector->special), u16le(sector->tag)};
+    memcpy(record, heights, 4);
+    memcpy(record + 4, config->lumps[sector->flats[FLAT_FLOOR]], LUMP_NAME_MAX);
+    memcpy(record + 12, config->lumps[sector->flats[FLAT_CEILING]], LUMP_NAME_MAX);
+    memcpy(record + 20, fields, 6);
+}
+
+void pack_lump(uint8_t* record, const struct WadLump* lump) {
+    pack_u32le(record, lump->filepos);
+    pack_u32le(record + 4, lump->size);
+    memcpy(record + 8, lump->name, LUMP_NAME_MAX);
+}
+
+void pack_u32le(uint8_t* record, uint32_t uint32) {
+    uint32 = u32le(uint32);
+    memcpy(record, &uint32, sizeof(uint32));
+}
+
+void write_lump(FILE* stream, uint32_t filepos, uint32_t size, const char* name) {
+    char padded[LUMP_NAME_MAX] = {0};
+    strncpy(padded, name, LUMP_NAME_MAX);
+
+    write_u32le(stream, filepos);
+    write_u32le(stream, size);
+    write_string(stream, padded, LUMP_NAME_MAX);
+}
+
 void write_string(FILE* stream, const char* string, size_t size) {
     fwrite(string, size, 1, stream);
 }
@@ -903,151 +2317,336 @@ void write_u32le(FILE* stream, uint32_t uint32) {
     fwrite(&uint32, sizeof(uint32), 1, stream);
 }
 
-uint16_t add_vertex(int16_t x, int16_t y) {
-    if (doommap.vertices == NULL) {
-        doommap.num_vertices = 1;
-        doommap.vertices = malloc(sizeof(struct DoomVertex));
-        if (doommap.vertices == NULL) {
-            printf("!!! add_vertex: Out of memory\n");
-            exit(EXIT_FAILURE);
-        }
+uint32_t hash_vertex(int16_t x, int16_t y) {
+    // Coordinates are mostly multiples of 64, so fold the high bits into the low ones used as slot
+    uint32_t hash = ((uint32_t)(uint16_t)x * 0x9E3779B1u) ^ ((uint32_t)(uint16_t)y * 0x85EBCA77u);
+    return hash ^ (hash >> 16);
+}
 
-        doommap.vertices[0].x = x;
-        doommap.vertices[0].y = y;
-        return 0;
+uint32_t hash_line(uint16_t start, uint16_t end) {
+    uint32_t hash = ((uint32_t)start * 0x9E3779B1u) ^ ((uint32_t)end * 0x85EBCA77u);
+    return hash ^ (hash >> 16);
+}
+
+bool index_vertices(struct DoomMap* doommap) {
+    size_t size = 64;
+    while (size < (doommap->num_vertices + 1) * 4)
+        size *= 2;
+
+    uint32_t* index = stats_calloc(size, sizeof(uint32_t));
+    if (index == NULL) {
+        doommap->oom = true;
+        return false;
+    }
+    stats_free(doommap->vertex_index);
+    doommap->vertex_index = index;
+    doommap->vertex_index_size = size;
+    doommap->vertex_index_used = doommap->num_vertices;
+
+    // Kept data isn't indexed anymore, so it can't be kept after all
+    doommap->diverged = true;
+
+    for (size_t i = 0; i < doommap->num_vertices; i++) {
+        size_t slot = hash_vertex(doommap->vertices[i].x, doommap->vertices[i].y) & (size - 1);
+        while (index[slot] != 0)
+            slot = (slot + 1) & (size - 1);
+        index[slot] = i + 1;
     }
 
-    size_t i;
-    for (i = 0; i < doommap.num_vertices; i++)
-        if (doommap.vertices[i].x == x && doommap.vertices[i].y == y)
-            return i;
+    return true;
+}
+
+bool index_lines(struct DoomMap* doommap) {
+    size_t size = 64;
+    while (size < (doommap->num_lines + 1) * 4)
+        size *= 2;
+
+    uint32_t* index = stats_calloc(size, sizeof(uint32_t));
+    if (index == NULL) {
+        doommap->oom = true;
+        return false;
+    }
+    stats_free(doommap->line_index);
+    doommap->line_index = index;
+    doommap->line_index_size = size;
+    doommap->line_index_used = 0;
+    doommap->diverged = true;
+
+    for (size_t i = 0; i < doommap->num_lines; i++)
+        index_line(doommap, i);
+    return true;
+}
+
+void index_line(struct DoomMap* doommap, uint16_t line) {
+    // A full rebuild already covers the line
+    if ((doommap->line_index_used + 1) * 2 > doommap->line_index_size) {
+        index_lines(doommap);
+        return;
+    }
+
+    size_t mask = doommap->line_index_size - 1;
+    size_t slot = hash_line(doommap->lines[line].start, doommap->lines[line].end) & mask;
+    while (doommap->line_index[slot] != 0)
+        slot = (slot + 1) & mask;
+    doommap->line_index[slot] = line + 1;
+    ++doommap->line_index_used;
+}
+
+uint16_t add_vertex(struct DoomMap* doommap, int16_t x, int16_t y) {
+    if ((doommap->vertex_index_used + 1) * 2 > doommap->vertex_index_size && !index_vertices(doommap))
+        return 0;
 
-    doommap.vertices = realloc(doommap.vertices, ++doommap.num_vertices * sizeof(struct DoomVertex));
-    if (doommap.vertices == NULL) {
-        printf("!!! add_vertex: Out of memory\n");
-        exit(EXIT_FAILURE);
+    // Entries of vertices that map_update dropped are left behind, so check what they point to
+    size_t mask = doommap->vertex_index_size - 1, probes = 0;
+    size_t slot = hash_vertex(x, y) & mask;
+    for (; doommap->vertex_index[slot] != 0; slot = (slot + 1) & mask) {
+        size_t i = doommap->vertex_index[slot] - 1;
+        ++probes;
+        if (i < doommap->num_vertices && doommap->vertices[i].x == x && doommap->vertices[i].y == y) {
+            stats_lookup(LOOKUP_VERTEX, probes);
+            return i;
+        }
+    }
+    stats_lookup(LOOKUP_VERTEX, probes);
+
+    size_t i = doommap->num_vertices;
+    if (i >= doommap->max_vertices) {
+        size_t max_vertices = doommap->max_vertices ? doommap->max_vertices * 2 : 256;
+        struct DoomVertex* vertices = stats_realloc(doommap->vertices, max_vertices * sizeof(struct DoomVertex));
+        if (vertices == NULL) {
+            doommap->oom = true;
+            return 0;
+        }
+        doommap->vertices = vertices;
+        doommap->max_vertices = max_vertices;
     }
 
-    doommap.vertices[i].x = x;
-    doommap.vertices[i].y = y;
+    if (doommap->keeping && (i >= doommap->kept.vertices || doommap->vertices[i].x != x || doommap->vertices[i].y != y))
+        doommap->diverged = true;
+    doommap->num_vertices = i + 1;
+    doommap->vertices[i].x = x;
+    doommap->vertices[i].y = y;
+    doommap->vertex_index[slot] = i + 1;
+    ++doommap->vertex_index_used;
     return i;
 }
 
 uint16_t add_side(
-    const char* upper, const char* middle, const char* lower, uint16_t sector, int16_t x_offset, int16_t y_offset
+    struct DoomMap* doommap, uint16_t upper, uint16_t middle, uint16_t lower, uint16_t sector, int16_t x_offset,
+    int16_t y_offset
 ) {
-    size_t i = doommap.num_sides++;
-    doommap.sides = (doommap.sides == NULL) ? calloc(doommap.num_sides, sizeof(struct DoomSide))
-                                            : realloc(doommap.sides, doommap.num_sides * sizeof(struct DoomSide));
-    if (doommap.sides == NULL) {
-        printf("!!! add_side: Out of memory\n");
-        exit(EXIT_FAILURE);
-    }
-
-    strncpy(doommap.sides[i].textures[SIDE_UPPER], upper, LUMP_NAME_MAX);
-    strncpy(doommap.sides[i].textures[SIDE_MIDDLE], middle, LUMP_NAME_MAX);
-    strncpy(doommap.sides[i].textures[SIDE_LOWER], lower, LUMP_NAME_MAX);
-    doommap.sides[i].x_offset = x_offset;
-    doommap.sides[i].y_offset = y_offset;
-    doommap.sides[i].sector = sector;
+    size_t i = doommap->num_sides;
+    if (i >= doommap->max_sides) {
+        size_t max_sides = doommap->max_sides ? doommap->max_sides * 2 : 256;
+        struct DoomSide* sides = stats_realloc(doommap->sides, max_sides * sizeof(struct DoomSide));
+        if (sides == NULL) {
+            doommap->oom = true;
+            return 0;
+        }
+        doommap->sides = sides;
+        doommap->max_sides = max_sides;
+    }
+
+    doommap->num_sides = i + 1;
+    doommap->sides[i].textures[SIDE_UPPER] = upper;
+    doommap->sides[i].textures[SIDE_MIDDLE] = middle;
+    doommap->sides[i].textures[SIDE_LOWER] = lower;
+    doommap->sides[i].x_offset = x_offset;
+    doommap->sides[i].y_offset = y_offset;
+    doommap->sides[i].sector = sector;
     return i;
 }
 
 uint16_t add_line(
-    uint16_t start, uint16_t end, const char* upper, const char* middle, const char* lower, const char* back_upper,
-    const char* back_middle, const char* back_lower, uint16_t sector, uint16_t back_sector, uint16_t flags,
-    uint16_t special, uint16_t tag, int16_t x_offset, int16_t y_offset
+    struct DoomMap* doommap, uint16_t start, uint16_t end, uint16_t upper, uint16_t middle, uint16_t lower,
+    uint16_t back_upper, uint16_t back_middle, uint16_t back_lower, uint16_t sector, uint16_t back_sector,
+    uint16_t flags, uint16_t special, uint16_t tag, int16_t x_offset, int16_t y_offset
 ) {
-    if (doommap.lines == NULL) {
-        doommap.num_lines = 1;
-        doommap.lines = malloc(sizeof(struct DoomLine));
-        if (doommap.lines == NULL) {
-            printf("!!! add_line: Out of memory\n");
-            exit(EXIT_FAILURE);
-        }
-
-        doommap.lines[0].start = start;
-        doommap.lines[0].end = end;
-        doommap.lines[0].flags = flags;
-        doommap.lines[0].special = special;
-        doommap.lines[0].tag = tag;
-        doommap.lines[0].front = add_side(upper, middle, lower, sector, x_offset, y_offset);
-        doommap.lines[0].back = add_side(back_upper, back_middle, back_lower, back_sector, x_offset, y_offset);
+    if ((doommap->line_index_used + 1) * 2 > doommap->line_index_size && !index_lines(doommap))
         return 0;
-    }
-
-    size_t i;
-    for (i = 0; i < doommap.num_lines; i++)
-        if ((doommap.lines[i].start == start && doommap.lines[i].end == end) ||
-            (doommap.lines[i].start == end && doommap.lines[i].end == start && doommap.lines[i].flags == LF_TWO_SIDED))
-            return i;
 
-    doommap.lines = realloc(doommap.lines, ++doommap.num_lines * sizeof(struct DoomLine));
-    if (doommap.lines == NULL) {
-        printf("!!! add_line: Out of memory\n");
-        exit(EXIT_FAILURE);
+    // Same as taking the first match in order, extended lines are indexed under each key they had
+    size_t mask = doommap->line_index_size - 1, probes = 0, found = doommap->num_lines;
+    for (int key = 0; key < 2; key++)
+        for (size_t slot = (key ? hash_line(end, start) : hash_line(start, end)) & mask;
+             doommap->line_index[slot] != 0; slot = (slot + 1) & mask) {
+            size_t i = doommap->line_index[slot] - 1;
+            ++probes;
+            if (i < found && ((doommap->lines[i].start == start && doommap->lines[i].end == end) ||
+                              (doommap->lines[i].start == end && doommap->lines[i].end == start &&
+                               doommap->lines[i].flags == LF_TWO_SIDED)))
+                found = i;
+        }
+    stats_lookup(LOOKUP_LINE, probes);
+    if (found < doommap->num_lines)
+        return found;
+
+    size_t i = doommap->num_lines;
+    if (i >= doommap->max_lines) {
+        size_t max_lines = doommap->max_lines ? doommap->max_lines * 2 : 256;
+        struct DoomLine* lines = stats_realloc(doommap->lines, max_lines * sizeof(struct DoomLine));
+        if (lines == NULL) {
+            doommap->oom = true;
+            return 0;
+        }
+        doommap->lines = lines;
+        doommap->max_lines = max_lines;
     }
 
-    doommap.lines[i].start = start;
-    doommap.lines[i].end = end;
-    doommap.lines[i].flags = flags;
-    doommap.lines[i].special = special;
-    doommap.lines[i].tag = tag;
-    doommap.lines[i].front = add_side(upper, middle, lower, sector, x_offset, y_offset);
-    doommap.lines[i].back = add_side(back_upper, back_middle, back_lower, back_sector, x_offset, y_offset);
+    // Later columns only look lines up by their vertices
+    const struct DoomLine* old = &doommap->lines[i];
+    if (doommap->keeping &&
+        (i >= doommap->kept.lines || old->start != start || old->end != end || old->flags != flags))
+        doommap->diverged = true;
+    doommap->num_lines = i + 1;
+    doommap->lines[i].start = start;
+    doommap->lines[i].end = end;
+    doommap->lines[i].flags = flags;
+    doommap->lines[i].special = special;
+    doommap->lines[i].tag = tag;
+    doommap->lines[i].front = add_side(doommap, upper, middle, lower, sector, x_offset, y_offset);
+    doommap->lines[i].back = add_side(doommap, back_upper, back_middle, back_lower, back_sector, x_offset, y_offset);
+    index_line(doommap, i);
     return i;
 }
 
-uint16_t add_sector(struct AreaInfo* area) {
+uint16_t add_sector(struct DoomMap* doommap, const struct AreaInfo* area) {
     return add_custom_sector(
-        area->id, 0, 64, area->flats[FLAT_FLOOR], area->flats[FLAT_CEILING], area->brightness, ST_NORMAL, 0
+        doommap, area->id, 0, 64, area->flats[FLAT_FLOOR], area->flats[FLAT_CEILING], area->brightness, ST_NORMAL, 0
     );
 }
 
 uint16_t add_custom_sector(
-    uint16_t id, int16_t floorz, int16_t ceilingz, const char* floor, const char* ceiling, uint16_t brightness,
-    uint16_t special, uint16_t tag
+    struct DoomMap* doommap, uint16_t id, int16_t floorz, int16_t ceilingz, uint16_t floor, uint16_t ceiling,
+    uint16_t brightness, uint16_t special, uint16_t tag
 ) {
-    if (doommap.sectors == NULL) {
-        doommap.num_sectors = 1;
-        doommap.sectors = malloc(sizeof(struct DoomSector));
-        doommap.sectormap = malloc(sizeof(uint16_t));
-        if (doommap.sectors == NULL || doommap.sectormap == NULL) {
-            printf("!!! add_custom_sector: Out of memory\n");
-            exit(EXIT_FAILURE);
-        }
-
-        doommap.sectormap[0] = id;
-        doommap.sectors[0].floor = floorz;
-        doommap.sectors[0].ceiling = ceilingz;
-        strncpy(doommap.sectors[0].flats[FLAT_FLOOR], floor, LUMP_NAME_MAX);
-        strncpy(doommap.sectors[0].flats[FLAT_CEILING], ceiling, LUMP_NAME_MAX);
-        doommap.sectors[0].brightness = brightness;
-        doommap.sectors[0].special = special;
-        doommap.sectors[0].tag = tag;
+    if (doommap->sector_index == NULL &&
+        (doommap->sector_index = stats_calloc(UINT16_MAX + 1, sizeof(uint16_t))) == NULL) {
+        doommap->oom = true;
+        return 0;
+    }
+    // Entries of sectors that map_update dropped are left behind, so check what they point to
+    stats_lookup(LOOKUP_SECTOR, 1);
+    size_t i = doommap->sector_index[id];
+    if (i > 0 && i <= doommap->num_sectors && doommap->sectormap[i - 1] == id)
+        return i - 1;
+
+    i = doommap->num_sectors;
+    if (i >= UINT16_MAX) {
+        doommap->oom = true;
         return 0;
     }
 
-    size_t i;
-    for (i = 0; i < doommap.num_sectors; i++)
-        if (doommap.sectormap[i] == id)
-            return i;
+    if (i >= doommap->max_sectors) {
+        size_t max_sectors = doommap->max_sectors ? doommap->max_sectors * 2 : 64;
+        struct DoomSector* sectors = stats_realloc(doommap->sectors, max_sectors * sizeof(struct DoomSector));
+        if (sectors == NULL) {
+            doommap->oom = true;
+            return 0;
+        }
+        doommap->sectors = sectors;
+
+        uint16_t* sectormap = stats_realloc(doommap->sectormap, max_sectors * sizeof(uint16_t));
+        if (sectormap == NULL) {
+            doommap->oom = true;
+            return 0;
+        }
+        doommap->sectormap = sectormap;
+        doommap->max_sectors = max_sectors;
+    }
 
-    ++doommap.num_sectors;
-    doommap.sectors = realloc(doommap.sectors, doommap.num_sectors * sizeof(struct DoomSector));
-    doommap.sectormap = realloc(doommap.sectormap, doommap.num_sectors * sizeof(uint16_t));
-    if (doommap.sectors == NULL || doommap.sectormap == NULL) {
-        printf("!!! add_custom_sector: Out of memory\n");
-        exit(EXIT_FAILURE);
-    }
-
-    doommap.sectormap[i] = id;
-    doommap.sectors[i].floor = floorz;
-    doommap.sectors[i].ceiling = ceilingz;
-    strncpy(doommap.sectors[i].flats[FLAT_FLOOR], floor, LUMP_NAME_MAX);
-    strncpy(doommap.sectors[i].flats[FLAT_CEILING], ceiling, LUMP_NAME_MAX);
-    doommap.sectors[i].brightness = brightness;
-    doommap.sectors[i].special = special;
-    doommap.sectors[i].tag = tag;
+    // Later columns only look sectors up by their ID
+    if (doommap->keeping && (i >= doommap->kept.sectors || doommap->sectormap[i] != id))
+        doommap->diverged = true;
+    doommap->num_sectors = i + 1;
+    doommap->sectormap[i] = id;
+    doommap->sector_index[id] = i + 1;
+    doommap->sectors[i].floor = floorz;
+    doommap->sectors[i].ceiling = ceilingz;
+    doommap->sectors[i].flats[FLAT_FLOOR] = floor;
+    doommap->sectors[i].flats[FLAT_CEILING] = ceiling;
+    doommap->sectors[i].brightness = brightness;
+    doommap->sectors[i].special = special;
+    doommap->sectors[i].tag = tag;
     return i;
 }
+
+uint16_t add_track_sector(struct DoomMap* doommap, const struct Config* config, uint16_t area) {
+    // Tracks are all alike, but only doors into the same sector can share them without carrying sound elsewhere
+    bool pooled = config->track_mode == TRACKS_AREA && area != NO_SECTOR;
+    if (pooled)
+        for (size_t i = 0; i < doommap->num_track_sectors; i++)
+            if (doommap->track_sectors[i].area == area)
+                return doommap->track_sectors[i].sector;
+
+    if (doommap->num_track_sectors >= doommap->max_track_sectors) {
+        size_t max_track_sectors = doommap->max_track_sectors ? doommap->max_track_sectors * 2 : 16;
+        struct TrackSector* track_sectors =
+            stats_realloc(doommap->track_sectors, max_track_sectors * sizeof(struct TrackSector));
+        if (track_sectors == NULL) {
+            doommap->oom = true;
+            return 0;
+        }
+        doommap->track_sectors = track_sectors;
+        doommap->max_track_sectors = max_track_sectors;
+    }
+
+    size_t i = doommap->num_track_sectors++;
+    struct TrackSector track = {pooled ? area : NO_SECTOR, add_track(doommap, config)};
+    if (doommap->keeping && (i >= doommap->kept.tracks || doommap->track_sectors[i].area != track.area ||
+                             doommap->track_sectors[i].sector != track.sector))
+        doommap->diverged = true;
+    doommap->track_sectors[i] = track;
+    return track.sector;
+}
+
+uint16_t add_track(struct DoomMap* doommap, const struct Config* config) {
+    return add_custom_sector(
+        doommap, doommap->last_asector--, 0, 64, config->flats[FLAT_FLOOR], config->flats[FLAT_CEILING],
+        config->brightness, ST_NORMAL, 0
+    );
+}
+
+void set_line_vertex(struct DoomMap* doommap, uint16_t line, bool end, uint16_t vertex) {
+    // Journal the old vertices so map_update can rewind lines extended by a later column
+    if (doommap->num_edits >= doommap->max_edits) {
+        size_t max_edits = doommap->max_edits ? doommap->max_edits * 2 : 64;
+        struct LineEdit* edits = stats_realloc(doommap->edits, max_edits * sizeof(struct LineEdit));
+        if (edits == NULL) {
+            doommap->oom = true;
+            return;
+        }
+
+        doommap->edits = edits;
+        doommap->max_edits = max_edits;
+    }
+
+    struct LineEdit edit = {line, doommap->lines[line].start, doommap->lines[line].end, vertex, end};
+    const struct LineEdit* old = &doommap->edits[doommap->num_edits];
+    if (doommap->keeping &&
+        (doommap->num_edits >= doommap->kept.edits || old->line != line || old->start != edit.start ||
+         old->end != edit.end || old->vertex != vertex || old->at_end != end))
+        doommap->diverged = true;
+    doommap->edits[doommap->num_edits++] = edit;
+    if (end)
+        doommap->lines[line].end = vertex;
+    else
+        doommap->lines[line].start = vertex;
+    index_line(doommap, line);
+}
+
+void set_cell_line(struct DoomMap* doommap, struct LineCell* cell, enum LineFields field, int16_t line) {
+    int16_t* slot = cell_line(cell, field);
+    if (doommap->keeping && *slot != line)
+        doommap->diverged = true;
+    *slot = line;
+}
+
+void checkpoint_lines(struct DoomMap* doommap, int16_t x) {
+    struct MapCheckpoint* checkpoint = &doommap->checkpoints[x];
+    checkpoint->lines = doommap->num_lines;
+    checkpoint->sides = doommap->num_sides;
+    checkpoint->vertices = doommap->num_vertices;
+    checkpoint->tracks = doommap->num_track_sectors;
+    checkpoint->edits = doommap->num_edits;
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <threads.h>
+
+#include "error.h"
+
 #ifdef __BIG_ENDIAN__
 #define u16le(x) ((x >> 8) | (x << 8))
 #define u32le(x) ((x >> 24) | ((x >> 8) & 0xFF00) | ((x >> 8) & 0xFF0000) | (x << 24))
@@ -13,23 +17,61 @@
 #endif
 
 #define MAX_LEVELS 100
+#define MAP_LUMPS 11
 #define MAX_PLANES 3
 #define LEVEL_NAME_MAX 16
+#define PK3_NAME_MAX 32
 
 #define CARMACK_NEAR 0xA7
 #define CARMACK_FAR 0xA8
 
+// How map_read found a plane stored, MAPTEMP files from editors skip Carmack and raw dumps skip both
+#define ENCODING_CARMACK 0
+#define ENCODING_RLEW 1
+#define ENCODING_RAW 2
+
 #define PLANE_WALLS 0
 #define PLANE_OBJECTS 1
 #define PLANE_MISC 2
+#define PLANES_ALL 0x7
+#define PLANES_CONVERT ((1 << PLANE_WALLS) | (1 << PLANE_OBJECTS))
 
 #define SIDE_UPPER 0
 #define SIDE_LOWER 1
 #define SIDE_MIDDLE 2
 
+#define LUMP_THINGS 1
+#define LUMP_LINEDEFS 2
+#define LUMP_SIDEDEFS 3
+#define LUMP_VERTEXES 4
+#define LUMP_SECTORS 8
+
+#define SIDEDEF_SIZE 30
+#define SECTOR_SIZE 26
+#define PIPELINE_DEPTH 2
+#define MAP_WINDOW 4
+
+// Maps with more tiles than this are converted a few columns at a time if the config asks for it, see map_banded. That
+// only bounds the cells, the planes and what comes out of them still cover the whole map
+#ifndef MAP_BANDED_AREA
+#define MAP_BANDED_AREA (128 * 128)
+#endif
+#define MAX_VARIANTS 16
+
+// Floor codes that Wolf3D numbers its areas with, plain floors need no config entry
+#define AREA_TILE_FIRST 107
+#define AREA_TILE_LAST 143
+
+// Vanilla Doom reads line, side, vertex and sector indices as signed
+#define VANILLA_MAX_INDEX 32767
+
 #define NO_SIDEDEF 0xFFFF
 #define NO_SECTOR 0xFFFF
 
+// Door track sectors that a band of the third pass refers to before they exist
+#define SECTOR_LTRACK 0xFFFE
+#define SECTOR_RTRACK 0xFFFD
+
 #define LF_BLOCKING 0x0001
 #define LF_TWO_SIDED 0x0004
 #define LF_UNPEG_LOW 0x0010
@@ -63,11 +105,16 @@
 struct WolfMap {
     uint8_t id;
     char name[LEVEL_NAME_MAX];
-    uint16_t width, height;
+    uint16_t width, height, magic;
 
     int32_t offsets[MAX_PLANES];
     uint16_t sizes[MAX_PLANES];
     uint16_t* planes[MAX_PLANES];
+
+    // Planes as stored from map_read until map_decode expands them, and their hash
+    uint8_t* carmack[MAX_PLANES];
+    uint8_t encodings[MAX_PLANES];
+    uint64_t hash;
 };
 
 struct DoomThing {
@@ -84,9 +131,10 @@ struct DoomLine {
     uint16_t front, back;
 };
 
+// Textures and flats are IDs into the config's lump names, only written out as names by wad_add_map
 struct DoomSide {
     int16_t x_offset, y_offset;
-    char textures[3][LUMP_NAME_MAX];
+    uint16_t textures[3];
     uint16_t sector;
 };
 
@@ -96,7 +144,7 @@ struct DoomVertex {
 
 struct DoomSector {
     int16_t floor, ceiling;
-    char flats[2][LUMP_NAME_MAX];
+    uint16_t flats[2];
     uint16_t brightness;
     uint16_t special, tag;
 };
@@ -114,41 +162,343 @@ struct LineCell {
     int16_t right, top, left, bottom;
 };
 
+// Output counts before each column of a pass, so that map_update can resume from there
+struct MapCheckpoint {
+    size_t things;
+    size_t sectors;
+    uint16_t last_asector;
+    size_t lines, sides, vertices, tracks, edits;
+};
+
+// A line that got extended by a later cell, with its vertices from before and the one it got
+struct LineEdit {
+    uint16_t line;
+    uint16_t start, end;
+    uint16_t vertex;
+    bool at_end;
+};
+
+// Cells of the columns map_update went over again, from before it did
+struct ColumnSnapshot {
+    struct LineCell* cells;
+    int16_t from, to;
+    size_t max_columns;
+};
+
+// Door track sector, by the sector its doors open into if pooled or NO_SECTOR
+struct TrackSector {
+    uint16_t area, sector;
+};
+
+// Per-row bitsets of the whole map for the second pass, one bit per tile
+enum TileBits {
+    TILE_INSIDE, // Unset for the padding past the width
+    TILE_WALL,
+    TILE_MIDTEX,
+    TILE_AREA,        // Neither wall nor door
+    TILE_FLOOR,       // Has a sector
+    TILE_OPEN,        // A solid wall facing it gets a linedef
+    TILE_OPEN_MIDTEX, // A midtex wall facing it gets a linedef
+    NUM_TILE_BITS,
+};
+
+enum LineOps {
+    OP_LINE,
+    OP_EXTEND,
+    OP_TRACKS,
+};
+
+enum LineFields {
+    LINE_NONE,
+    LINE_RIGHT,
+    LINE_TOP,
+    LINE_LEFT,
+    LINE_BOTTOM,
+};
+
+// What a cell of the third pass adds, planned per column and applied in column order by stitch_lines
+struct LineOp {
+    enum LineOps type;
+    enum LineFields field;
+    bool end;
+    int16_t x, y;
+
+    struct DoomVertex vertices[2];
+    uint16_t textures[6];
+    uint16_t sector, back_sector;
+    uint16_t flags, special, tag;
+    int16_t x_offset, y_offset;
+};
+
+struct LineBand {
+    struct LineOp* ops;
+    size_t num_ops, max_ops;
+    bool oom;
+};
+
+// Where stitch_ops left off, carried from one band to the next
+struct LineStitch {
+    int16_t x;
+    uint16_t ltrack_sector, rtrack_sector;
+};
+
+// Columns of a pass split into bands for the thread pool
+struct MapBands {
+    struct DoomMap* doommap;
+    const struct WolfMap* wolfmap;
+    const struct Config* config;
+    int16_t from;
+    size_t num_bands;
+
+    // Columns whose lines are planned again, all of them if NULL
+    const bool* replan;
+};
+
+// Directory entry of a WAD that is being written or updated
+struct WadLump {
+    uint32_t filepos, size;
+    char name[LUMP_NAME_MAX];
+};
+
+// A map as its own WAD inside a PK3, see pk3_compress
+struct Pk3Entry {
+    char name[PK3_NAME_MAX];
+    uint8_t* data;
+    uint16_t method;
+    uint32_t crc, size, compressed_size, offset;
+};
+
 struct DoomMap {
+    char name[LUMP_NAME_MAX];
+    uint16_t width, height;
+
     struct DoomThing* things;
     struct DoomLine* lines;
     struct DoomSide* sides;
     struct DoomVertex* vertices;
     struct DoomSector* sectors;
 
+    // Only the last MAP_WINDOW columns if banded, see map_cell
     struct LineCell* linemap;
+    bool banded;
     uint16_t* sectormap;
     uint16_t last_asector;
 
+    // Sector index + 1 of every sector ID (0 if it has none yet), see add_custom_sector
+    uint16_t* sector_index;
+
     size_t num_things, num_lines, num_sides, num_vertices, num_sectors;
+    size_t max_lines, max_sides, max_vertices, max_sectors;
+
+    uint64_t* tiles;
+    size_t tile_words;
+
+    // Hash tables of vertex and line indices + 1 (0 is empty), see add_vertex and add_line
+    uint32_t *vertex_index, *line_index;
+    size_t vertex_index_size, vertex_index_used, line_index_size, line_index_used;
+
+    // Set when an add_* function runs out of memory
+    bool oom;
+
+    // Source of the last conversion, see map_update
+    const struct Config* config;
+    uint64_t config_hash;
+    uint16_t* planes[MAX_PLANES];
+    struct MapCheckpoint* checkpoints;
+    struct LineBand* plans;
+    struct LineEdit* edits;
+    size_t num_edits, max_edits;
+
+    // Counts from before map_update, whose data past the current ones is still there. While keeping, the add_*
+    // functions note when anything later columns look up comes out different, see update_sectors and stitch_lines
+    struct MapCheckpoint kept;
+    bool keeping, diverged;
+
+    // Every door track sector in the order they were added, see add_track_sector
+    struct TrackSector* track_sectors;
+    size_t num_track_sectors, max_track_sectors;
 };
 
-void map_init(const char*, const char*, int);
-void map_teardown();
+// Output WAD that maps are added to one at a time, the directory is only written once all of them are in
+struct WadWriter {
+    const char* name;
+    FILE* stream;
+    bool update;
+
+    // Instead of the stream, see wad_open_buffer
+    uint8_t* buffer;
+    size_t max_size;
+
+    // Zip entries instead of a WAD directory, see pk3_add_entry
+    bool pk3;
+    struct Pk3Entry* entries;
+    size_t num_entries;
+
+    struct WadLump* directory;
+    size_t num_lumps;
+    uint32_t infotableofs, end, append;
+
+    // Whether an update wrote anything or changed the directory, see wad_close
+    bool changed;
+};
 
+// Sort key of a vertex, line or side for order_map
+struct OrderKey {
+    uint64_t key;
+    size_t index;
+};
+
+// Lumps of one converted map as they are written, either packed from a DoomMap or read back from the cache
+struct MapLumps {
+    uint64_t key;
+    bool cached;
+    char name[LUMP_NAME_MAX];
+    const void* data[MAP_LUMPS];
+    uint32_t sizes[MAP_LUMPS];
+    uint8_t* buffer;
+    struct Pk3Entry entry;
+};
+
+// One config's output of a map_convert_variants, all of them are converted from the same decoded levels
+struct MapVariant {
+    const struct Config* config;
+    struct WadWriter writer;
+
+    struct DoomMap doommaps[PIPELINE_DEPTH];
+    struct MapLumps cached[PIPELINE_DEPTH], lumps[PIPELINE_DEPTH];
+};
+
+// Levels on their way through map_convert, no stage gets more than PIPELINE_DEPTH levels ahead of the next
+struct MapPipeline {
+    const char *maphead_name, *gamemaps_name;
+    const int* levels;
+    size_t num_levels;
+    struct DoomMap* maps;
+    bool dry_run;
+    const char* cache_dir;
+
+    mtx_t lock;
+    cnd_t changed;
+    size_t decoded, converted, written;
+    bool failed, flagged;
+    char error[ERROR_MAX];
+
+    struct WolfMap wolfmaps[PIPELINE_DEPTH];
+    struct MapVariant variants[MAX_VARIANTS];
+    size_t num_variants, level;
+};
+
+bool map_init(struct WolfMap*, const char*, const char*, int, unsigned);
+bool map_load(struct WolfMap*, const char*, const char*, int, unsigned);
+bool map_read(struct WolfMap*, const uint8_t*, size_t, const uint8_t*, size_t, int, unsigned);
+bool map_decode(struct WolfMap*);
+void map_teardown(struct WolfMap*, struct DoomMap*);
+
+struct LineCell* map_cell(const struct DoomMap*, int, int);
 uint16_t read_u16le(const uint8_t*);
-void read_carmack(FILE*, size_t, size_t, uint8_t*);
+uint8_t plane_encoding(const uint8_t*, size_t, size_t);
+bool carmack_literal(const uint8_t*, size_t, uint16_t);
+void read_carmack(const uint8_t*, uint8_t*);
 void read_rlew(uint8_t*, uint8_t*, uint16_t);
 
-void map_to_wad(const char*);
-bool place_free(struct LineCell*, int, int);
-bool floor_free(struct LineCell*, int, int);
+bool map_to_wad(struct DoomMap*, const struct WolfMap*, const struct Config*);
+bool map_banded(struct DoomMap*, const struct WolfMap*, const struct Config*);
+bool band_sectors(struct DoomMap*, const struct WolfMap*, const struct Config*, int16_t);
+bool map_things(struct DoomMap*, const struct WolfMap*, const struct Config*, int16_t, int16_t);
+bool map_sectors(struct DoomMap*, const struct WolfMap*, const struct Config*, int16_t);
+bool sectors_column(struct DoomMap*, const struct WolfMap*, const struct Config*, int16_t);
+bool map_space(struct DoomMap*, int16_t);
+bool map_lines(struct DoomMap*, const struct Config*, int16_t, const bool*);
+void sectors_band(void*, size_t);
+void lookup_cell(struct DoomMap*, const struct WolfMap*, const struct Config*, int16_t, int16_t);
+void tiles_band(void*, size_t);
+void space_band(void*, size_t);
+uint32_t cell_tiles(const struct LineCell*);
+void space_cell(struct DoomMap*, int16_t, int16_t);
+void lines_band(void*, size_t);
+void plan_column(struct LineBand*, const struct DoomMap*, int16_t);
+void band_range(const struct MapBands*, size_t, int16_t*, int16_t*);
+void row_range(const struct MapBands*, size_t, int16_t*, int16_t*);
+uint64_t tile_word(const struct DoomMap*, enum TileBits, int, size_t, int);
+bool stitch_lines(struct DoomMap*, const struct Config*, int16_t, int16_t);
+bool lines_settled(const struct DoomMap*, int16_t);
+void keep_lines(struct DoomMap*);
+bool stitch_ops(struct DoomMap*, const struct Config*, const struct LineBand*, struct LineStitch*);
+bool map_update(struct DoomMap*, const struct WolfMap*, const struct Config*);
+bool map_keep(struct DoomMap*, const struct WolfMap*, const struct Config*, int16_t, int16_t);
+bool update_things(struct DoomMap*, const struct WolfMap*, const struct Config*, int16_t, int16_t);
+bool update_sectors(struct DoomMap*, const struct WolfMap*, const struct Config*, int16_t, struct ColumnSnapshot*);
+bool snapshot_column(const struct DoomMap*, struct ColumnSnapshot*);
+bool column_changed(const struct DoomMap*, const struct ColumnSnapshot*, int16_t);
+bool map_audit(const struct DoomMap*, const struct Config*);
 
+bool map_convert(
+    const struct Config*, const char*, const char*, const int*, size_t, const char*, bool, const char*, struct DoomMap*
+);
+
+bool map_convert_variants(
+    const struct Config* const*, const char* const*, size_t, const char*, const char*, const int*, size_t, bool,
+    const char*, struct DoomMap*
+);
+struct DoomMap* pipeline_map(struct MapPipeline*, struct MapVariant*, size_t);
+bool pipeline_wait(struct MapPipeline*, const size_t*, size_t);
+void pipeline_advance(struct MapPipeline*, size_t*);
+void pipeline_fail(struct MapPipeline*);
+int pipeline_decode(void*);
+void pipeline_convert(void*, size_t);
+int pipeline_write(void*);
+
+bool wad_open(struct WadWriter*, const char*, size_t, bool);
+bool wad_open_buffer(struct WadWriter*, size_t);
+bool wad_add_map(struct WadWriter*, const struct MapLumps*);
+bool wad_write(struct WadWriter*, const void*, size_t);
+bool wad_close(struct WadWriter*, bool);
+bool read_wad_directory(FILE*, struct WadLump**, size_t*, uint32_t*, size_t);
+bool update_wad_map(FILE*, const struct MapLumps*, struct WadLump*, size_t*, uint32_t*, bool*);
+bool update_wad_lump(FILE*, const struct WadLump*, size_t, size_t, struct WadLump*, const void*, uint32_t*, size_t*);
+bool is_map_lump(const char*);
+bool pack_map(struct MapLumps*, const struct Config*, const struct DoomMap*);
+bool order_map(const struct DoomMap*, struct DoomLine*, struct DoomVertex*, size_t*);
+uint64_t morton_key(int, int);
+int compare_keys(const void*, const void*);
+void free_lumps(struct MapLumps*);
+void pack_side(uint8_t*, const struct Config*, const struct DoomSide*);
+void pack_sector(uint8_t*, const struct Config*, const struct DoomSector*);
+void pack_lump(uint8_t*, const struct WadLump*);
+void pack_u32le(uint8_t*, uint32_t);
+void write_lump(FILE*, uint32_t, uint32_t, const char*);
 void write_string(FILE*, const char*, size_t);
 void write_u16le(FILE*, uint16_t);
 void write_s16le(FILE*, int16_t);
 void write_u32le(FILE*, uint32_t);
 
-uint16_t add_vertex(int16_t, int16_t);
-uint16_t add_side(const char*, const char*, const char*, uint16_t, int16_t, int16_t);
+struct LineOp* plan_op(struct LineBand*, enum LineOps, int16_t, int16_t);
+void plan_line(
+    struct LineBand*, int16_t, int16_t, enum LineFields, int16_t, int16_t, int16_t, int16_t, uint16_t, uint16_t,
+    uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, int16_t, int16_t
+);
+void plan_extend(struct LineBand*, int16_t, int16_t, enum LineFields, bool, int16_t, int16_t);
+void plan_tracks(struct LineBand*, int16_t, int16_t, uint16_t, uint16_t);
+void plan_door(struct LineBand*, const struct DoomMap*, const struct LineCell*, int16_t, int16_t);
+int16_t* cell_line(struct LineCell*, enum LineFields);
+
+uint32_t hash_vertex(int16_t, int16_t);
+uint32_t hash_line(uint16_t, uint16_t);
+bool index_vertices(struct DoomMap*);
+bool index_lines(struct DoomMap*);
+void index_line(struct DoomMap*, uint16_t);
+uint16_t add_vertex(struct DoomMap*, int16_t, int16_t);
+uint16_t add_side(struct DoomMap*, uint16_t, uint16_t, uint16_t, uint16_t, int16_t, int16_t);
 uint16_t add_line(
-    uint16_t, uint16_t, const char*, const char*, const char*, const char*, const char*, const char*, uint16_t,
-    uint16_t, uint16_t, uint16_t, uint16_t, int16_t, int16_t
+    struct DoomMap*, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t,
+    uint16_t, uint16_t, uint16_t, int16_t, int16_t
+);
+uint16_t add_sector(struct DoomMap*, const struct AreaInfo*);
+uint16_t add_track_sector(struct DoomMap*, const struct Config*, uint16_t);
+uint16_t add_track(struct DoomMap*, const struct Config*);
+void set_line_vertex(struct DoomMap*, uint16_t, bool, uint16_t);
+void set_cell_line(struct DoomMap*, struct LineCell*, enum LineFields, int16_t);
+void checkpoint_lines(struct DoomMap*, int16_t);
+uint16_t add_custom_sector(
+    struct DoomMap*, uint16_t, int16_t, int16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t
 );
-uint16_t add_sector(struct AreaInfo*);
-uint16_t add_custom_sector(uint16_t, int16_t, int16_t, const char*, const char*, uint16_t, uint16_t, uint16_t);
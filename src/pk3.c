@@ -0,0 +1,334 @@
+#include <ctype.h>
+#include <string.h>
+#include <threads.h>
+
+#include "pk3.h"
+#include "pool.h"
+#include "stats.h"
+
+// Lumps of a map in WAD order after its marker
+static const char* lump_names[MAP_LUMPS] = {
+    NULL, "THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS", "SSECTORS", "NODES", "SECTORS", "REJECT", "BLOCKMAP",
+};
+
+static const uint16_t length_bases[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t length_bits[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t distance_bases[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const uint8_t distance_bits[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+static once_flag crc_once = ONCE_FLAG_INIT;
+static uint32_t crc_table[256];
+
+bool is_pk3_name(const char* name) {
+    size_t size = strlen(name);
+    if (size < 4 || name[size - 4] != '.')
+        return false;
+    return tolower((unsigned char)name[size - 3]) == 'p' && tolower((unsigned char)name[size - 2]) == 'k' &&
+           name[size - 1] == '3';
+}
+
+bool pk3_compress(struct MapLumps* lumps) {
+    stats_begin(PHASE_COMPRESS);
+    struct Pk3Entry* entry = &lumps->entry;
+    memset(entry, 0, sizeof(struct Pk3Entry));
+    snprintf(entry->name, PK3_NAME_MAX, "maps/%.8s.wad", lumps->name);
+
+    // Same layout as wad_open writes, the directory right after the header
+    uint32_t size = 12 + MAP_LUMPS * 16;
+    for (int i = 0; i < MAP_LUMPS; i++)
+        size += lumps->sizes[i];
+    uint8_t* wad = stats_malloc(size);
+    if (wad == NULL) {
+        stats_end();
+        return fail("pk3_compress: Out of memory");
+    }
+    memcpy(wad, "PWAD", 4);
+    pack_u32le(wad + 4, MAP_LUMPS);
+    pack_u32le(wad + 8, 12);
+    uint32_t filepos = 12 + MAP_LUMPS * 16;
+    for (int i = 0; i < MAP_LUMPS; i++) {
+        struct WadLump lump = {lumps->sizes[i] > 0 ? filepos : 0, lumps->sizes[i], {0}};
+        if (i == 0)
+            memcpy(lump.name, lumps->name, LUMP_NAME_MAX);
+        else
+            strncpy(lump.name, lump_names[i], LUMP_NAME_MAX);
+        pack_lump(wad + 12 + i * 16, &lump);
+        if (lumps->sizes[i] > 0)
+            memcpy(wad + filepos, lumps->data[i], lumps->sizes[i]);
+        filepos += lumps->sizes[i];
+    }
+
+    entry->size = size;
+    entry->crc = pk3_crc32(0, wad, size);
+    if (!pk3_deflate(entry, wad, size)) {
+        stats_free(wad);
+        stats_end();
+        return fail("pk3_compress: Out of memory");
+    }
+
+    // A map that doesn't get any smaller is stored as it is
+    if (entry->compressed_size >= size) {
+        stats_free(entry->data);
+        entry->data = wad;
+        entry->method = PK3_STORED;
+        entry->compressed_size = size;
+    } else {
+        stats_free(wad);
+    }
+    stats_end();
+    return true;
+}
+
+bool pk3_deflate(struct Pk3Entry* entry, const uint8_t* data, size_t size) {
+    struct Pk3Deflate deflate = {data, size, NULL, size > 0 ? (size + PK3_CHUNK - 1) / PK3_CHUNK : 1};
+    deflate.chunks = stats_calloc(deflate.num_chunks, sizeof(struct Pk3Chunk));
+    if (deflate.chunks == NULL)
+        return false;
+    for (size_t i = 0; i < deflate.num_chunks; i++) {
+        deflate.chunks[i].start = i * PK3_CHUNK;
+        deflate.chunks[i].size = size - i * PK3_CHUNK < PK3_CHUNK ? size - i * PK3_CHUNK : PK3_CHUNK;
+    }
+
+    // Chunks only read the data, so every one of them is compressed at once and they're joined in order
+    pool_run(pk3_deflate_chunk, &deflate, deflate.num_chunks);
+    size_t compressed_size = 0;
+    bool success = true;
+    for (size_t i = 0; i < deflate.num_chunks; i++) {
+        success = success && deflate.chunks[i].data != NULL;
+        compressed_size += deflate.chunks[i].compressed_size;
+    }
+    entry->data = success ? stats_malloc(compressed_size) : NULL;
+    entry->method = PK3_DEFLATED;
+    entry->compressed_size = compressed_size;
+    for (size_t i = 0, offset = 0; i < deflate.num_chunks; i++) {
+        if (entry->data != NULL)
+            memcpy(entry->data + offset, deflate.chunks[i].data, deflate.chunks[i].compressed_size);
+        offset += deflate.chunks[i].compressed_size;
+        stats_free(deflate.chunks[i].data);
+    }
+    stats_free(deflate.chunks);
+    return entry->data != NULL;
+}
+
+void pk3_deflate_chunk(void* ctx, size_t index) {
+    struct Pk3Deflate* deflate = ctx;
+    struct Pk3Chunk* chunk = &deflate->chunks[index];
+    const uint8_t* data = deflate->data;
+    size_t end = chunk->start + chunk->size;
+    size_t base = chunk->start > PK3_WINDOW ? chunk->start - PK3_WINDOW : 0;
+
+    // Fixed codes take at most 9 bits a byte, plus the block header, its end and the flush
+    uint8_t* compressed = stats_malloc(chunk->size + chunk->size / 8 + 16);
+    int32_t* head = stats_malloc(((size_t)1 << PK3_HASH_BITS) * sizeof(int32_t));
+    int32_t* prev = stats_malloc(PK3_WINDOW * sizeof(int32_t));
+    if (compressed == NULL || head == NULL || prev == NULL) {
+        stats_free(compressed);
+        stats_free(head);
+        stats_free(prev);
+        return;
+    }
+    memset(head, 0xFF, ((size_t)1 << PK3_HASH_BITS) * sizeof(int32_t));
+
+    // Positions are kept relative to the window before the chunk, matches may reach back into it like in one stream
+    for (size_t i = base; i < chunk->start && i + PK3_MIN_MATCH <= deflate->size; i++) {
+        uint32_t hash = pk3_hash(data + i);
+        prev[(i - base) & (PK3_WINDOW - 1)] = head[hash];
+        head[hash] = (int32_t)(i - base);
+    }
+
+    bool last = index + 1 == deflate->num_chunks;
+    struct Pk3Bits bits = {compressed, 0, 0, 0};
+    pk3_write_bits(&bits, last, 1);
+    pk3_write_bits(&bits, 1, 2);
+    for (size_t i = chunk->start; i < end;) {
+        size_t best_length = 0, best_distance = 0;
+        if (end - i >= PK3_MIN_MATCH) {
+            size_t max_length = end - i < PK3_MAX_MATCH ? end - i : PK3_MAX_MATCH;
+            int32_t candidate = head[pk3_hash(data + i)];
+            for (int chain = 0; candidate >= 0 && chain < PK3_MAX_CHAIN; chain++) {
+                size_t position = base + (size_t)candidate;
+                if (i - position > PK3_WINDOW)
+                    break;
+                if (data[position + best_length] == data[i + best_length]) {
+                    size_t length = 0;
+                    while (length < max_length && data[position + length] == data[i + length])
+                        ++length;
+                    if (length > best_length) {
+                        best_length = length;
+                        best_distance = i - position;
+                        if (length >= PK3_NICE_MATCH || length == max_length)
+                            break;
+                    }
+                }
+
+                // Slots are reused once a position leaves the window, which ends the chain
+                int32_t next = prev[candidate & (PK3_WINDOW - 1)];
+                if (next >= candidate)
+                    break;
+                candidate = next;
+            }
+        }
+
+        size_t step = best_length >= PK3_MIN_MATCH ? best_length : 1;
+        if (step > 1)
+            pk3_write_match(&bits, best_length, best_distance);
+        else
+            pk3_write_symbol(&bits, data[i]);
+        for (size_t j = i; j < i + step && j + PK3_MIN_MATCH <= deflate->size; j++) {
+            uint32_t hash = pk3_hash(data + j);
+            prev[(j - base) & (PK3_WINDOW - 1)] = head[hash];
+            head[hash] = (int32_t)(j - base);
+        }
+        i += step;
+    }
+    pk3_write_symbol(&bits, 256);
+
+    // An empty stored block brings the stream to a byte boundary, where the next chunk carries on
+    if (!last) {
+        pk3_write_bits(&bits, 0, 3);
+        pk3_flush_bits(&bits);
+        memcpy(bits.data + bits.size, "\x00\x00\xFF\xFF", 4);
+        bits.size += 4;
+    }
+    pk3_flush_bits(&bits);
+
+    stats_free(head);
+    stats_free(prev);
+    chunk->data = compressed;
+    chunk->compressed_size = bits.size;
+}
+
+uint32_t pk3_hash(const uint8_t* data) {
+    uint32_t hash = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+    return (hash * 0x9E3779B1u) >> (32 - PK3_HASH_BITS);
+}
+
+void pk3_write_symbol(struct Pk3Bits* bits, int symbol) {
+    // Fixed Huffman codes, which are sent from their most significant bit
+    uint32_t code, reversed = 0;
+    int size;
+    if (symbol < 144)
+        code = 0x30 + symbol, size = 8;
+    else if (symbol < 256)
+        code = 0x190 + symbol - 144, size = 9;
+    else if (symbol < 280)
+        code = symbol - 256, size = 7;
+    else
+        code = 0xC0 + symbol - 280, size = 8;
+    for (int i = 0; i < size; i++)
+        reversed |= ((code >> i) & 1) << (size - 1 - i);
+    pk3_write_bits(bits, reversed, size);
+}
+
+void pk3_write_match(struct Pk3Bits* bits, size_t length, size_t distance) {
+    int code = 28;
+    while (length_bases[code] > length)
+        --code;
+    pk3_write_symbol(bits, 257 + code);
+    pk3_write_bits(bits, (uint32_t)(length - length_bases[code]), length_bits[code]);
+
+    code = 29;
+    while (distance_bases[code] > distance)
+        --code;
+    uint32_t reversed = 0;
+    for (int i = 0; i < 5; i++)
+        reversed |= ((code >> i) & 1) << (4 - i);
+    pk3_write_bits(bits, reversed, 5);
+    pk3_write_bits(bits, (uint32_t)(distance - distance_bases[code]), distance_bits[code]);
+}
+
+void pk3_write_bits(struct Pk3Bits* bits, uint32_t value, int count) {
+    bits->bits |= (uint64_t)value << bits->count;
+    bits->count += count;
+    while (bits->count >= 8) {
+        bits->data[bits->size++] = (uint8_t)bits->bits;
+        bits->bits >>= 8;
+        bits->count -= 8;
+    }
+}
+
+void pk3_flush_bits(struct Pk3Bits* bits) {
+    if (bits->count > 0)
+        bits->data[bits->size++] = (uint8_t)bits->bits;
+    bits->bits = 0;
+    bits->count = 0;
+}
+
+bool pk3_add_entry(struct WadWriter* writer, const struct Pk3Entry* entry) {
+    struct Pk3Entry* it = &writer->entries[writer->num_entries++];
+    *it = *entry;
+    it->data = NULL;
+    it->offset = writer->append;
+    pk3_write_header(writer->stream, false, it);
+    writer->append += 30 + strlen(it->name);
+    return wad_write(writer, entry->data, entry->compressed_size);
+}
+
+void pk3_finish(struct WadWriter* writer) {
+    // Central directory, then where it starts @ 16 of the end record
+    uint32_t offset = writer->append, size = 0;
+    for (size_t i = 0; i < writer->num_entries; i++) {
+        pk3_write_header(writer->stream, true, &writer->entries[i]);
+        size += 46 + strlen(writer->entries[i].name);
+    }
+    write_u32le(writer->stream, 0x06054B50);                    // signature @ 0 -> 4
+    write_u16le(writer->stream, 0);                             // disk @ 4 -> 6
+    write_u16le(writer->stream, 0);                             // directory disk @ 6 -> 8
+    write_u16le(writer->stream, (uint16_t)writer->num_entries); // entries on disk @ 8 -> 10
+    write_u16le(writer->stream, (uint16_t)writer->num_entries); // entries @ 10 -> 12
+    write_u32le(writer->stream, size);                          // directory size @ 12 -> 16
+    write_u32le(writer->stream, offset);                        // directory offset @ 16 -> 20
+    write_u16le(writer->stream, 0);                             // comment size @ 20 -> 22
+}
+
+void pk3_write_header(FILE* stream, bool central, const struct Pk3Entry* entry) {
+    // The central directory's copy of a local header has a few more fields
+    uint16_t name_size = (uint16_t)strlen(entry->name);
+    write_u32le(stream, central ? 0x02014B50 : 0x04034B50);
+    if (central)
+        write_u16le(stream, 20); // made by MS-DOS, zip 2.0
+    write_u16le(stream, 20);     // needs zip 2.0 for deflate
+    write_u16le(stream, 0);      // flags
+    write_u16le(stream, entry->method);
+    write_u16le(stream, PK3_DOS_TIME);
+    write_u16le(stream, PK3_DOS_DATE);
+    write_u32le(stream, entry->crc);
+    write_u32le(stream, entry->compressed_size);
+    write_u32le(stream, entry->size);
+    write_u16le(stream, name_size);
+    write_u16le(stream, 0); // extra field size
+    if (central) {
+        write_u16le(stream, 0); // comment size
+        write_u16le(stream, 0); // disk
+        write_u16le(stream, 0); // internal attributes
+        write_u32le(stream, 0); // external attributes
+        write_u32le(stream, entry->offset);
+    }
+    write_string(stream, entry->name, name_size);
+}
+
+uint32_t pk3_crc32(uint32_t crc, const uint8_t* data, size_t size) {
+    call_once(&crc_once, pk3_crc_init);
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void pk3_crc_init() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++)
+            crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        crc_table[i] = crc;
+    }
+}
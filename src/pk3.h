@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "config.h"
+#include "map.h"
+
+#define PK3_CHUNK 32768
+#define PK3_WINDOW 32768
+#define PK3_HASH_BITS 15
+#define PK3_MAX_CHAIN 64
+#define PK3_MIN_MATCH 3
+#define PK3_MAX_MATCH 258
+#define PK3_NICE_MATCH 128
+
+#define PK3_STORED 0
+#define PK3_DEFLATED 8
+
+// 1980-01-01 00:00, so that the same maps always make the same PK3
+#define PK3_DOS_TIME 0
+#define PK3_DOS_DATE 0x21
+
+// Part of an entry compressed on its own, every chunk but the last ends on a byte boundary so they can be joined
+struct Pk3Chunk {
+    size_t start, size;
+    uint8_t* data;
+    size_t compressed_size;
+};
+
+struct Pk3Deflate {
+    const uint8_t* data;
+    size_t size;
+    struct Pk3Chunk* chunks;
+    size_t num_chunks;
+};
+
+// Deflate wants the least significant bit first
+struct Pk3Bits {
+    uint8_t* data;
+    size_t size;
+    uint64_t bits;
+    int count;
+};
+
+bool is_pk3_name(const char*);
+bool pk3_compress(struct MapLumps*);
+bool pk3_deflate(struct Pk3Entry*, const uint8_t*, size_t);
+void pk3_deflate_chunk(void*, size_t);
+uint32_t pk3_hash(const uint8_t*);
+void pk3_write_symbol(struct Pk3Bits*, int);
+void pk3_write_match(struct Pk3Bits*, size_t, size_t);
+void pk3_write_bits(struct Pk3Bits*, uint32_t, int);
+void pk3_flush_bits(struct Pk3Bits*);
+bool pk3_add_entry(struct WadWriter*, const struct Pk3Entry*);
+void pk3_finish(struct WadWriter*);
+void pk3_write_header(FILE*, bool, const struct Pk3Entry*);
+uint32_t pk3_crc32(uint32_t, const uint8_t*, size_t);
+void pk3_crc_init();
@@ -0,0 +1,157 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <threads.h>
+
+#include "error.h"
+#include "pool.h"
+#include "stats.h"
+#include "trace.h"
+
+static thrd_t threads[POOL_MAX_THREADS];
+static size_t num_threads = 0;
+static bool ready = false, stopping = false;
+
+static mtx_t lock;
+static cnd_t wake, done;
+static unsigned generation = 0;
+
+// Current pool_run, guarded by lock
+static PoolTask task = NULL;
+static void* task_ctx = NULL;
+static struct PhaseStats* task_stats = NULL;
+static size_t next_index = 0, num_indices = 0, pending = 0;
+
+// Set while a thread runs a task, a pool_run from inside one runs inline
+static _Thread_local bool running = false;
+
+// Runs the remaining tasks of the current pool_run, called with the lock held
+static void pool_work() {
+    while (next_index < num_indices) {
+        PoolTask run = task;
+        void* ctx = task_ctx;
+        struct PhaseStats* previous = stats_attach(task_stats);
+        size_t index = next_index++;
+        mtx_unlock(&lock);
+
+        trace_begin("task", TRACE_NO_LEVEL);
+        running = true;
+        run(ctx, index);
+        running = false;
+        trace_end("task");
+        stats_attach(previous);
+
+        mtx_lock(&lock);
+        if (--pending == 0)
+            cnd_broadcast(&done);
+    }
+}
+
+static int pool_worker(void* arg) {
+    (void)arg;
+    mtx_lock(&lock);
+    unsigned seen = generation;
+    for (;;) {
+        while (!stopping && generation == seen)
+            cnd_wait(&wake, &lock);
+        if (stopping)
+            break;
+
+        seen = generation;
+        pool_work();
+    }
+    mtx_unlock(&lock);
+    return 0;
+}
+
+bool pool_init(size_t total) {
+    if (total == 0) {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        total = info.dwNumberOfProcessors;
+#else
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        total = cores > 0 ? (size_t)cores : 1;
+#endif
+    }
+    if (total > POOL_MAX_THREADS)
+        total = POOL_MAX_THREADS;
+    if (total <= 1)
+        return true;
+
+    if (mtx_init(&lock, mtx_plain) != thrd_success)
+        return fail("pool_init: Failed to create mutex");
+    if (cnd_init(&wake) != thrd_success || cnd_init(&done) != thrd_success) {
+        mtx_destroy(&lock);
+        return fail("pool_init: Failed to create condition variables");
+    }
+    ready = true;
+    stopping = false;
+
+    // The calling thread works too, so it counts towards the total
+    for (num_threads = 0; num_threads < total - 1; num_threads++)
+        if (thrd_create(&threads[num_threads], pool_worker, NULL) != thrd_success) {
+            printf("! pool_init: Only started %zu of %zu thread(s)\n", num_threads + 1, total);
+            break;
+        }
+
+    printf("pool_init: Using %zu thread(s)\n", num_threads + 1);
+    return true;
+}
+
+void pool_teardown() {
+    if (!ready)
+        return;
+
+    mtx_lock(&lock);
+    stopping = true;
+    cnd_broadcast(&wake);
+    mtx_unlock(&lock);
+    for (size_t i = 0; i < num_threads; i++)
+        thrd_join(threads[i], NULL);
+    num_threads = 0;
+
+    cnd_destroy(&done);
+    cnd_destroy(&wake);
+    mtx_destroy(&lock);
+    ready = false;
+}
+
+size_t pool_size() {
+    return num_threads + 1;
+}
+
+size_t pool_bands(size_t columns) {
+    // A few bands per thread even out uneven columns, a single thread just takes everything at once
+    size_t bands = num_threads > 0 ? pool_size() * 4 : 1;
+    return columns < bands ? columns : bands;
+}
+
+void pool_run(PoolTask run, void* ctx, size_t count) {
+    if (num_threads <= 0 || count <= 1 || running) {
+        for (size_t i = 0; i < count; i++)
+            run(ctx, i);
+        return;
+    }
+
+    // Only one thread may start tasks at a time
+    mtx_lock(&lock);
+    task = run;
+    task_ctx = ctx;
+    task_stats = stats_current();
+    next_index = 0;
+    num_indices = count;
+    pending = count;
+    ++generation;
+    cnd_broadcast(&wake);
+
+    pool_work();
+    while (pending > 0)
+        cnd_wait(&done, &lock);
+    mtx_unlock(&lock);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define POOL_MAX_THREADS 64
+
+// Called once for every index given to pool_run, from any thread
+typedef void (*PoolTask)(void*, size_t);
+
+bool pool_init(size_t);
+void pool_teardown();
+
+size_t pool_size();
+size_t pool_bands(size_t);
+void pool_run(PoolTask, void*, size_t);
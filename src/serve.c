@@ -0,0 +1,369 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "config.h"
+#include "error.h"
+#include "file.h"
+#include "map.h"
+#include "serve.h"
+#include "stats.h"
+#include "trace.h"
+#include "verify.h"
+
+static struct ServeConfig configs[SERVE_MAX_CONFIGS] = {0};
+static uint64_t num_uses = 0;
+static struct ServeMap maps[SERVE_MAX_MAPS] = {0};
+static size_t num_maps = 0;
+static FILE* responses = NULL;
+
+bool serve_claim_stdout() {
+    // Responses own stdout, everything else that gets printed goes to stderr
+    fflush(stdout);
+#ifdef _WIN32
+    int fd = _dup(_fileno(stdout));
+    _dup2(_fileno(stderr), _fileno(stdout));
+    responses = _fdopen(fd, "w");
+#else
+    int fd = dup(fileno(stdout));
+    dup2(fileno(stderr), fileno(stdout));
+    responses = fdopen(fd, "w");
+#endif
+    if (responses == NULL)
+        return fail("serve_claim_stdout: Failed to open output stream");
+    return true;
+}
+
+bool serve(const struct Config* config, const char* socket_name) {
+    bool success = true;
+
+    if (socket_name == NULL) {
+        if (responses == NULL && !serve_claim_stdout())
+            return false;
+
+        printf("serve: Reading jobs from stdin\n");
+        success = serve_stream(config, stdin, responses);
+        fclose(responses);
+        responses = NULL;
+    } else {
+#ifdef _WIN32
+        return fail("serve: UNIX sockets are not supported on this platform");
+#else
+        int server = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server < 0)
+            return fail("serve: Failed to create socket (%s)", strerror(errno));
+
+        struct sockaddr_un address = {0};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socket_name, sizeof(address.sun_path) - 1);
+        unlink(socket_name);
+        if (bind(server, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server, 4) != 0) {
+            close(server);
+            return fail("serve: Failed to listen on \"%s\" (%s)", socket_name, strerror(errno));
+        }
+
+        printf("serve: Listening on \"%s\"\n", socket_name);
+        for (;;) {
+            int client = accept(server, NULL, NULL);
+            if (client < 0) {
+                if (errno == EINTR)
+                    continue;
+                success = fail("serve: Failed to accept connection (%s)", strerror(errno));
+                break;
+            }
+
+            int client_out = dup(client);
+            FILE* input = fdopen(client, "r");
+            FILE* output = client_out < 0 ? NULL : fdopen(client_out, "w");
+            if (input == NULL || output == NULL) {
+                printf("! serve: Failed to open connection streams\n");
+                if (input != NULL)
+                    fclose(input);
+                else
+                    close(client);
+                if (output != NULL)
+                    fclose(output);
+                else if (client_out >= 0)
+                    close(client_out);
+                continue;
+            }
+
+            serve_stream(config, input, output);
+            fclose(input);
+            fclose(output);
+        }
+
+        close(server);
+        unlink(socket_name);
+#endif
+    }
+
+    for (size_t i = 0; i < num_maps; i++) {
+        map_teardown(NULL, &maps[i].map);
+        free(maps[i].gamemaps);
+    }
+    num_maps = 0;
+
+    for (size_t i = 0; i < SERVE_MAX_CONFIGS; i++) {
+        if (configs[i].name == NULL)
+            continue;
+        config_teardown(&configs[i].config);
+        free(configs[i].name);
+        memset(&configs[i], 0, sizeof(struct ServeConfig));
+    }
+
+    return success;
+}
+
+bool serve_stream(const struct Config* config, FILE* input, FILE* output) {
+    size_t size = 0, max_size = 1024;
+    char* line = malloc(max_size);
+    if (line == NULL)
+        return fail("serve_stream: Out of memory");
+
+    for (;;) {
+        int c = fgetc(input);
+        if (c == EOF || c == '\n') {
+            if (size > 0) {
+                line[size] = '\0';
+                serve_job(config, line, size, output);
+                fflush(output);
+                size = 0;
+            }
+
+            if (c == EOF)
+                break;
+            continue;
+        }
+
+        if (size + 1 >= max_size) {
+            char* grown = realloc(line, max_size * 2);
+            if (grown == NULL) {
+                free(line);
+                return fail("serve_stream: Out of memory");
+            }
+            line = grown;
+            max_size *= 2;
+        }
+        line[size++] = (char)c;
+    }
+
+    free(line);
+    return true;
+}
+
+void serve_job(const struct Config* config, char* line, size_t size, FILE* output) {
+    double start = get_time();
+    trace_begin("job", TRACE_NO_LEVEL);
+
+    int levels[MAX_LEVELS];
+    size_t num_levels = 0;
+    struct DoomMap job_maps[MAX_LEVELS] = {0};
+    bool success = false;
+
+    yyjson_read_err error;
+    yyjson_doc* json = yyjson_read_opts(line, size, JSON_FLAGS, NULL, &error);
+    yyjson_val* root = yyjson_doc_get_root(json);
+    yyjson_val* id = yyjson_obj_get(root, "id");
+    const char* maphead_name = yyjson_get_str(yyjson_obj_get(root, "maphead"));
+    const char* gamemaps_name = yyjson_get_str(yyjson_obj_get(root, "gamemaps"));
+    const char* output_name = yyjson_get_str(yyjson_obj_get(root, "output"));
+    const char* config_name = yyjson_get_str(yyjson_obj_get(root, "config"));
+    bool update = yyjson_get_bool(yyjson_obj_get(root, "update"));
+    bool dry_run = yyjson_get_bool(yyjson_obj_get(root, "dry_run"));
+    bool verify = yyjson_get_bool(yyjson_obj_get(root, "verify"));
+    if (dry_run)
+        output_name = NULL;
+
+    if (json == NULL) {
+        fail("serve_job: Failed to read job (%s)", error.msg);
+    } else if (!yyjson_is_obj(root)) {
+        fail("serve_job: Expected job as object, got %s", yyjson_get_type_desc(root));
+    } else if (maphead_name == NULL || gamemaps_name == NULL || (output_name == NULL && !dry_run)) {
+        fail("serve_job: Expected \"maphead\", \"gamemaps\" and \"output\" as strings");
+    } else if (config_name != NULL && (config = serve_config(config_name)) == NULL) {
+        // serve_config already reported why
+    } else {
+        yyjson_val* value = yyjson_obj_get(root, "levels");
+        if (yyjson_is_arr(value)) {
+            size_t i, n;
+            yyjson_val* level;
+            yyjson_arr_foreach(value, i, n, level) {
+                if (num_levels < MAX_LEVELS)
+                    levels[num_levels++] = yyjson_is_int(level) ? (int)yyjson_get_sint(level) : -1;
+            }
+        } else {
+            value = yyjson_obj_get(root, "level");
+            levels[num_levels++] = yyjson_is_int(value) ? (int)yyjson_get_sint(value) : 0;
+        }
+
+        for (size_t i = 0; i < num_levels; i++)
+            serve_take_map(&job_maps[i], gamemaps_name, levels[i]);
+        success = map_convert(
+            config, maphead_name, gamemaps_name, levels, num_levels, output_name, update, NULL, job_maps
+        );
+        success = success && (!verify || output_name == NULL || verify_wad(output_name));
+    }
+    stats_end();
+
+    fputc('{', output);
+    if (yyjson_is_str(id)) {
+        fprintf(output, "\"id\":");
+        write_json_string(output, yyjson_get_str(id));
+        fputc(',', output);
+    } else if (yyjson_is_int(id)) {
+        fprintf(output, "\"id\":%lld,", (long long)yyjson_get_sint(id));
+    }
+    fprintf(output, "\"ok\":%s,\"time_ms\":%.3f", success ? "true" : "false", (get_time() - start) * 1000);
+
+    if (success) {
+        if (output_name != NULL) {
+            fprintf(output, ",\"output\":");
+            write_json_string(output, output_name);
+        }
+        fprintf(output, ",\"levels\":[");
+        for (size_t i = 0; i < num_levels; i++)
+            fprintf(
+                output,
+                "%s{\"level\":%d,\"name\":\"%.8s\",\"things\":%zu,\"lines\":%zu,\"sides\":%zu,\"vertices\":%zu,"
+                "\"sectors\":%zu}",
+                i ? "," : "", levels[i], job_maps[i].name, job_maps[i].num_things, job_maps[i].num_lines,
+                job_maps[i].num_sides, job_maps[i].num_vertices, job_maps[i].num_sectors
+            );
+        fputc(']', output);
+    } else {
+        fprintf(output, ",\"error\":");
+        write_json_string(output, get_error());
+    }
+    fprintf(output, "}\n");
+
+    for (size_t i = 0; i < num_levels; i++) {
+        if (success)
+            serve_keep_map(&job_maps[i], gamemaps_name, levels[i]);
+        map_teardown(NULL, &job_maps[i]);
+    }
+    yyjson_doc_free(json);
+    trace_end("job");
+}
+
+const struct Config* serve_config(const char* config_name) {
+    size_t size;
+    char* source = read_file(config_name, &size);
+    if (source == NULL) {
+        fail("serve_config: Failed to open \"%s\" (%s)", config_name, strerror(errno));
+        return NULL;
+    }
+    uint64_t hash = hash_bytes(HASH_INIT, source, size);
+    stats_free(source);
+
+    // Free slots were never used, so they go before the override that was used the longest time ago
+    struct ServeConfig *it = NULL, *oldest = &configs[0];
+    for (size_t i = 0; i < SERVE_MAX_CONFIGS && it == NULL; i++)
+        if (configs[i].name != NULL && strcmp(configs[i].name, config_name) == 0)
+            it = &configs[i];
+        else if (configs[i].used < oldest->used)
+            oldest = &configs[i];
+
+    if (it != NULL) {
+        it->used = ++num_uses;
+        if (it->config.hash == hash)
+            return &it->config;
+        serve_forget_maps(&it->config);
+        config_teardown(&it->config);
+    } else {
+        it = oldest;
+        if (it->name != NULL) {
+            serve_forget_maps(&it->config);
+            config_teardown(&it->config);
+            free(it->name);
+        }
+
+        it->name = malloc(strlen(config_name) + 1);
+        if (it->name == NULL) {
+            memset(it, 0, sizeof(struct ServeConfig));
+            fail("serve_config: Out of memory");
+            return NULL;
+        }
+        strcpy(it->name, config_name);
+        it->used = ++num_uses;
+    }
+
+    if (!config_init(&it->config, config_name, NULL)) {
+        free(it->name);
+        memset(it, 0, sizeof(struct ServeConfig));
+        return NULL;
+    }
+
+    return &it->config;
+}
+
+void serve_take_map(struct DoomMap* doommap, const char* gamemaps_name, int level) {
+    for (size_t i = 0; i < num_maps; i++)
+        if (maps[i].level == level && strcmp(maps[i].gamemaps, gamemaps_name) == 0) {
+            *doommap = maps[i].map;
+            free(maps[i].gamemaps);
+            maps[i] = maps[--num_maps];
+            return;
+        }
+}
+
+void serve_keep_map(struct DoomMap* doommap, const char* gamemaps_name, int level) {
+    // A level listed twice is only kept once
+    bool keep = doommap->checkpoints != NULL;
+    for (size_t i = 0; i < num_maps && keep; i++)
+        keep = maps[i].level != level || strcmp(maps[i].gamemaps, gamemaps_name) != 0;
+    if (!keep)
+        return;
+
+    if (num_maps >= SERVE_MAX_MAPS) {
+        map_teardown(NULL, &maps[0].map);
+        free(maps[0].gamemaps);
+        memmove(&maps[0], &maps[1], (SERVE_MAX_MAPS - 1) * sizeof(struct ServeMap));
+        --num_maps;
+    }
+
+    struct ServeMap* it = &maps[num_maps];
+    it->gamemaps = malloc(strlen(gamemaps_name) + 1);
+    if (it->gamemaps == NULL)
+        return;
+    strcpy(it->gamemaps, gamemaps_name);
+    it->level = level;
+    it->map = *doommap;
+    memset(doommap, 0, sizeof(struct DoomMap));
+    ++num_maps;
+}
+
+void serve_forget_maps(const struct Config* config) {
+    // Their cells point into the config that is about to be freed
+    for (size_t i = 0; i < num_maps;)
+        if (maps[i].map.config == config) {
+            map_teardown(NULL, &maps[i].map);
+            free(maps[i].gamemaps);
+            maps[i] = maps[--num_maps];
+        } else {
+            i++;
+        }
+}
+
+void write_json_string(FILE* stream, const char* string) {
+    fputc('"', stream);
+    for (const unsigned char* c = (const unsigned char*)string; *c != '\0'; c++)
+        if (*c == '"' || *c == '\\')
+            fprintf(stream, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(stream, "\\u%04x", *c);
+        else
+            fputc(*c, stream);
+    fputc('"', stream);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "config.h"
+#include "map.h"
+
+#define SERVE_MAX_CONFIGS 16
+#define SERVE_MAX_MAPS 32
+
+// Config override requested by a job, reloaded whenever its source changes. Overrides never move, the maps kept
+// for them point at their config
+struct ServeConfig {
+    char* name;
+    uint64_t used;
+    struct Config config;
+};
+
+// Last conversion of a level, kept so that the next job on it only redoes what was edited
+struct ServeMap {
+    char* gamemaps;
+    int level;
+    struct DoomMap map;
+};
+
+bool serve_claim_stdout();
+bool serve(const struct Config*, const char*);
+bool serve_stream(const struct Config*, FILE*, FILE*);
+void serve_job(const struct Config*, char*, size_t, FILE*);
+const struct Config* serve_config(const char*);
+void serve_take_map(struct DoomMap*, const char*, int);
+void serve_keep_map(struct DoomMap*, const char*, int);
+void serve_forget_maps(const struct Config*);
+
+void write_json_string(FILE*, const char*);
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "stats.h"
+#include "trace.h"
+
+static const char* phase_names[NUM_PHASES] = {
+    "config", "header", "decode", "things", "sectors", "space", "lines", "write", "audit", "cache", "verify",
+    "compress",
+};
+
+static const char* lookup_names[NUM_LOOKUPS] = {
+    "add_vertex", "add_line", "add_custom_sector", "get_wall_info", "get_door_info", "get_object_info", "get_area_info",
+};
+
+static enum StatsFormats format = STATS_NONE;
+static struct PhaseStats phases[NUM_PHASES] = {0};
+static struct Allocator allocator = {0};
+
+// Every thread times its own phase, pool workers count towards the phase of whoever started their task
+static _Thread_local enum StatsPhases phase_id = NUM_PHASES;
+static _Thread_local struct PhaseStats* phase = NULL;
+static _Thread_local double phase_start = 0;
+
+void stats_init(enum StatsFormats stats_format) {
+    format = stats_format;
+}
+
+void stats_set_allocator(const struct Allocator* hooks) {
+    if (hooks != NULL)
+        allocator = *hooks;
+    else
+        memset(&allocator, 0, sizeof(struct Allocator));
+}
+
+void stats_print() {
+    if (format == STATS_NONE || format == STATS_QUIET)
+        return;
+
+    if (format == STATS_JSON) {
+        printf("{\"phases\":[");
+        bool first = true;
+        for (int i = 0; i < NUM_PHASES; i++) {
+            const struct PhaseStats* stats = &phases[i];
+            if (!stats->used)
+                continue;
+
+            printf(
+                "%s{\"name\":\"%s\",\"time_ms\":%.3f,\"allocs\":%zu,\"bytes\":%zu,\"peak_memory\":%zu,\"lookups\":{",
+                first ? "" : ",", phase_names[i], stats->time * 1000, stats->allocs, stats->bytes, stats->peak_memory
+            );
+            for (int j = 0; j < NUM_LOOKUPS; j++)
+                printf(
+                    "%s\"%s\":{\"calls\":%zu,\"probes\":%zu}", j ? "," : "", lookup_names[j], stats->lookups[j],
+                    stats->probes[j]
+                );
+            printf("}}");
+            first = false;
+        }
+        printf("]}\n");
+        return;
+    }
+
+    printf("stats: %-8s %10s %8s %12s %12s\n", "Phase", "Time (ms)", "Allocs", "Bytes", "Peak (KiB)");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        const struct PhaseStats* stats = &phases[i];
+        if (!stats->used)
+            continue;
+
+        printf(
+            "stats: %-8s %10.3f %8zu %12zu %12zu\n", phase_names[i], stats->time * 1000, stats->allocs, stats->bytes,
+            stats->peak_memory / 1024
+        );
+        for (int j = 0; j < NUM_LOOKUPS; j++)
+            if (stats->lookups[j])
+                printf(
+                    "stats:   %-18s %10zu call(s) %12zu probe(s)\n", lookup_names[j], stats->lookups[j],
+                    stats->probes[j]
+                );
+    }
+}
+
+const char* stats_phase_name(enum StatsPhases id) {
+    return phase_names[id];
+}
+
+double stats_time(enum StatsPhases id) {
+    // Negative for phases that never ran
+    return phases[id].used ? phases[id].time : -1;
+}
+
+void stats_begin(enum StatsPhases id) {
+    // A phase that bailed out early never got to end itself
+    stats_end();
+    phase_id = id;
+    trace_begin(phase_names[id], TRACE_NO_LEVEL);
+    if (format == STATS_NONE)
+        return;
+
+    phase = &phases[id];
+    phase->used = true;
+    phase_start = get_time();
+}
+
+void stats_end() {
+    if (phase_id != NUM_PHASES) {
+        trace_end(phase_names[phase_id]);
+        phase_id = NUM_PHASES;
+    }
+    if (phase == NULL)
+        return;
+
+    double elapsed = get_time() - phase_start, time = atomic_load(&phase->time);
+    while (!atomic_compare_exchange_weak(&phase->time, &time, time + elapsed))
+        ;
+    phase->peak_memory = get_peak_memory();
+    phase = NULL;
+}
+
+struct PhaseStats* stats_current() {
+    return phase;
+}
+
+struct PhaseStats* stats_attach(struct PhaseStats* stats) {
+    struct PhaseStats* previous = phase;
+    phase = stats;
+    return previous;
+}
+
+void stats_lookup(enum StatsLookups id, size_t probes) {
+    if (phase == NULL)
+        return;
+
+    ++phase->lookups[id];
+    phase->probes[id] += probes;
+}
+
+void* stats_malloc(size_t size) {
+    if (phase != NULL) {
+        ++phase->allocs;
+        phase->bytes += size;
+    }
+
+    return allocator.malloc != NULL ? allocator.malloc(allocator.ctx, size) : malloc(size);
+}
+
+void* stats_calloc(size_t count, size_t size) {
+    if (phase != NULL) {
+        ++phase->allocs;
+        phase->bytes += count * size;
+    }
+    if (allocator.malloc == NULL)
+        return calloc(count, size);
+
+    void* ptr = count > 0 && size > SIZE_MAX / count ? NULL : allocator.malloc(allocator.ctx, count * size);
+    if (ptr != NULL)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* stats_realloc(void* ptr, size_t size) {
+    if (phase != NULL) {
+        ++phase->allocs;
+        phase->bytes += size;
+    }
+
+    return allocator.realloc != NULL ? allocator.realloc(allocator.ctx, ptr, size) : realloc(ptr, size);
+}
+
+void stats_free(void* ptr) {
+    if (allocator.free != NULL)
+        allocator.free(allocator.ctx, ptr);
+    else
+        free(ptr);
+}
+
+static void* json_malloc(void* ctx, size_t size) {
+    (void)ctx;
+    return stats_malloc(size);
+}
+
+static void* json_realloc(void* ctx, void* ptr, size_t old_size, size_t size) {
+    (void)ctx;
+    (void)old_size;
+    return stats_realloc(ptr, size);
+}
+
+static void json_free(void* ctx, void* ptr) {
+    (void)ctx;
+    stats_free(ptr);
+}
+
+static const yyjson_alc json_allocator = {json_malloc, json_realloc, json_free, NULL};
+
+const yyjson_alc* stats_allocator() {
+    return format == STATS_NONE && allocator.malloc == NULL ? NULL : &json_allocator;
+}
+
+double get_time() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+size_t get_peak_memory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024;
+#endif
+#endif
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdatomic.h>
+
+#include "yyjson.h"
+
+enum StatsFormats {
+    STATS_NONE,
+    STATS_TEXT,
+    STATS_JSON,
+    // Measured for --golden, but not printed
+    STATS_QUIET,
+};
+
+enum StatsPhases {
+    PHASE_CONFIG,
+    PHASE_HEADER,
+    PHASE_DECODE,
+    PHASE_THINGS,
+    PHASE_SECTORS,
+    PHASE_SPACE,
+    PHASE_LINES,
+    PHASE_WRITE,
+    PHASE_AUDIT,
+    PHASE_CACHE,
+    PHASE_VERIFY,
+    PHASE_COMPRESS,
+    NUM_PHASES,
+};
+
+enum StatsLookups {
+    LOOKUP_VERTEX,
+    LOOKUP_LINE,
+    LOOKUP_SECTOR,
+    LOOKUP_WALL,
+    LOOKUP_DOOR,
+    LOOKUP_OBJECT,
+    LOOKUP_AREA,
+    NUM_LOOKUPS,
+};
+
+// Replaces malloc, realloc and free for everything allocated through stats_malloc and friends
+struct Allocator {
+    void* (*malloc)(void*, size_t);
+    void* (*realloc)(void*, void*, size_t);
+    void (*free)(void*, void*);
+    void* ctx;
+};
+
+struct PhaseStats {
+    // Updated from every thread that is in the phase, e.g. several levels or mods converted at once
+    atomic_bool used;
+    _Atomic double time;
+    atomic_size_t allocs, bytes;
+    atomic_size_t peak_memory;
+
+    // Calls and entries scanned per lookup function, also counted from pool threads
+    atomic_size_t lookups[NUM_LOOKUPS], probes[NUM_LOOKUPS];
+};
+
+void stats_init(enum StatsFormats);
+void stats_set_allocator(const struct Allocator*);
+void stats_print();
+const char* stats_phase_name(enum StatsPhases);
+double stats_time(enum StatsPhases);
+
+void stats_begin(enum StatsPhases);
+void stats_end();
+struct PhaseStats* stats_current();
+struct PhaseStats* stats_attach(struct PhaseStats*);
+void stats_lookup(enum StatsLookups, size_t);
+
+void* stats_malloc(size_t);
+void* stats_calloc(size_t, size_t);
+void* stats_realloc(void*, size_t);
+void stats_free(void*);
+const yyjson_alc* stats_allocator();
+
+double get_time();
+size_t get_peak_memory();
@@ -0,0 +1,131 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "error.h"
+#include "stats.h"
+#include "trace.h"
+
+static char* trace_name = NULL;
+static double trace_start = 0;
+static thrd_t main_thread;
+static atomic_bool enabled = false;
+
+static _Atomic(struct TraceBuffer*) buffers = NULL;
+static atomic_int num_buffers = 0;
+static _Thread_local struct TraceBuffer* buffer = NULL;
+
+bool trace_init(const char* output_name) {
+    if (output_name == NULL)
+        return true;
+
+    trace_name = malloc(strlen(output_name) + 1);
+    if (trace_name == NULL)
+        return fail("trace_init: Out of memory");
+    strcpy(trace_name, output_name);
+    trace_start = get_time();
+    main_thread = thrd_current();
+    enabled = true;
+    return true;
+}
+
+void trace_teardown() {
+    if (trace_name == NULL)
+        return;
+
+    // A trace that ran out of memory is missing events, so it isn't saved at all
+    FILE* output = enabled ? fopen(trace_name, "wb") : NULL;
+    if (!enabled) {
+        printf("! trace_teardown: Tracing stopped early, not saving \"%s\"\n", trace_name);
+    } else if (output == NULL) {
+        printf("! trace_teardown: Failed to open trace \"%s\"\n", trace_name);
+    } else {
+        fprintf(output, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(output, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"wolf2wad\"}}");
+        for (struct TraceBuffer* it = atomic_load(&buffers); it != NULL; it = it->next) {
+            fprintf(
+                output, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                it->tid, it->main ? "main" : "worker", it->tid
+            );
+
+            for (size_t i = 0; i < it->num_events; i++) {
+                const struct TraceEvent* event = &it->events[i];
+                fprintf(
+                    output, ",\n{\"name\":\"%s\",\"cat\":\"wolf2wad\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+                    event->name, event->type == TRACE_BEGIN ? 'B' : 'E', event->time * 1e6, it->tid
+                );
+                if (event->level != TRACE_NO_LEVEL)
+                    fprintf(output, ",\"args\":{\"level\":%d}", event->level);
+                fputc('}', output);
+            }
+        }
+        fprintf(output, "\n]}\n");
+        fclose(output);
+        printf("trace_teardown: Saved trace in \"%s\"\n", trace_name);
+    }
+
+    struct TraceBuffer* it = atomic_exchange(&buffers, NULL);
+    while (it != NULL) {
+        struct TraceBuffer* next = it->next;
+        free(it->events);
+        free(it);
+        it = next;
+    }
+    buffer = NULL;
+
+    free(trace_name);
+    trace_name = NULL;
+    enabled = false;
+}
+
+static void trace_stop(const char* message) {
+    // Only the first thread to run out reports it, the conversion itself carries on and keeps its own error
+    if (atomic_exchange(&enabled, false))
+        printf("! %s\n", message);
+}
+
+static void trace_push(const char* name, enum TraceTypes type, int level) {
+    if (buffer == NULL) {
+        buffer = calloc(1, sizeof(struct TraceBuffer));
+        if (buffer == NULL) {
+            trace_stop("trace_push: Out of memory, tracing stopped");
+            return;
+        }
+
+        // Publish the buffer without taking a lock, the teardown only reads it once every thread is done
+        buffer->tid = atomic_fetch_add(&num_buffers, 1);
+        buffer->main = thrd_equal(thrd_current(), main_thread);
+        buffer->next = atomic_load(&buffers);
+        while (!atomic_compare_exchange_weak(&buffers, &buffer->next, buffer))
+            ;
+    }
+
+    if (buffer->num_events >= buffer->max_events) {
+        size_t max_events = buffer->max_events ? buffer->max_events * 2 : 256;
+        struct TraceEvent* events = realloc(buffer->events, max_events * sizeof(struct TraceEvent));
+        if (events == NULL) {
+            trace_stop("trace_push: Out of memory, tracing stopped");
+            return;
+        }
+        buffer->events = events;
+        buffer->max_events = max_events;
+    }
+
+    struct TraceEvent* event = &buffer->events[buffer->num_events++];
+    event->name = name;
+    event->type = type;
+    event->level = level;
+    event->time = get_time() - trace_start;
+}
+
+void trace_begin(const char* name, int level) {
+    if (enabled)
+        trace_push(name, TRACE_BEGIN, level);
+}
+
+void trace_end(const char* name) {
+    if (enabled)
+        trace_push(name, TRACE_END, TRACE_NO_LEVEL);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TRACE_NO_LEVEL -1
+
+enum TraceTypes {
+    TRACE_BEGIN,
+    TRACE_END,
+};
+
+struct TraceEvent {
+    const char* name;
+    enum TraceTypes type;
+    int level;
+    double time;
+};
+
+// One per recording thread, only ever appended to by its owner
+struct TraceBuffer {
+    struct TraceBuffer* next;
+    int tid;
+    bool main;
+
+    struct TraceEvent* events;
+    size_t num_events, max_events;
+};
+
+bool trace_init(const char*);
+void trace_teardown();
+
+void trace_begin(const char*, int);
+void trace_end(const char*);
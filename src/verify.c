@@ -0,0 +1,211 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pk3.h"
+#include "pool.h"
+#include "stats.h"
+#include "verify.h"
+
+// Lumps of a map in WAD order after its marker, with the size of their records
+static const char* lump_names[MAP_LUMPS] = {
+    NULL, "THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS", "SSECTORS", "NODES", "SECTORS", "REJECT", "BLOCKMAP",
+};
+static const uint32_t record_sizes[MAP_LUMPS] = {
+    [LUMP_THINGS] = sizeof(struct DoomThing), [LUMP_LINEDEFS] = sizeof(struct DoomLine),
+    [LUMP_SIDEDEFS] = SIDEDEF_SIZE,           [LUMP_VERTEXES] = sizeof(struct DoomVertex),
+    [LUMP_SECTORS] = SECTOR_SIZE,
+};
+
+bool verify_wad(const char* name) {
+    // Entries of a PK3 are compressed, there are no lumps to check in place
+    if (is_pk3_name(name)) {
+        printf("! verify_wad: \"%s\" is a PK3, only WADs are checked\n", name);
+        return true;
+    }
+
+    stats_begin(PHASE_VERIFY);
+    double start = get_time();
+    struct Verify verify = {0};
+    verify.name = name;
+    if (!file_map(&verify.view, name)) {
+        stats_end();
+        return fail("verify_wad: Failed to map \"%s\"", name);
+    }
+
+    size_t issues = 0;
+    bool success = verify_directory(&verify, &issues);
+    if (success) {
+        for (size_t i = 0; i < verify.num_maps; i++)
+            issues += verify_map(&verify.maps[i]);
+
+        // Lumps only read the mapped file, so every one of them can be checked at once
+        pool_run(verify_lump, &verify, verify.num_tasks);
+        for (size_t i = 0; i < verify.num_tasks; i++) {
+            const struct VerifyTask* task = &verify.tasks[i];
+            if (task->issues == 0)
+                continue;
+            printf(
+                "! verify_wad: %.8s has %zu issue(s) in %s, first: %s\n", task->map->name, task->issues,
+                lump_names[task->lump], task->first
+            );
+            issues += task->issues;
+        }
+    }
+
+    size_t num_maps = verify.num_maps;
+    stats_free(verify.maps);
+    stats_free(verify.tasks);
+    file_unmap(&verify.view);
+    stats_end();
+
+    if (!success)
+        return false;
+    if (issues > 0)
+        return fail("verify_wad: Found %zu issue(s) in \"%s\"", issues, name);
+    printf("verify_wad: Checked %zu map(s) in \"%s\" (%.2f ms)\n", num_maps, name, (get_time() - start) * 1000);
+    return true;
+}
+
+bool verify_directory(struct Verify* verify, size_t* issues) {
+    const uint8_t* data = verify->view.data;
+    size_t size = verify->view.size;
+    uint32_t header[2];
+    if (size < 12 || (memcmp(data, "IWAD", 4) != 0 && memcmp(data, "PWAD", 4) != 0))
+        return fail("verify_directory: \"%s\" is not a WAD", verify->name);
+    memcpy(header, data + 4, sizeof(header));
+    size_t num_lumps = u32le(header[0]), infotableofs = u32le(header[1]);
+    if (infotableofs > size || num_lumps > (size - infotableofs) / 16)
+        return fail("verify_directory: Directory of \"%s\" is past the end of the file", verify->name);
+
+    // Every map starts with a marker right before its THINGS
+    const uint8_t* directory = data + infotableofs;
+    size_t max_maps = 0;
+    for (size_t i = 1; i < num_lumps; i++)
+        if (strncmp((const char*)directory + i * 16 + 8, "THINGS", LUMP_NAME_MAX) == 0)
+            ++max_maps;
+    verify->maps = stats_calloc(max_maps > 0 ? max_maps : 1, sizeof(struct VerifyMap));
+    verify->tasks = stats_calloc(max_maps > 0 ? max_maps * MAP_LUMPS : 1, sizeof(struct VerifyTask));
+    if (verify->maps == NULL || verify->tasks == NULL)
+        return fail("verify_directory: Out of memory");
+
+    struct VerifyMap* map = NULL;
+    for (size_t i = 0; i < num_lumps; i++) {
+        const uint8_t* entry = directory + i * 16;
+        uint32_t fields[2];
+        memcpy(fields, entry, sizeof(fields));
+        uint32_t filepos = u32le(fields[0]), lump_size = u32le(fields[1]);
+        const char* lump_name = (const char*)entry + 8;
+        if (filepos > size || lump_size > size - filepos) {
+            printf("! verify_directory: Lump %zu (%.8s) is past the end of the file\n", i, lump_name);
+            ++*issues;
+            lump_size = 0;
+        }
+
+        if (i + 1 < num_lumps && strncmp((const char*)entry + 24, "THINGS", LUMP_NAME_MAX) == 0) {
+            map = &verify->maps[verify->num_maps++];
+            memcpy(map->name, lump_name, LUMP_NAME_MAX);
+            continue;
+        }
+        if (map == NULL || !is_map_lump(lump_name)) {
+            map = NULL;
+            continue;
+        }
+
+        for (int lump = LUMP_THINGS; lump < MAP_LUMPS; lump++) {
+            if (strncmp(lump_name, lump_names[lump], LUMP_NAME_MAX) != 0)
+                continue;
+            if (map->found[lump]) {
+                printf("! verify_directory: %.8s has more than one %s\n", map->name, lump_names[lump]);
+                ++*issues;
+            }
+            map->found[lump] = true;
+            map->data[lump] = lump_size > 0 ? data + filepos : NULL;
+            map->sizes[lump] = lump_size;
+            if (record_sizes[lump] > 0)
+                verify->tasks[verify->num_tasks++] = (struct VerifyTask){map, lump, 0, ""};
+            break;
+        }
+    }
+
+    return true;
+}
+
+size_t verify_map(const struct VerifyMap* map) {
+    size_t issues = 0;
+    for (int lump = LUMP_THINGS; lump < MAP_LUMPS; lump++)
+        if (record_sizes[lump] > 0 && !map->found[lump]) {
+            printf("! verify_map: %.8s has no %s\n", map->name, lump_names[lump]);
+            ++issues;
+        }
+
+    const int lumps[] = {LUMP_LINEDEFS, LUMP_SIDEDEFS, LUMP_VERTEXES, LUMP_SECTORS};
+    for (int i = 0; i < 4; i++) {
+        size_t count = map->sizes[lumps[i]] / record_sizes[lumps[i]];
+        if (count > VANILLA_MAX_INDEX) {
+            printf(
+                "! verify_map: %.8s has %zu %s, vanilla Doom allows %d\n", map->name, count, lump_names[lumps[i]],
+                VANILLA_MAX_INDEX
+            );
+            ++issues;
+        }
+    }
+
+    return issues;
+}
+
+void verify_lump(void* ctx, size_t index) {
+    struct VerifyTask* task = &((struct Verify*)ctx)->tasks[index];
+    const struct VerifyMap* map = task->map;
+    const uint8_t* data = map->data[task->lump];
+    uint32_t size = map->sizes[task->lump], record_size = record_sizes[task->lump];
+    if (size % record_size != 0)
+        verify_issue(task, "size %u is not a multiple of %u", size, record_size);
+
+    size_t count = size / record_size;
+    size_t num_vertices = map->sizes[LUMP_VERTEXES] / record_sizes[LUMP_VERTEXES];
+    size_t num_sides = map->sizes[LUMP_SIDEDEFS] / record_sizes[LUMP_SIDEDEFS];
+    size_t num_sectors = map->sizes[LUMP_SECTORS] / record_sizes[LUMP_SECTORS];
+    const uint8_t* sides = map->data[LUMP_SIDEDEFS];
+
+    if (task->lump == LUMP_LINEDEFS) {
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t* line = data + i * record_size;
+            uint16_t start = read_u16le(line), end = read_u16le(line + 2), flags = read_u16le(line + 4);
+            uint16_t front = read_u16le(line + 10), back = read_u16le(line + 12);
+            if (start >= num_vertices || end >= num_vertices)
+                verify_issue(task, "line %zu uses missing vertex %u", i, start >= num_vertices ? start : end);
+
+            if (front == NO_SIDEDEF)
+                verify_issue(task, "line %zu has no front side", i);
+            else if (front >= num_sides)
+                verify_issue(task, "line %zu uses missing side %u", i, front);
+            else if (read_u16le(sides + front * SIDEDEF_SIZE + 28) == NO_SECTOR)
+                verify_issue(task, "line %zu has a front side without a sector", i);
+
+            // Walls keep a back side without a sector, only two-sided lines need a real one
+            if (back != NO_SIDEDEF && back >= num_sides)
+                verify_issue(task, "line %zu uses missing side %u", i, back);
+            else if ((flags & LF_TWO_SIDED) &&
+                     (back == NO_SIDEDEF || read_u16le(sides + back * SIDEDEF_SIZE + 28) == NO_SECTOR))
+                verify_issue(task, "line %zu is two-sided without a back sector", i);
+        }
+    } else if (task->lump == LUMP_SIDEDEFS) {
+        // Sides without a sector are only an issue once a line uses them, see above
+        for (size_t i = 0; i < count; i++) {
+            uint16_t sector = read_u16le(data + i * record_size + 28);
+            if (sector != NO_SECTOR && sector >= num_sectors)
+                verify_issue(task, "side %zu uses missing sector %u", i, sector);
+        }
+    }
+}
+
+void verify_issue(struct VerifyTask* task, const char* format, ...) {
+    if (task->issues++ > 0)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(task->first, ERROR_MAX, format, args);
+    va_end(args);
+}
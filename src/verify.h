@@ -0,0 +1,38 @@
+#pragma once
+
+#include "config.h"
+#include "error.h"
+#include "file.h"
+#include "map.h"
+
+// Lumps of a map in a WAD that is being verified, pointing into the mapped file
+struct VerifyMap {
+    char name[LUMP_NAME_MAX];
+    const uint8_t* data[MAP_LUMPS];
+    uint32_t sizes[MAP_LUMPS];
+    bool found[MAP_LUMPS];
+};
+
+// One lump of one map, checked on the thread pool and reported in directory order
+struct VerifyTask {
+    const struct VerifyMap* map;
+    int lump;
+    size_t issues;
+    char first[ERROR_MAX];
+};
+
+struct Verify {
+    const char* name;
+    struct FileView view;
+
+    struct VerifyMap* maps;
+    size_t num_maps;
+    struct VerifyTask* tasks;
+    size_t num_tasks;
+};
+
+bool verify_wad(const char*);
+bool verify_directory(struct Verify*, size_t*);
+size_t verify_map(const struct VerifyMap*);
+void verify_lump(void*, size_t);
+void verify_issue(struct VerifyTask*, const char*, ...);
@@ -0,0 +1,66 @@
+#include <string.h>
+
+#include "wolf2wad.h"
+
+bool wolf2wad_config(struct Config* config, const char* source, size_t size) {
+    return config_parse(config, "config", source, size);
+}
+
+bool wolf2wad_convert(const struct Config* config, const struct Wolf2WadInput* input, struct Wolf2WadOutput* output) {
+    // Levels are converted one after another on the calling thread, nothing touches the filesystem
+    memset(output, 0, sizeof(struct Wolf2WadOutput));
+    output->maps = stats_calloc(input->num_levels > 0 ? input->num_levels : 1, sizeof(struct MapLumps));
+    if (output->maps == NULL)
+        return fail("wolf2wad_convert: Out of memory");
+
+    struct WadWriter writer;
+    if (!wad_open_buffer(&writer, input->num_levels)) {
+        wolf2wad_free(output);
+        return false;
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < input->num_levels && success; i++) {
+        struct WolfMap wolfmap;
+        struct DoomMap doommap = {0};
+        struct MapLumps lumps = {0};
+        success = map_read(
+                      &wolfmap, input->maphead, input->maphead_size, input->gamemaps, input->gamemaps_size,
+                      input->levels[i], PLANES_ALL
+                  ) &&
+                  map_decode(&wolfmap) && map_to_wad(&doommap, &wolfmap, config) &&
+                  pack_map(&lumps, config, &doommap) && wad_add_map(&writer, &lumps);
+        map_teardown(&wolfmap, &doommap);
+        free_lumps(&lumps);
+    }
+
+    // Offsets only become pointers once the buffer has stopped growing
+    if (success) {
+        output->num_maps = input->num_levels;
+        for (size_t i = 0; i < output->num_maps; i++) {
+            struct MapLumps* map = &output->maps[i];
+            const struct WadLump* directory = &writer.directory[i * MAP_LUMPS];
+            memcpy(map->name, directory[0].name, LUMP_NAME_MAX);
+            for (int j = 0; j < MAP_LUMPS; j++) {
+                map->sizes[j] = directory[j].size;
+                map->data[j] = directory[j].size > 0 ? writer.buffer + directory[j].filepos : NULL;
+            }
+        }
+    }
+
+    if (!wad_close(&writer, success)) {
+        wolf2wad_free(output);
+        return false;
+    }
+    output->wad = writer.buffer;
+    output->wad_size = writer.append;
+    return true;
+}
+
+void wolf2wad_free(struct Wolf2WadOutput* output) {
+    if (output->wad != NULL)
+        stats_free(output->wad);
+    if (output->maps != NULL)
+        stats_free(output->maps);
+    memset(output, 0, sizeof(struct Wolf2WadOutput));
+}
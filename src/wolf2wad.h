@@ -0,0 +1,26 @@
+#pragma once
+
+#include "config.h"
+#include "error.h"
+#include "map.h"
+#include "stats.h"
+
+// Levels to convert from MAPHEAD and GAMEMAPS already in memory
+struct Wolf2WadInput {
+    const uint8_t *maphead, *gamemaps;
+    size_t maphead_size, gamemaps_size;
+    const int* levels;
+    size_t num_levels;
+};
+
+// PWAD laid out like one written by the CLI, with each level's lumps pointing into it
+struct Wolf2WadOutput {
+    uint8_t* wad;
+    size_t wad_size;
+    struct MapLumps* maps;
+    size_t num_maps;
+};
+
+bool wolf2wad_config(struct Config*, const char*, size_t);
+bool wolf2wad_convert(const struct Config*, const struct Wolf2WadInput*, struct Wolf2WadOutput*);
+void wolf2wad_free(struct Wolf2WadOutput*);
@@ -0,0 +1,210 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Writes MAPHEAD.* and GAMEMAPS.* of synthetic levels for the golden tests. Everything comes from a fixed seed, so
+// the levels are the same on every machine.
+
+#define RLEW_TAG 0xABCD
+#define NEAR_TAG 0xA7
+#define FAR_TAG 0xA8
+#define MAX_SIZE 128
+
+#define TILE_DOOR_X 90
+#define TILE_DOOR_Y 91
+#define TILE_AMBUSH 106
+#define TILE_AREA 108
+#define OBJ_PUSHWALL 98
+
+struct LevelSet {
+    const char* ext;
+    uint32_t seed;
+    int num_levels, sizes[4];
+    int num_walls, num_midtex;
+    uint16_t midtex[5];
+};
+
+static const struct LevelSet sets[] = {
+    {"wl6", 1, 4, {64, 64, 96, MAX_SIZE}, 39, 0, {0}},
+    {"sod", 2, 2, {64, 64}, 59, 5, {66, 67, 68, 69, 70}},
+};
+
+static const uint16_t things[] = {19, 20, 23, 24, 25, 43, 44};
+
+static uint32_t state;
+
+static uint32_t next_random(uint32_t range) {
+    // xorshift32, rand() differs between C libraries
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state % range;
+}
+
+static void generate(const struct LevelSet* set, int size, uint16_t* walls, uint16_t* objects) {
+    // Rooms of area codes split by a grid of walls with doors, then pillars, pushwalls, ambush tiles and things
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++) {
+            bool border = x == 0 || y == 0 || x == size - 1 || y == size - 1;
+            uint32_t area = TILE_AREA + (x / 12 + y / 12 * 3) % 36;
+            walls[y * size + x] = (uint16_t)(border ? 1 + next_random(set->num_walls) : area);
+            objects[y * size + x] = 0;
+        }
+
+    for (int gx = 8; gx < size - 1; gx += 8) {
+        uint16_t wall = 1 + next_random(set->num_walls);
+        for (int y = 1; y < size - 1; y++)
+            walls[y * size + gx] = (y % 8 == 4 && y < size - 2 && next_random(5) > 0) ? TILE_DOOR_X : wall;
+    }
+    for (int gy = 8; gy < size - 1; gy += 8) {
+        uint16_t wall = 1 + next_random(set->num_walls);
+        for (int x = 1; x < size - 1; x++) {
+            uint16_t* tile = &walls[gy * size + x];
+            if (*tile == TILE_DOOR_X)
+                continue;
+            bool open = walls[(gy - 1) * size + x] >= TILE_AMBUSH && walls[(gy + 1) * size + x] >= TILE_AMBUSH;
+            *tile = (x % 8 == 4 && x < size - 2 && open && next_random(5) > 0) ? TILE_DOOR_Y : wall;
+        }
+    }
+
+    for (int i = 0; i < size * size / 40; i++) {
+        int x = 1 + next_random(size - 2), y = 1 + next_random(size - 2);
+        uint16_t* tile = &walls[y * size + x];
+        uint32_t roll = next_random(20);
+        if (*tile < TILE_AMBUSH)
+            continue;
+        if (roll < 8)
+            *tile = 1 + next_random(set->num_walls);
+        else if (roll < 11 && set->num_midtex > 0)
+            *tile = set->midtex[next_random(set->num_midtex)];
+        else if (roll < 14)
+            *tile = TILE_AMBUSH;
+        else if (roll < 15)
+            *tile = TILE_AMBUSH + 1;
+        else
+            objects[y * size + x] = things[next_random(sizeof(things) / sizeof(things[0]))];
+    }
+    for (int i = 0; i < size * size / 200; i++) {
+        int x = 1 + next_random(size - 2), y = 1 + next_random(size - 2);
+        if (walls[y * size + x] <= set->num_walls)
+            objects[y * size + x] = OBJ_PUSHWALL;
+    }
+}
+
+static size_t encode(const uint16_t* plane, size_t count, uint8_t* out) {
+    // RLEW, then Carmack without any pointers, escaping the words that look like one
+    static uint16_t rlew[MAX_SIZE * MAX_SIZE * 3 + 1];
+    size_t words = 0;
+    rlew[words++] = (uint16_t)(count * 2);
+    for (size_t i = 0; i < count;) {
+        size_t run = 1;
+        while (i + run < count && plane[i + run] == plane[i] && run < 0xFFFF)
+            ++run;
+        if (run > 3 || plane[i] == RLEW_TAG) {
+            rlew[words++] = RLEW_TAG;
+            rlew[words++] = (uint16_t)run;
+            rlew[words++] = plane[i];
+        } else {
+            for (size_t j = 0; j < run; j++)
+                rlew[words++] = plane[i];
+        }
+        i += run;
+    }
+
+    size_t size = 0;
+    out[size++] = (uint8_t)(words * 2);
+    out[size++] = (uint8_t)(words * 2 >> 8);
+    for (size_t i = 0; i < words; i++) {
+        uint8_t high = rlew[i] >> 8;
+        if (high == NEAR_TAG || high == FAR_TAG) {
+            out[size++] = 0;
+            out[size++] = high;
+            out[size++] = (uint8_t)rlew[i];
+        } else {
+            out[size++] = (uint8_t)rlew[i];
+            out[size++] = high;
+        }
+    }
+    return size;
+}
+
+static void put_u16(uint8_t* ptr, uint32_t value) {
+    ptr[0] = (uint8_t)value;
+    ptr[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* ptr, uint32_t value) {
+    put_u16(ptr, value);
+    put_u16(ptr + 2, value >> 16);
+}
+
+static bool write_file(const char* dir, const char* name, const char* ext, const uint8_t* data, size_t size) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.%s", dir, name, ext);
+    FILE* file = fopen(path, "wb");
+    bool success = file != NULL && fwrite(data, 1, size, file) == size;
+    if (file != NULL && fclose(file) != 0)
+        success = false;
+    if (!success)
+        fprintf(stderr, "levelgen: Failed to write \"%s\"\n", path);
+    return success;
+}
+
+static bool write_set(const char* dir, const struct LevelSet* set) {
+    // Three planes of at most 3 bytes per word each, plus level headers
+    static uint16_t walls[MAX_SIZE * MAX_SIZE], objects[MAX_SIZE * MAX_SIZE], misc[MAX_SIZE * MAX_SIZE];
+    static uint8_t gamemaps[8 + 4 * (3 * (MAX_SIZE * MAX_SIZE * 9 + 8) + 38)];
+    uint8_t maphead[2 + 100 * 4] = {0};
+
+    state = set->seed;
+    memcpy(gamemaps, "TED5v1.0", 8);
+    size_t size = 8;
+    put_u16(maphead, RLEW_TAG);
+    for (int level = 0; level < set->num_levels; level++) {
+        int side = set->sizes[level];
+        generate(set, side, walls, objects);
+
+        uint32_t offsets[3];
+        size_t sizes[3];
+        const uint16_t* planes[3] = {walls, objects, misc};
+        for (int i = 0; i < 3; i++) {
+            offsets[i] = (uint32_t)size;
+            sizes[i] = encode(planes[i], (size_t)side * side, gamemaps + size);
+            size += sizes[i];
+            if (sizes[i] > UINT16_MAX) {
+                fprintf(stderr, "levelgen: Plane %d of level %d doesn't fit in GAMEMAPS\n", i, level);
+                return false;
+            }
+        }
+
+        put_u32(maphead + 2 + level * 4, (uint32_t)size);
+        uint8_t* header = gamemaps + size;
+        memset(header, 0, 38);
+        for (int i = 0; i < 3; i++) {
+            put_u32(header + i * 4, offsets[i]);
+            put_u16(header + 12 + i * 2, (uint32_t)sizes[i]);
+        }
+        put_u16(header + 18, side);
+        put_u16(header + 20, side);
+        snprintf((char*)header + 22, 16, "Synthetic %d", level + 1);
+        size += 38;
+    }
+
+    printf("levelgen: Wrote %d level(s) to %s/GAMEMAPS.%s\n", set->num_levels, dir, set->ext);
+    return write_file(dir, "MAPHEAD", set->ext, maphead, sizeof(maphead)) &&
+           write_file(dir, "GAMEMAPS", set->ext, gamemaps, size);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: levelgen <dir>\n");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++)
+        if (!write_set(argv[1], &sets[i]))
+            return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}